@@ -33,15 +33,18 @@
 #include "log.h"
 #include "cline.h"
 #include "profile.h"
+#include "fftplan.h"
+#include "pool.h"
+#include "stream.h"
 
 int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 {
 	long int		pos = 0;
 	double			longest = 0;
-	double			*buffer;
+	SampleValue		*buffer;
 	long int		buffersize = 0;
 	windowManager	windows;
-	double			*windowUsed = NULL;
+	windowUnit		*windowUsed = NULL;
 	long int		loadedBlockSize = 0, i = 0, matchIndex = 0;
 	struct timespec	start, end;
 	int				discardBytes = 0;
@@ -77,7 +80,7 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 	}
 
 	buffersize = SecondsToSamples(Signal->SampleRate, longest, Signal->AudioChannels, NULL, NULL);
-	buffer = (double*)malloc(sizeof(double)*buffersize);
+	buffer = (SampleValue*)malloc(sizeof(SampleValue)*buffersize);
 	if(!buffer)
 	{
 		logmsg("\tmalloc failed\n");
@@ -104,7 +107,7 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 
 		difference = GetSampleSizeDifferenceByFrameRate(Signal->framerate, frames, Signal->SampleRate, Signal->AudioChannels, config);
 
-		windowUsed = getWindowByLength(&windows, frames, cutFrames, config->smallerFramerate, config);
+		windowUsed = getWindowUnitByLength(&windows, frames, cutFrames, config->smallerFramerate, config);
 
 		if(i == block)
 		{
@@ -123,12 +126,17 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 				break;
 			}
 			
-			memcpy(buffer, Signal->Samples + pos, sizeof(double)*(loadedBlockSize-difference));
+			if(!StreamSamples(Signal, pos, pos + loadedBlockSize))
+			{
+				free(buffer);
+				return 0;
+			}
+			memcpy(buffer, Signal->Samples + pos, sizeof(SampleValue)*(loadedBlockSize-difference));
 	
-			if(!ExecuteBalanceDFFT(&Channels[0], buffer, (loadedBlockSize-difference), Signal->SampleRate, windowUsed, CHANNEL_LEFT, config))
+			if(!ExecuteBalanceDFFT(&Channels[0], buffer, (loadedBlockSize-difference), Signal->SampleRate, windowUsed, CHANNEL_LEFT, &Signal->pool, config))
 				return 0;
 
-			if(!ExecuteBalanceDFFT(&Channels[1], buffer, (loadedBlockSize-difference), Signal->SampleRate, windowUsed, CHANNEL_RIGHT, config))
+			if(!ExecuteBalanceDFFT(&Channels[1], buffer, (loadedBlockSize-difference), Signal->SampleRate, windowUsed, CHANNEL_RIGHT, &Signal->pool, config))
 				return 0;
 
 			Channels[0].freq = (Frequency*)malloc(sizeof(Frequency)*config->MaxFreq);
@@ -295,14 +303,14 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 	return 1;
 }
 
-int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, char channel, parameters *config)
+int ExecuteBalanceDFFT(AudioBlocks *AudioArray, SampleValue *samples, size_t size, double samplerate, windowUnit *window, char channel, BufferPool *pool, parameters *config)
 {
-	fftw_plan		p = NULL;
 	long		  	stereoSignalSize = 0;	
 	long		  	i = 0, monoSignalSize = 0, zeropadding = 0;
 	double		  	*signal = NULL;
 	fftw_complex  	*spectrum = NULL;
 	double		 	seconds = 0, S2 = 0;
+	size_t			signalBytes = 0, spectrumBytes = 0;
 	
 	if(!AudioArray)
 	{
@@ -317,40 +325,22 @@ int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, do
 	if(config->ZeroPad)  /* disabled by default */
 		zeropadding = GetZeroPadValues(&monoSignalSize, &seconds, samplerate, 1);
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+	signalBytes = sizeof(double)*(monoSignalSize+1);
+	spectrumBytes = sizeof(fftw_complex)*(monoSignalSize/2+1);
+	signal = (double*)PoolAlloc(pool, signalBytes);
 	if(!signal)
 	{
 		logmsg("Not enough memory\n");
 		return(0);
 	}
-	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
+	spectrum = (fftw_complex*)PoolAlloc(pool, spectrumBytes);
 	if(!spectrum)
 	{
+		PoolFree(pool, signal, signalBytes);
 		logmsg("Not enough memory\n");
 		return(0);
 	}
 
-	if(!config->model_plan)
-	{
-		config->model_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->model_plan)
-		{
-			logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			return 0;
-		}
-	}
-
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-	if(!p)
-	{
-		logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-		free(signal);
-		signal = NULL;
-		return 0;
-	}
-
 	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
 	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
 
@@ -360,19 +350,22 @@ int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, do
 			signal[i] = (double)samples[i*2];
 		if(channel == CHANNEL_RIGHT)
 			signal[i] = (double)samples[i*2+1];
-
-		if(window)
-		{
-			signal[i] *= window[i];
-			S2 += window[i]*window[i];
-		}
+	}
+	if(window)
+	{
+		for(long int j = 0; j < i; j++)
+			signal[j] *= window->window[j];
+		S2 = GetWindowEnergy(window, i);
 	}
 
-	fftw_execute(p); 
-	fftw_destroy_plan(p);
-	p = NULL;
+	if(!ExecuteRealToComplex(monoSignalSize, signal, spectrum, config))
+	{
+		PoolFree(pool, signal, signalBytes);
+		PoolFree(pool, spectrum, spectrumBytes);
+		return 0;
+	}
 
-	free(signal);
+	PoolFree(pool, signal, signalBytes);
 	signal = NULL;
 
 	AudioArray->fftwValues.spectrum = spectrum;
@@ -386,7 +379,7 @@ int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, do
 void BalanceAudioChannel(AudioSignal *Signal, char channel, double ratio)
 {
 	long int 	i = 0, start = 0, end = 0;
-	double		*samples = NULL;
+	SampleValue	*samples = NULL;
 
 	if(!Signal)
 		return;
@@ -394,6 +387,12 @@ void BalanceAudioChannel(AudioSignal *Signal, char channel, double ratio)
 	if(!Signal->Samples)
 		return;
 
+	if(Signal->stream.active)
+	{
+		SetStreamChannelGain(Signal, channel, ratio);
+		return;
+	}
+
 	samples = Signal->Samples;
 	start = Signal->startOffset;
 	end = Signal->endOffset;
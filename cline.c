@@ -30,6 +30,8 @@
 #include "log.h"
 #include "plot.h"
 #include "profile.h"
+#include "fftplan.h"
+#include "synccache.h"
 
 #define CHAR_FOLDER_REMOVE		0
 #define CHAR_FOLDER_OK			1
@@ -55,6 +57,10 @@ void PrintUsage(void)
 	logmsg("	 -I: <I>gnore frame rate difference for analysis\n");
 	logmsg("	 -p: Define the noise floor value in dBFS (0 to disable auto adjust)\n");
 	logmsg("	 -T: Increase Sync detection <T>olerance (ignore frequency for pulses)\n");
+	logmsg("	 -2: Find sync by correlation against the expected pulse train\n");
+	logmsg("	 -3: Cache detected sync in a %s file next to each audio file\n", SYNC_CACHE_EXT);
+	logmsg("	 -4: Stream audio from disk, only the blocks in use are kept in memory\n");
+	logmsg("	 -6: Decode FLAC files in parallel segments, the MD5 signature is not verified\n");
 	logmsg("	 -Y: Define the Reference Video Format from the profile\n");
 	logmsg("	 -Z: Define the Comparison Video Format from the profile\n");
 	logmsg("	 -m: Set <m>anual sync samples, takes format [r|c]:<start sample>:<end sample>\n");
@@ -66,11 +72,15 @@ void PrintUsage(void)
 	logmsg("	 -R: Adjust sample <R>ate if duration difference is found\n");
 	logmsg("	 -j: Ad<j>ust clock (profile defined) via FFTW if difference is found\n");
 	logmsg("	 -k: cloc<k> FFTW operations\n");
+	logmsg("	 -K: Load and save FFTW wisdom from this file (default %s)\n", WISDOM_FILE);
+	logmsg("	 -U: Use single precision FFTs for the block analysis, faster with a small accuracy loss\n");
+	logmsg("		use -UU to validate, reports the max dB deviation against double precision\n");
 	logmsg("	 -X: Do not use E<x>tra Data from the Profile\n");
 	logmsg("   Output options:\n");
 	logmsg("	 -l: Do not <l>og output to file [reference]_vs_[compare].txt\n");
 	logmsg("	 -v: Enable <v>erbose mode, spits all the FFTW results\n");
 	logmsg("	 -C: Create <C>SV file with plot values.\n");
+	logmsg("	 -5: Save all amplitude differences to a binary columnar file (.mdfd)\n");
 	logmsg("	 -b: Change <b>ar value for frequency match, default is 1.0dB.\n");
 	logmsg("	 -A: Do not weight values in <A>veraged Plot (implies -g)\n");
 	logmsg("	 -G: Adjust difference plots around avera<G>e difference.\n");
@@ -170,11 +180,16 @@ void CleanParameters(parameters *config)
 	config->ignoreFrameRateDiff = 0;
 	config->labelNames = 1;
 	config->outputCSV = 0;
+	config->outputBinary = 0;
 	config->whiteBG = 0;
 	config->smallFile = 0;
 	config->videoFormatRef = 0;
 	config->videoFormatCom = 0;
 	config->syncTolerance = 0;
+	config->syncCorrelation = 0;
+	config->useSyncCache = 0;
+	config->streamPCM = 0;
+	config->segmentFLAC = 0;
 	config->AmpBarRange = BAR_DIFF_DB_TOLERANCE;
 	config->FullTimeSpectroScale = 0;
 	config->hasTimeDomain = 0;
@@ -215,7 +230,6 @@ void CleanParameters(parameters *config)
 		config->syncAlignPct[i] = 0;
 		config->syncAlignTolerance[i] = 0;
 	}
-	config->syncAlignIterator = 0;
 
 	config->logScale = 1;
 	config->logScaleTS = 0;
@@ -246,6 +260,7 @@ void CleanParameters(parameters *config)
 	config->noBalance = 0;
 
 	config->Differences.BlockDiffArray = NULL;
+	memset(&config->Differences.arena, 0, sizeof(DifferenceArena));
 	config->Differences.cntFreqAudioDiff = 0;
 	config->Differences.cntAmplAudioDiff = 0;
 	
@@ -267,9 +282,10 @@ void CleanParameters(parameters *config)
 	config->thresholdMissingHiDif = MISS_HIDIFF;
 	config->thresholdExtraHiDif = EXTRA_HIDIFF;
 
-	config->sync_plan = NULL;
-	config->model_plan = NULL;
-	config->reverse_plan = NULL;
+	sprintf(config->wisdomFile, "%s", WISDOM_FILE);
+	config->singlePrecision = 0;
+	config->singlePrecisionMaxDev = 0;
+	config->singlePrecisionBlocks = 0;
 
 	config->referenceSignal = NULL;
 	config->comparisonSignal = NULL;
@@ -319,8 +335,8 @@ int commandline(int argc , char *argv[], parameters *config)
 	
 	CleanParameters(config);
 
-	// Available: KU123456
-	while ((c = getopt (argc, argv, "Aa:Bb:Cc:Dd:Ee:Ff:GgH:hIiJjkL:lMm:Nn:Oo:P:p:Qq:R:r:Ss:TtuVvWw:XxY:yZ:z0:789")) != -1)
+	// Available: 1
+	while ((c = getopt (argc, argv, "Aa:Bb:Cc:Dd:Ee:Ff:GgH:hIiJjK:kL:lMm:Nn:Oo:P:p:Qq:R:r:Ss:TtUuVvWw:XxY:yZ:z0:23456789")) != -1)
 	switch (c)
 	  {
 	  case 'A':
@@ -451,6 +467,9 @@ int commandline(int argc , char *argv[], parameters *config)
 		config->doClkAdjust = 1;
 		logmsg("\t-Adjusting Clock\n");
 		break;
+	  case 'K':
+		snprintf(config->wisdomFile, BUFFER_SIZE, "%s", optarg);
+		break;
 	  case 'k':
 		config->clock = 1;
 		break;
@@ -678,6 +697,11 @@ int commandline(int argc , char *argv[], parameters *config)
 	  case 't':
 		config->plotTimeSpectrogram = 0;
 		break;
+	  case 'U':
+		config->singlePrecision++;
+		if(config->singlePrecision > SINGLE_PRECISION_VALIDATE)
+			config->singlePrecision = SINGLE_PRECISION_VALIDATE;
+		break;
 	  case 'u':
 		config->plotAllNotes++;
 		if(config->plotAllNotes > 4)
@@ -782,6 +806,26 @@ int commandline(int argc , char *argv[], parameters *config)
 	  case '0':
 		sprintf(config->outputPath, "%s", optarg);
 		break;
+	  case '2':
+		config->syncCorrelation = 1;
+		logmsg("\t-Sync pulse trains will be located by correlation\n");
+		break;
+	  case '3':
+		config->useSyncCache = 1;
+		logmsg("\t-Detected sync will be cached next to the audio files\n");
+		break;
+	  case '4':
+		config->streamPCM = 1;
+		logmsg("\t-Audio will be streamed from disk as blocks are processed\n");
+		break;
+	  case '5':
+		config->outputBinary = 1;
+		logmsg("\t-Amplitude differences will be saved to a binary columnar file\n");
+		break;
+	  case '6':
+		config->segmentFLAC = 1;
+		logmsg("\t-FLAC files will be decoded in parallel segments without MD5 verification\n");
+		break;
 	  case '7':
 		config->drawWindows = 1;
 		break;
@@ -806,6 +850,8 @@ int commandline(int argc , char *argv[], parameters *config)
 		  logmsg("\t ERROR: Max # of frequencies to use from FFTW -%c requires an argument: 1-%d\n", optopt, MAX_FREQ_COUNT);
 		else if (optopt == 'H')
 		  logmsg("\t ERROR: Highly different waveform -%c requires an argument: 0.01-100.0\n", optopt);
+		else if (optopt == 'K')
+		  logmsg("\t ERROR: FFTW wisdom file -%c requires a file argument\n", optopt);
 		else if (optopt == 'L')
 		  logmsg("\t ERROR: Plot Resolution -%c requires an argument: 1-6\n", optopt);
 		else if (optopt == 'm')
@@ -0,0 +1,199 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library:
+ *	  http://www.fftw.org/
+ *
+ */
+
+/*
+ * Sample decode kernels, one per sample format, kept apart from
+ * loadfile.c so each one can be checked and timed against its scalar
+ * loop on its own (make decodetest).
+ *
+ * The SSE2 paths are always there on x86-64, the 24 bit one uses pshufb
+ * when built with SSSE3 and overlapping 32 bit loads otherwise. Every
+ * path gives the scalar result: up to 24 bit PCM fits in a float and all
+ * of it in a double, 32 bit PCM rounds to nearest into float in both.
+ * The scalar loops do the tails and the other architectures. With double
+ * samples 32 bit PCM and float are only widened, the compiler vectorizes
+ * those loops as well as the intrinsics did, so they are used directly.
+ */
+
+#include "decode.h"
+
+#if defined(__SSSE3__)
+	#include <tmmintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+#ifdef __SSE2__
+#ifdef FLOAT_SAMPLES
+static inline void DecodeStoreInt32x4(__m128i v, SampleValue *samples)
+{
+	_mm_storeu_ps(samples, _mm_cvtepi32_ps(v));
+}
+#else
+static inline void DecodeStoreInt32x4(__m128i v, SampleValue *samples)
+{
+	_mm_storeu_pd(samples, _mm_cvtepi32_pd(v));
+	_mm_storeu_pd(samples+2, _mm_cvtepi32_pd(_mm_unpackhi_epi64(v, v)));
+}
+#endif
+
+// Sign extends by placing each value in the top half of a lane
+static inline void DecodeStoreInt16x8(__m128i v, SampleValue *samples)
+{
+	DecodeStoreInt32x4(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16), samples);
+	DecodeStoreInt32x4(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16), samples+4);
+}
+#endif
+
+static inline double DecodePCM24Sample(const uint8_t *bytes)
+{
+	return (double)((int32_t)(((uint32_t)bytes[0] << 8) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 24)) >> 8);
+}
+
+void DecodePCM8Scalar(const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	for(long int i = 0; i < count; i++)
+		samples[i] = (double)(bytes[i]-0x80);	// 8 bit is unsigned. Convert to signed
+}
+
+void DecodePCM16Scalar(const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	for(long int i = 0; i < count; i++)
+		samples[i] = (double)(int16_t)(bytes[i*2] | (bytes[i*2+1] << 8));
+}
+
+void DecodePCM24Scalar(const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	for(long int i = 0; i < count; i++)
+		samples[i] = DecodePCM24Sample(bytes+i*3);
+}
+
+void DecodePCM32Scalar(const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	for(long int i = 0; i < count; i++)
+	{
+		int32_t	sample = 0;
+
+		memcpy(&sample, bytes+i*4, sizeof(int32_t));
+		samples[i] = (double)sample;
+	}
+}
+
+void DecodeFloat32Scalar(const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	for(long int i = 0; i < count; i++)
+	{
+		float	sample = 0;
+
+		memcpy(&sample, bytes+i*4, sizeof(float));
+		samples[i] = sample;
+	}
+}
+
+void DecodePCM8(const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	long int	i = 0;
+
+#ifdef __SSE2__
+	const __m128i	zero = _mm_setzero_si128(), bias = _mm_set1_epi16(0x80);
+
+	for(; i + 8 <= count; i += 8)
+	{
+		__m128i	v = _mm_loadl_epi64((const __m128i*)(bytes+i));
+
+		v = _mm_sub_epi16(_mm_unpacklo_epi8(v, zero), bias);
+		DecodeStoreInt16x8(v, samples+i);
+	}
+#endif
+	DecodePCM8Scalar(bytes+i, samples+i, count-i);
+}
+
+void DecodePCM16(const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	long int	i = 0;
+
+#ifdef __SSE2__
+	for(; i + 8 <= count; i += 8)
+		DecodeStoreInt16x8(_mm_loadu_si128((const __m128i*)(bytes+i*2)), samples+i);
+#endif
+	DecodePCM16Scalar(bytes+i*2, samples+i, count-i);
+}
+
+void DecodePCM24(const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	long int	i = 0;
+
+#if defined(__SSSE3__)
+	// Each sample goes to the top three bytes of a lane, sign extended by the shift
+	const __m128i	spread = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+
+	// 16 bytes are loaded for 12, the last four samples are left to the tail
+	for(; i + 6 <= count; i += 4)
+	{
+		__m128i	v = _mm_loadu_si128((const __m128i*)(bytes+i*3));
+
+		DecodeStoreInt32x4(_mm_srai_epi32(_mm_shuffle_epi8(v, spread), 8), samples+i);
+	}
+#elif defined(__SSE2__)
+	// Samples 1-3 are taken with the byte before them, so only these 12 bytes are read
+	for(; i + 4 <= count; i += 4)
+	{
+		uint64_t	low = 0;
+		uint32_t	high = 0;
+
+		memcpy(&low, bytes+i*3, sizeof(uint64_t));
+		memcpy(&high, bytes+i*3+8, sizeof(uint32_t));
+		DecodeStoreInt32x4(_mm_srai_epi32(_mm_set_epi32((int32_t)high, (int32_t)((low >> 40) | ((uint64_t)high << 24)),
+			(int32_t)(low >> 16), (int32_t)(low << 8)), 8), samples+i);
+	}
+#endif
+	DecodePCM24Scalar(bytes+i*3, samples+i, count-i);
+}
+
+void DecodePCM32(const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	long int	i = 0;
+
+#if defined(__SSE2__) && defined(FLOAT_SAMPLES)
+	for(; i + 4 <= count; i += 4)
+		DecodeStoreInt32x4(_mm_loadu_si128((const __m128i*)(bytes+i*4)), samples+i);
+#endif
+	DecodePCM32Scalar(bytes+i*4, samples+i, count-i);
+}
+
+void DecodeFloat32(const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	long int	i = 0;
+
+#ifdef FLOAT_SAMPLES
+	// Same layout, RIFF and this code are little endian
+	memcpy(samples, bytes, sizeof(float)*count);
+	i = count;
+#endif
+	DecodeFloat32Scalar(bytes+i*4, samples+i, count-i);
+}
@@ -0,0 +1,48 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library:
+ *	  http://www.fftw.org/
+ *
+ */
+
+#ifndef MDFOURIER_DECODE_H
+#define MDFOURIER_DECODE_H
+
+#include "mdfourier.h"
+
+// Little endian RIFF sample bytes to SampleValue, count is in samples
+void DecodePCM8(const uint8_t *bytes, SampleValue *samples, long int count);
+void DecodePCM16(const uint8_t *bytes, SampleValue *samples, long int count);
+void DecodePCM24(const uint8_t *bytes, SampleValue *samples, long int count);
+void DecodePCM32(const uint8_t *bytes, SampleValue *samples, long int count);
+void DecodeFloat32(const uint8_t *bytes, SampleValue *samples, long int count);
+
+// The same conversions one sample at a time, the kernels use them for their tails
+void DecodePCM8Scalar(const uint8_t *bytes, SampleValue *samples, long int count);
+void DecodePCM16Scalar(const uint8_t *bytes, SampleValue *samples, long int count);
+void DecodePCM24Scalar(const uint8_t *bytes, SampleValue *samples, long int count);
+void DecodePCM32Scalar(const uint8_t *bytes, SampleValue *samples, long int count);
+void DecodeFloat32Scalar(const uint8_t *bytes, SampleValue *samples, long int count);
+
+#endif
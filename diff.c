@@ -30,97 +30,77 @@
 #include "log.h"
 #include "freq.h"
 
-#define STEREO_DIFF_SIZE	2*config->MaxFreq
-#define MONO_DIFF_SIZE		config->MaxFreq
+#define DIFF_ARENA_ALIGN	16
+#define DIFF_ARENA_ROUND(x)	(((x) + DIFF_ARENA_ALIGN - 1) & ~((size_t)DIFF_ARENA_ALIGN - 1))
 
-long int GetSilenceBlockSize(int block, parameters *config)
+#define DIFF_ENTRY_BYTES	(DIFF_ARENA_ROUND(sizeof(FreqDifference)) + DIFF_ARENA_ROUND(sizeof(AmplDifference)) + DIFF_ARENA_ROUND(sizeof(PhaseDifference)))
+
+// Each compared reference frequency adds at most one entry to each array
+long int GetBlockDifferenceSize(int block, parameters *config)
 {
-	long int s1, s2, size = 0;
-
-	s1 = config->referenceSignal->Blocks[block].SilenceSizeLeft + config->referenceSignal->Blocks[block].SilenceSizeRight;
-	s2 = config->comparisonSignal->Blocks[block].SilenceSizeLeft + config->comparisonSignal->Blocks[block].SilenceSizeRight;
-	if(s1 > s2)
-		size = s1;
-	else
-		size = s2;
+	long int	size = 0;
+	double		significant = 0;
+
+	significant = GetBlockType(config, block) != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT;
+	size = CalculateMaxCompare(block, config->referenceSignal, significant, CHANNEL_LEFT, config);
+	if(GetBlockChannel(config, block) == CHANNEL_STEREO)
+		size += CalculateMaxCompare(block, config->referenceSignal, significant, CHANNEL_RIGHT, config);
 	return size;
 }
 
-AmplDifference *CreateAmplDifferences(int block, parameters *config)
+/*
+	All difference arrays live in one allocation, that only grows when a
+	comparison needs more than the previous one reserved.
+*/
+static int ReserveDifferenceArena(DifferenceArena *arena, size_t bytes)
 {
-	AmplDifference	*ad = NULL;
-	long int		size = 0;
+	if(bytes < DIFF_ARENA_ALIGN)
+		bytes = DIFF_ARENA_ALIGN;
 
-	if(GetBlockType(config, block) == TYPE_SILENCE)
-		size = GetSilenceBlockSize(block, config);
-	else
-	{
-		if(GetBlockChannel(config, block) == CHANNEL_STEREO)
-			size = STEREO_DIFF_SIZE;
-		else
-			size = MONO_DIFF_SIZE;
-	}
-	ad = (AmplDifference*)malloc(sizeof(AmplDifference)*size);
-	if(!ad)
+	if(bytes > arena->reserved)
 	{
-		logmsg("Insufficient memory for AmplDifference (%ld bytes)\n", sizeof(AmplDifference)*size);
-		return 0;
+		char	*memory = NULL;
+
+		memory = (char*)realloc(arena->memory, bytes);
+		if(!memory)
+		{
+			logmsg("Insufficient memory for difference arrays (%zu bytes)\n", bytes);
+			return 0;
+		}
+		arena->memory = memory;
+		arena->reserved = bytes;
 	}
-	memset(ad, 0, sizeof(AmplDifference)*size);
-	return ad;
+	arena->used = 0;
+	return 1;
 }
 
-FreqDifference *CreateFreqDifferences(int block, parameters *config)
+static void *CarveDifferenceArena(DifferenceArena *arena, size_t bytes)
 {
-	FreqDifference *fd = NULL;
-	long int		size = 0;
+	void	*extent = NULL;
 
-	if(GetBlockType(config, block) == TYPE_SILENCE)
-		size = GetSilenceBlockSize(block, config);
-	else
-	{
-		if(GetBlockChannel(config, block) == CHANNEL_STEREO)
-			size = STEREO_DIFF_SIZE;
-		else
-			size = MONO_DIFF_SIZE;
-	}
-	fd = (FreqDifference*)malloc(sizeof(FreqDifference)*size);
-	if(!fd)
-	{
-		logmsg("Insufficient memory for FreqDifference (%ld bytes)\n", sizeof(sizeof(FreqDifference)*size));
-		return 0;
-	}
-	memset(fd, 0, sizeof(FreqDifference)*size);
-	return fd;
+	bytes = DIFF_ARENA_ROUND(bytes);
+	if(arena->used + bytes > arena->reserved)
+		return NULL;
+
+	extent = arena->memory + arena->used;
+	memset(extent, 0, bytes);
+	arena->used += bytes;
+	return extent;
 }
 
-PhaseDifference *CreatePhaseDifferences(int block, parameters *config)
+void ReleaseDifferenceArena(DifferenceArena *arena)
 {
-	PhaseDifference *pd = NULL;
-	long int		size = 0;
-
-	if(GetBlockType(config, block) == TYPE_SILENCE)
-		size = GetSilenceBlockSize(block, config);
-	else
-	{
-		if(GetBlockChannel(config, block) == CHANNEL_STEREO)
-			size = STEREO_DIFF_SIZE;
-		else
-			size = MONO_DIFF_SIZE;
-	}
-	pd = (PhaseDifference*)malloc(sizeof(PhaseDifference)*size);
-	if(!pd)
-	{
-		logmsg("Insufficient memory for FreqDifference (%ld bytes)\n", sizeof(sizeof(PhaseDifference)*size));
-		return 0;
-	}
-	memset(pd, 0, sizeof(PhaseDifference)*size);
-	return pd;
+	if(arena->memory)
+		free(arena->memory);
+	arena->memory = NULL;
+	arena->reserved = 0;
+	arena->used = 0;
 }
 
 int CreateDifferenceArray(parameters *config)
 {
 	BlockDifference *BlockDiffArray = NULL;
+	size_t			bytes = 0;
 
 	if(!config)
 		return 0;
@@ -134,6 +114,22 @@ int CreateDifferenceArray(parameters *config)
 
 	memset(BlockDiffArray, 0, sizeof(BlockDifference)*config->types.totalBlocks);
 
+	// Extents are sized from the frequencies that will be compared
+	for(int i = 0; i < config->types.totalBlocks; i++)
+	{
+		if(GetBlockType(config, i) >= TYPE_SILENCE)
+		{
+			BlockDiffArray[i].size = GetBlockDifferenceSize(i, config);
+			bytes += BlockDiffArray[i].size*DIFF_ENTRY_BYTES;
+		}
+	}
+
+	if(!ReserveDifferenceArena(&config->Differences.arena, bytes))
+	{
+		free(BlockDiffArray);
+		return 0;
+	}
+
 	for(int i = 0; i < config->types.totalBlocks; i++)
 	{
 		int type = TYPE_NOTYPE;
@@ -141,23 +137,14 @@ int CreateDifferenceArray(parameters *config)
 		type = GetBlockType(config, i);
 		if(type >= TYPE_SILENCE)
 		{
-			BlockDiffArray[i].freqMissArray = CreateFreqDifferences(i, config);
-			if(!BlockDiffArray[i].freqMissArray)
-			{
-				free(BlockDiffArray);
-				return 0;
-			}
-	
-			BlockDiffArray[i].amplDiffArray = CreateAmplDifferences(i, config);
-			if(!BlockDiffArray[i].amplDiffArray)
-			{
-				free(BlockDiffArray);
-				return 0;
-			}
+			long int	size = BlockDiffArray[i].size;
 
-			BlockDiffArray[i].phaseDiffArray = CreatePhaseDifferences(i, config);
-			if(!BlockDiffArray[i].phaseDiffArray)
+			BlockDiffArray[i].freqMissArray = (FreqDifference*)CarveDifferenceArena(&config->Differences.arena, sizeof(FreqDifference)*size);
+			BlockDiffArray[i].amplDiffArray = (AmplDifference*)CarveDifferenceArena(&config->Differences.arena, sizeof(AmplDifference)*size);
+			BlockDiffArray[i].phaseDiffArray = (PhaseDifference*)CarveDifferenceArena(&config->Differences.arena, sizeof(PhaseDifference)*size);
+			if(!BlockDiffArray[i].freqMissArray || !BlockDiffArray[i].amplDiffArray || !BlockDiffArray[i].phaseDiffArray)
 			{
+				logmsg("Internal consistency failure, please send error log (difference arena)\n");
 				free(BlockDiffArray);
 				return 0;
 			}
@@ -232,28 +219,17 @@ void ReleaseDifferenceArray(parameters *config)
 	if(!config)
 		return;
 
+	// The block arrays are extents in the arena
+	ReleaseDifferenceArena(&config->Differences.arena);
+
 	if(!config->Differences.BlockDiffArray)
 		return;
 
 	for(int i = 0; i < config->types.totalBlocks; i++)
 	{
-		if(config->Differences.BlockDiffArray[i].amplDiffArray)
-		{
-			free(config->Differences.BlockDiffArray[i].amplDiffArray);
-			config->Differences.BlockDiffArray[i].amplDiffArray = NULL;
-		}
-
-		if(config->Differences.BlockDiffArray[i].freqMissArray)
-		{
-			free(config->Differences.BlockDiffArray[i].freqMissArray);
-			config->Differences.BlockDiffArray[i].freqMissArray = NULL;
-		}
-
-		if(config->Differences.BlockDiffArray[i].phaseDiffArray)
-		{
-			free(config->Differences.BlockDiffArray[i].phaseDiffArray);
-			config->Differences.BlockDiffArray[i].phaseDiffArray = NULL;
-		}
+		config->Differences.BlockDiffArray[i].amplDiffArray = NULL;
+		config->Differences.BlockDiffArray[i].freqMissArray = NULL;
+		config->Differences.BlockDiffArray[i].phaseDiffArray = NULL;
 	}
 
 	free(config->Differences.BlockDiffArray);
@@ -267,6 +243,195 @@ void ReleaseDifferenceArray(parameters *config)
 	config->Differences.cntTotalAudioDiff = 0;
 }
 
+// Used is what the differences found take, reserved is the arena
+void PrintDifferenceArenaStats(parameters *config)
+{
+	size_t	used = 0;
+
+	if(!config->Differences.BlockDiffArray)
+		return;
+
+	for(int i = 0; i < config->types.totalBlocks; i++)
+	{
+		BlockDifference	*blk = &config->Differences.BlockDiffArray[i];
+
+		used += blk->cntFreqBlkDiff*sizeof(FreqDifference);
+		used += blk->cntAmplBlkDiff*sizeof(AmplDifference);
+		used += blk->cntPhaseBlkDiff*sizeof(PhaseDifference);
+	}
+
+	logmsg(" - Differences: %0.2f MB used of %0.2f MB reserved\n",
+		(double)used/(1024.0*1024.0),
+		(double)config->Differences.arena.reserved/(1024.0*1024.0));
+}
+
+#define DIFF_EXPORT_CHUNK	4096
+
+static size_t GetDiffColumnWidth(int column)
+{
+	switch(column)
+	{
+		case DIFF_COL_HERTZ:
+		case DIFF_COL_REFAMPLITUDE:
+		case DIFF_COL_DIFFAMPLITUDE:
+			return sizeof(double);
+		case DIFF_COL_BLOCK:
+		case DIFF_COL_TYPE:
+			return sizeof(int32_t);
+		case DIFF_COL_CHANNEL:
+			return sizeof(int8_t);
+	}
+	return 0;
+}
+
+// Gathers one field from every block into a chunk, written as it fills
+static int WriteDiffColumn(FILE *file, int column, parameters *config)
+{
+	char	buffer[DIFF_EXPORT_CHUNK*sizeof(double)];
+	size_t	width = 0, used = 0;
+
+	width = GetDiffColumnWidth(column);
+	for(int b = 0; b < config->types.totalBlocks; b++)
+	{
+		BlockDifference	*blk = &config->Differences.BlockDiffArray[b];
+		int32_t			type = 0;
+
+		if(!blk->amplDiffArray)
+			continue;
+
+		type = GetBlockType(config, b);
+		for(long int a = 0; a < blk->cntAmplBlkDiff; a++)
+		{
+			AmplDifference	*diff = &blk->amplDiffArray[a];
+			int32_t			block = b;
+			int8_t			channel = diff->channel;
+
+			switch(column)
+			{
+				case DIFF_COL_HERTZ:
+					memcpy(buffer+used, &diff->hertz, width);
+					break;
+				case DIFF_COL_REFAMPLITUDE:
+					memcpy(buffer+used, &diff->refAmplitude, width);
+					break;
+				case DIFF_COL_DIFFAMPLITUDE:
+					memcpy(buffer+used, &diff->diffAmplitude, width);
+					break;
+				case DIFF_COL_BLOCK:
+					memcpy(buffer+used, &block, width);
+					break;
+				case DIFF_COL_TYPE:
+					memcpy(buffer+used, &type, width);
+					break;
+				case DIFF_COL_CHANNEL:
+					memcpy(buffer+used, &channel, width);
+					break;
+			}
+			used += width;
+			if(used + width > sizeof(buffer))
+			{
+				if(fwrite(buffer, 1, used, file) != used)
+					return 0;
+				used = 0;
+			}
+		}
+	}
+	if(used && fwrite(buffer, 1, used, file) != used)
+		return 0;
+	return 1;
+}
+
+static int PadDiffColumn(FILE *file, uint64_t position, uint64_t offset)
+{
+	char	zero[DIFF_EXPORT_ALIGN];
+
+	memset(zero, 0, sizeof(zero));
+	if(offset > position && fwrite(zero, 1, offset - position, file) != offset - position)
+		return 0;
+	return 1;
+}
+
+/*
+	Written straight from BlockDiffArray, with the values the plots use.
+	Rows are not filtered, readers can compare refAmplitude against the
+	significant amplitude in the header.
+*/
+int SaveBinaryDifferences(char *filename, parameters *config)
+{
+	FILE				*file = NULL;
+	char				name[BUFFER_SIZE+16];
+	DiffExportHeader	header;
+	uint64_t			count = 0, position = 0;
+
+	if(!config || !config->Differences.BlockDiffArray)
+	{
+		logmsg(" - No differences to export\n");
+		return 0;
+	}
+
+	for(int b = 0; b < config->types.totalBlocks; b++)
+	{
+		if(config->Differences.BlockDiffArray[b].amplDiffArray)
+			count += config->Differences.BlockDiffArray[b].cntAmplBlkDiff;
+	}
+
+	memset(&header, 0, sizeof(DiffExportHeader));
+	memcpy(header.magic, DIFF_EXPORT_MAGIC, sizeof(DIFF_EXPORT_MAGIC));
+	header.version = DIFF_EXPORT_VERSION;
+	header.byteOrder = DIFF_EXPORT_BYTE_ORDER;
+	header.headerSize = sizeof(DiffExportHeader);
+	header.columns = DIFF_COL_COUNT;
+	header.count = count;
+	header.significantAmplitude = config->significantAmplitude;
+	header.averageDifference = config->averageDifference;
+	header.totalBlocks = config->types.totalBlocks;
+
+	position = sizeof(DiffExportHeader);
+	for(int c = 0; c < DIFF_COL_COUNT; c++)
+	{
+		position = (position + DIFF_EXPORT_ALIGN - 1) & ~((uint64_t)DIFF_EXPORT_ALIGN - 1);
+		header.offset[c] = position;
+		position += count*GetDiffColumnWidth(c);
+	}
+
+	sprintf(name, "%s%s", filename, DIFF_EXPORT_EXT);
+	file = fopen(name, "wb");
+	if(!file)
+	{
+		logmsg(" - Could not create %s\n", name);
+		return 0;
+	}
+
+	if(fwrite(&header, sizeof(DiffExportHeader), 1, file) != 1)
+	{
+		logmsg(" - Could not write %s\n", name);
+		fclose(file);
+		remove(name);
+		return 0;
+	}
+
+	position = sizeof(DiffExportHeader);
+	for(int c = 0; c < DIFF_COL_COUNT; c++)
+	{
+		if(!PadDiffColumn(file, position, header.offset[c]) || !WriteDiffColumn(file, c, config))
+		{
+			logmsg(" - Could not write %s\n", name);
+			fclose(file);
+			remove(name);
+			return 0;
+		}
+		position = header.offset[c] + count*GetDiffColumnWidth(c);
+	}
+
+	if(fclose(file) != 0)
+	{
+		logmsg(" - Could not write %s\n", name);
+		remove(name);
+		return 0;
+	}
+	return 1;
+}
+
 int IncrementCmpAmpl(int block, char channel, parameters *config)
 {
 	if(!config)
@@ -300,7 +465,6 @@ int IncrementCmpPhase(int block, parameters *config)
 		return 0;
 
 	config->Differences.BlockDiffArray[block].cmpPhaseBlkDiff ++;
-	config->Differences.cmpPhaseAudioDiff ++;
 	return 1;
 }
 
@@ -330,24 +494,8 @@ int InsertAmplDifference(int block, Frequency ref, Frequency comp, char channel,
 	diffAmpl = fabs(ref.amplitude) - fabs(comp.amplitude);
 	position = config->Differences.BlockDiffArray[block].cntAmplBlkDiff;
 
-	if(GetBlockType(config, block) != TYPE_SILENCE)
-	{
-		if(GetBlockChannel(config, block) == CHANNEL_STEREO)
-		{
-			if(position >= STEREO_DIFF_SIZE)
-				return 0;
-		}
-		else
-		{
-			if(position >= MONO_DIFF_SIZE)
-				return 0;
-		}
-	}
-	else
-	{
-		if(position >= GetSilenceBlockSize(block, config))
-			return 0;
-	}
+	if(position >= config->Differences.BlockDiffArray[block].size)
+		return 0;
 
 	config->Differences.BlockDiffArray[block].amplDiffArray[position].hertz = ref.hertz;
 	config->Differences.BlockDiffArray[block].amplDiffArray[position].refAmplitude = ref.amplitude;
@@ -355,22 +503,12 @@ int InsertAmplDifference(int block, Frequency ref, Frequency comp, char channel,
 	config->Differences.BlockDiffArray[block].amplDiffArray[position].channel = channel;
 
 	config->Differences.BlockDiffArray[block].cntAmplBlkDiff ++;
-	config->Differences.cntAmplAudioDiff ++;
-	config->Differences.cntTotalAudioDiff ++;
 
 	if(channel == CHANNEL_LEFT || channel == CHANNEL_MONO)
-	{
 		config->Differences.BlockDiffArray[block].cntAmplBlkDiffLeft ++;
-		config->Differences.cntAmplAudioDiffLeft ++;
-		config->Differences.cntTotalAudioDiffLeft ++;
-	}
 
 	if(channel == CHANNEL_RIGHT)
-	{
 		config->Differences.BlockDiffArray[block].cntAmplBlkDiffRight ++;
-		config->Differences.cntAmplAudioDiffRight ++;
-		config->Differences.cntTotalAudioDiffRight ++;
-	}
 	
 	return 1;
 }
@@ -408,32 +546,14 @@ int InsertPhaseDifference(int block, Frequency ref, Frequency comp, char channel
 
 	position = config->Differences.BlockDiffArray[block].cntPhaseBlkDiff;
 
-	if(GetBlockType(config, block) != TYPE_SILENCE)
-	{
-		if(GetBlockChannel(config, block) == CHANNEL_STEREO)
-		{
-			if(position >= STEREO_DIFF_SIZE)
-				return 0;
-		}
-		else
-		{
-			if(position >= MONO_DIFF_SIZE)
-				return 0;
-		}
-	}
-	else
-	{
-		if(position >= GetSilenceBlockSize(block, config))
-			return 0;
-	}
+	if(position >= config->Differences.BlockDiffArray[block].size)
+		return 0;
 
 	config->Differences.BlockDiffArray[block].phaseDiffArray[position].hertz = ref.hertz;
 	config->Differences.BlockDiffArray[block].phaseDiffArray[position].diffPhase = diffPhase;
 	config->Differences.BlockDiffArray[block].phaseDiffArray[position].channel = channel;
 
 	config->Differences.BlockDiffArray[block].cntPhaseBlkDiff ++;
-	config->Differences.cntPhaseAudioDiff ++;
-	//config->Differences.cntTotalAudioDiff ++;
 	
 	return 1;
 }
@@ -443,11 +563,6 @@ int IncrementCompared(int block, char channel, parameters *config)
 	if(!config)
 		return 0;
 
-	config->Differences.cntTotalCompared ++;
-	if(channel == CHANNEL_LEFT || channel == CHANNEL_MONO)
-		config->Differences.cntTotalComparedLeft++;
-	if(channel == CHANNEL_RIGHT)
-		config->Differences.cntTotalComparedRight++;
 	if(!IncrementCmpAmpl(block, channel, config))
 		return 0;
 	if(!IncrementCmpFreq(block, config))
@@ -469,19 +584,12 @@ int IncrementPerfectMatch(int block, char channel, parameters *config)
 		return 0;
 
 	config->Differences.BlockDiffArray[block].perfectAmplMatch ++;
-	config->Differences.cntPerfectAmplMatch ++;
 
 	if(channel == CHANNEL_LEFT || channel == CHANNEL_MONO)
-	{
 		config->Differences.BlockDiffArray[block].perfectAmplMatchLeft ++;
-		config->Differences.cntPerfectAmplMatchLeft ++;
-	}
 
 	if(channel == CHANNEL_RIGHT)
-	{
 		config->Differences.BlockDiffArray[block].perfectAmplMatchRight ++;
-		config->Differences.cntPerfectAmplMatchRight ++;
-	}
 	
 	return 1;
 }
@@ -524,17 +632,75 @@ int InsertFreqNotFound(int block, double freq, double amplitude, char channel, p
 	}
 
 	position = config->Differences.BlockDiffArray[block].cntFreqBlkDiff;
+	if(position >= config->Differences.BlockDiffArray[block].size)
+		return 0;
+
 	config->Differences.BlockDiffArray[block].freqMissArray[position].hertz = freq;
 	config->Differences.BlockDiffArray[block].freqMissArray[position].amplitude = amplitude;
 	config->Differences.BlockDiffArray[block].freqMissArray[position].channel = channel;
 
 	config->Differences.BlockDiffArray[block].cntFreqBlkDiff ++;
-	config->Differences.cntFreqAudioDiff ++;
-	config->Differences.cntTotalAudioDiff ++;
 
 	return 1;
 }
 
+/*
+	The functions above only touch the counters of their own block, so
+	blocks can be compared at the same time. The totals are added up
+	afterwards in block order.
+*/
+void ReduceDifferenceTotals(parameters *config)
+{
+	AudioDifference	*diff = NULL;
+
+	if(!config || !config->Differences.BlockDiffArray)
+		return;
+
+	diff = &config->Differences;
+
+	diff->cntFreqAudioDiff = 0;
+	diff->cntAmplAudioDiff = 0;
+	diff->cntPhaseAudioDiff = 0;
+	diff->cmpPhaseAudioDiff = 0;
+	diff->cntPerfectAmplMatch = 0;
+	diff->cntTotalCompared = 0;
+	diff->cntTotalAudioDiff = 0;
+
+	diff->cntAmplAudioDiffLeft = 0;
+	diff->cntPerfectAmplMatchLeft = 0;
+	diff->cntTotalComparedLeft = 0;
+	diff->cntTotalAudioDiffLeft = 0;
+
+	diff->cntAmplAudioDiffRight = 0;
+	diff->cntPerfectAmplMatchRight = 0;
+	diff->cntTotalComparedRight = 0;
+	diff->cntTotalAudioDiffRight = 0;
+
+	for(int i = 0; i < config->types.totalBlocks; i++)
+	{
+		BlockDifference	*blk = &diff->BlockDiffArray[i];
+
+		diff->cntFreqAudioDiff += blk->cntFreqBlkDiff;
+		diff->cntAmplAudioDiff += blk->cntAmplBlkDiff;
+		diff->cntPhaseAudioDiff += blk->cntPhaseBlkDiff;
+		diff->cmpPhaseAudioDiff += blk->cmpPhaseBlkDiff;
+		diff->cntPerfectAmplMatch += blk->perfectAmplMatch;
+		diff->cntTotalCompared += blk->cmpAmplBlkDiff;
+		diff->cntTotalAudioDiff += blk->cntAmplBlkDiff + blk->cntFreqBlkDiff;
+
+		// Missing frequencies are not counted per channel
+		diff->cntAmplAudioDiffLeft += blk->cntAmplBlkDiffLeft;
+		diff->cntPerfectAmplMatchLeft += blk->perfectAmplMatchLeft;
+		diff->cntTotalComparedLeft += blk->cmpAmplBlkDiffLeft;
+		diff->cntTotalAudioDiffLeft += blk->cntAmplBlkDiffLeft;
+
+		diff->cntAmplAudioDiffRight += blk->cntAmplBlkDiffRight;
+		diff->cntPerfectAmplMatchRight += blk->perfectAmplMatchRight;
+		diff->cntTotalComparedRight += blk->cmpAmplBlkDiffRight;
+		diff->cntTotalAudioDiffRight += blk->cntAmplBlkDiffRight;
+	}
+}
+
 void PrintDifferentFrequencies(int block, parameters *config)
 {
 	if(!config)
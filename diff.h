@@ -31,10 +31,52 @@
 
 #include "mdfourier.h"
 
-AmplDifference *CreateAmplDifferences(int block, parameters *config);
-FreqDifference *CreateFreqDifferences(int block, parameters *config);
-PhaseDifference *CreatePhaseDifferences(int block, parameters *config);
+/*
+	Binary difference export, one row per amplitude difference in block
+	order. After the header each column is a packed array that starts at
+	its offset, aligned to DIFF_EXPORT_ALIGN bytes, so the file can be
+	memory mapped and used as is. Values are in the host byte order,
+	byteOrder reads as DIFF_EXPORT_BYTE_ORDER when it matches.
+
+	hertz, refAmplitude, diffAmplitude	double
+	block, type							int32_t
+	channel								int8_t, 'l', 'r' or 'm'
+*/
+#define DIFF_EXPORT_EXT			".mdfd"
+#define DIFF_EXPORT_MAGIC		"MDFDIFF"
+#define DIFF_EXPORT_VERSION		1
+#define DIFF_EXPORT_BYTE_ORDER	0x01020304
+#define DIFF_EXPORT_ALIGN		64
+
+enum diffExportColumn {
+	DIFF_COL_HERTZ,
+	DIFF_COL_REFAMPLITUDE,
+	DIFF_COL_DIFFAMPLITUDE,
+	DIFF_COL_BLOCK,
+	DIFF_COL_TYPE,
+	DIFF_COL_CHANNEL,
+	DIFF_COL_COUNT
+};
+
+typedef struct diff_export_header_st {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	byteOrder;
+	uint32_t	headerSize;
+	uint32_t	columns;
+	uint64_t	count;
+	uint64_t	offset[DIFF_COL_COUNT];
+	double		significantAmplitude;
+	double		averageDifference;
+	int32_t		totalBlocks;
+	int32_t		reserved;
+} DiffExportHeader;
+
+long int GetBlockDifferenceSize(int block, parameters *config);
 int CreateDifferenceArray(parameters *config);
+void ReleaseDifferenceArena(DifferenceArena *arena);
+void PrintDifferenceArenaStats(parameters *config);
+int SaveBinaryDifferences(char *filename, parameters *config);
 int InsertFreqNotFound(int block, double freq, double amplitude, char channel, parameters *config);
 int InsertAmplDifference(int block, Frequency ref, Frequency comp, char channel, parameters *config);
 int InsertPhaseDifference(int block, Frequency ref, Frequency comp, char channel, parameters *config);
@@ -43,6 +85,7 @@ int IncrementCmpAmpl(int block, char channel, parameters *config);
 int IncrementCmpFreq(int block, parameters *config);
 int IncrementCompared(int block, char channel, parameters *config);
 int IncrementPerfectMatch(int block, char channel, parameters *config);
+void ReduceDifferenceTotals(parameters *config);
 void PrintDifferentFrequencies(int block, parameters *config);
 void PrintDifferentAmplitudes(int block, parameters *config);
 void PrintDifferenceArray(parameters *config);
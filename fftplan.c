@@ -0,0 +1,327 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+/*
+ * Plans are created once per (size, direction, alignment, precision, batch) and executed
+ * with the new-array interface, so each distinct block length is only
+ * measured once per process, or once per machine via the wisdom file.
+ */
+
+#include "fftplan.h"
+#include "log.h"
+
+#define PLAN_CACHE_STEP	32
+
+FFTWPlanCache	*planCache = NULL;
+int				planCacheCount = 0;
+int				planCacheMax = 0;
+int				wisdomLoaded = 0;
+int				wisdomChanged = 0;
+int				wisdomFloatChanged = 0;
+
+// single precision wisdom is not compatible, it is kept next to the double one
+void GetFloatWisdomName(char *name, parameters *config)
+{
+	sprintf(name, "%s%s", config->wisdomFile, WISDOM_FLOAT_EXT);
+}
+
+void LoadWisdom(parameters *config)
+{
+	char	name[BUFFER_SIZE+16];
+
+	if(wisdomLoaded)
+		return;
+
+	wisdomLoaded = 1;
+	// a missing file is expected on first run, it is created on exit
+	fftw_import_wisdom_from_filename(config->wisdomFile);
+	GetFloatWisdomName(name, config);
+	fftwf_import_wisdom_from_filename(name);
+}
+
+// FFTW_MEASURE overwrites the arrays, so plans are measured on scratch buffers
+// fftw_malloc aligned buffers use the SIMD plans, anything else is planned as unaligned
+fftw_plan CreateCachedPlan(long int size, int direction, int alignment, int howmany)
+{
+	fftw_plan		plan = NULL;
+	double			*signal = NULL;
+	fftw_complex	*spectrum = NULL;
+	unsigned		flags = FFTW_MEASURE;
+
+	signal = (double*)fftw_malloc(sizeof(double)*(BATCH_REAL_DIST(size)*howmany+1));
+	if(!signal)
+	{
+		logmsg("Not enough memory (fftw_malloc)\n");
+		return NULL;
+	}
+	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(size/2+1)*howmany);
+	if(!spectrum)
+	{
+		fftw_free(signal);
+		logmsg("Not enough memory (fftw_malloc)\n");
+		return NULL;
+	}
+
+	if(alignment)
+		flags |= FFTW_UNALIGNED;
+
+	if(howmany > 1)
+	{
+		int	n = size;
+
+		plan = fftw_plan_many_dft_r2c(1, &n, howmany, signal, NULL, 1, BATCH_REAL_DIST(size),
+					spectrum, NULL, 1, size/2+1, flags);
+	}
+	else if(direction == FFTW_FORWARD)
+		plan = fftw_plan_dft_r2c_1d(size, signal, spectrum, flags);
+	else
+		plan = fftw_plan_dft_c2r_1d(size, spectrum, signal, flags);
+
+	fftw_free(signal);
+	fftw_free(spectrum);
+
+	return plan;
+}
+
+// Only forward transforms are used in single precision
+fftwf_plan CreateCachedPlanFloat(long int size, int alignment)
+{
+	fftwf_plan		plan = NULL;
+	float			*signal = NULL;
+	fftwf_complex	*spectrum = NULL;
+	unsigned		flags = FFTW_MEASURE;
+
+	signal = (float*)fftwf_malloc(sizeof(float)*(size+1));
+	if(!signal)
+	{
+		logmsg("Not enough memory (fftwf_malloc)\n");
+		return NULL;
+	}
+	spectrum = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*(size/2+1));
+	if(!spectrum)
+	{
+		fftwf_free(signal);
+		logmsg("Not enough memory (fftwf_malloc)\n");
+		return NULL;
+	}
+
+	if(alignment)
+		flags |= FFTW_UNALIGNED;
+
+	plan = fftwf_plan_dft_r2c_1d(size, signal, spectrum, flags);
+
+	fftwf_free(signal);
+	fftwf_free(spectrum);
+
+	return plan;
+}
+
+// Must be called with the planner lock held, see GetCachedPlan
+FFTWPlanCache *GetCachedPlanInternal(long int size, int direction, int howmany, int alignment, int precision, parameters *config)
+{
+	FFTWPlanCache	*entry = NULL;
+
+	for(int i = 0; i < planCacheCount; i++)
+	{
+		if(planCache[i].size == size && planCache[i].direction == direction &&
+			planCache[i].alignment == alignment && planCache[i].precision == precision &&
+			planCache[i].howmany == howmany)
+			return &planCache[i];
+	}
+
+	if(planCacheCount == planCacheMax)
+	{
+		FFTWPlanCache *tmp = NULL;
+
+		tmp = (FFTWPlanCache*)realloc(planCache, sizeof(FFTWPlanCache)*(planCacheMax+PLAN_CACHE_STEP));
+		if(!tmp)
+		{
+			logmsg("Not enough memory for FFTW plan cache\n");
+			return NULL;
+		}
+		planCache = tmp;
+		memset(planCache+planCacheMax, 0, sizeof(FFTWPlanCache)*PLAN_CACHE_STEP);
+		planCacheMax += PLAN_CACHE_STEP;
+	}
+
+	LoadWisdom(config);
+	entry = &planCache[planCacheCount];
+	if(precision == PLAN_FLOAT)
+		entry->planf = CreateCachedPlanFloat(size, alignment);
+	else
+		entry->plan = CreateCachedPlan(size, direction, alignment, howmany);
+	if(!entry->plan && !entry->planf)
+	{
+		logmsg("FFTW failed to create FFTW_MEASURE %s%splan\n", 
+			precision == PLAN_FLOAT ? "single precision " : "", direction == FFTW_FORWARD ? "" : "reverse ");
+		return NULL;
+	}
+
+	entry->size = size;
+	entry->direction = direction;
+	entry->alignment = alignment;
+	entry->precision = precision;
+	entry->howmany = howmany;
+	planCacheCount++;
+
+	if(precision == PLAN_FLOAT)
+		wisdomFloatChanged = 1;
+	else
+		wisdomChanged = 1;
+	return entry;
+}
+
+/*
+	The FFTW planner is not thread safe, and the cache array can be
+	moved by realloc, so lookups and plan creation are serialized.
+	Executing a plan with the new-array interface is thread safe.
+*/
+fftw_plan GetCachedPlan(long int size, int direction, int howmany, double *signal, fftw_complex *spectrum, parameters *config)
+{
+	int				alignment = 0;
+	fftw_plan		plan = NULL;
+	FFTWPlanCache	*entry = NULL;
+
+	alignment = fftw_alignment_of(signal) | (fftw_alignment_of((double*)spectrum) << 8);
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (fftw_planner)
+#endif
+	{
+		entry = GetCachedPlanInternal(size, direction, howmany, alignment, PLAN_DOUBLE, config);
+		if(entry)
+			plan = entry->plan;
+	}
+	return plan;
+}
+
+fftwf_plan GetCachedPlanFloat(long int size, float *signal, fftwf_complex *spectrum, parameters *config)
+{
+	int				alignment = 0;
+	fftwf_plan		plan = NULL;
+	FFTWPlanCache	*entry = NULL;
+
+	alignment = fftwf_alignment_of(signal) | (fftwf_alignment_of((float*)spectrum) << 8);
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (fftw_planner)
+#endif
+	{
+		entry = GetCachedPlanInternal(size, FFTW_FORWARD, 1, alignment, PLAN_FLOAT, config);
+		if(entry)
+			plan = entry->planf;
+	}
+	return plan;
+}
+
+int ExecuteRealToComplex(long int size, double *signal, fftw_complex *spectrum, parameters *config)
+{
+	fftw_plan	plan = NULL;
+
+	plan = GetCachedPlan(size, FFTW_FORWARD, 1, signal, spectrum, config);
+	if(!plan)
+		return 0;
+
+	fftw_execute_dft_r2c(plan, signal, spectrum);
+	return 1;
+}
+
+// Inputs are BATCH_REAL_DIST(size) apart in signal, spectra are size/2+1 apart
+int ExecuteRealToComplexBatch(long int size, int howmany, double *signal, fftw_complex *spectrum, parameters *config)
+{
+	fftw_plan	plan = NULL;
+
+	plan = GetCachedPlan(size, FFTW_FORWARD, howmany, signal, spectrum, config);
+	if(!plan)
+		return 0;
+
+	fftw_execute_dft_r2c(plan, signal, spectrum);
+	return 1;
+}
+
+int ExecuteRealToComplexFloat(long int size, float *signal, fftwf_complex *spectrum, parameters *config)
+{
+	fftwf_plan	plan = NULL;
+
+	plan = GetCachedPlanFloat(size, signal, spectrum, config);
+	if(!plan)
+		return 0;
+
+	fftwf_execute_dft_r2c(plan, signal, spectrum);
+	return 1;
+}
+
+// Note that c2r transforms destroy the input spectrum
+int ExecuteComplexToReal(long int size, fftw_complex *spectrum, double *signal, parameters *config)
+{
+	fftw_plan	plan = NULL;
+
+	plan = GetCachedPlan(size, FFTW_BACKWARD, 1, signal, spectrum, config);
+	if(!plan)
+		return 0;
+
+	fftw_execute_dft_c2r(plan, spectrum, signal);
+	return 1;
+}
+
+void ReleasePlanCache(parameters *config)
+{
+	if(!planCache)
+		return;
+
+	if(wisdomChanged)
+	{
+		fftw_export_wisdom_to_filename(config->wisdomFile);
+		wisdomChanged = 0;
+	}
+	if(wisdomFloatChanged)
+	{
+		char	name[BUFFER_SIZE+16];
+
+		GetFloatWisdomName(name, config);
+		fftwf_export_wisdom_to_filename(name);
+		wisdomFloatChanged = 0;
+	}
+
+	for(int i = 0; i < planCacheCount; i++)
+	{
+		if(planCache[i].plan)
+		{
+			fftw_destroy_plan(planCache[i].plan);
+			planCache[i].plan = NULL;
+		}
+		if(planCache[i].planf)
+		{
+			fftwf_destroy_plan(planCache[i].planf);
+			planCache[i].planf = NULL;
+		}
+	}
+
+	free(planCache);
+	planCache = NULL;
+	planCacheCount = 0;
+	planCacheMax = 0;
+}
@@ -0,0 +1,59 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_FFTPLAN_H
+#define MDFOURIER_FFTPLAN_H
+
+#include "mdfourier.h"
+
+#define WISDOM_FILE	"wisdom.fftw"
+#define WISDOM_FLOAT_EXT	".float"
+
+#define PLAN_DOUBLE	0
+#define PLAN_FLOAT	1
+
+// Batched real inputs are stored this far apart, keeps every channel 16 byte aligned
+#define BATCH_REAL_DIST(size)	((size)+((size)&1))
+
+typedef struct fftw_plan_cache_st {
+	long int	size;
+	int			direction;
+	int			alignment;
+	int			precision;
+	int			howmany;
+	fftw_plan	plan;
+	fftwf_plan	planf;
+} FFTWPlanCache;
+
+int ExecuteRealToComplex(long int size, double *signal, fftw_complex *spectrum, parameters *config);
+int ExecuteRealToComplexBatch(long int size, int howmany, double *signal, fftw_complex *spectrum, parameters *config);
+int ExecuteRealToComplexFloat(long int size, float *signal, fftwf_complex *spectrum, parameters *config);
+int ExecuteComplexToReal(long int size, fftw_complex *spectrum, double *signal, parameters *config);
+void ReleasePlanCache(parameters *config);
+
+#endif
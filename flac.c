@@ -46,17 +46,25 @@
 #include "FLAC/stream_decoder.h"
 
 #include <ctype.h>
-
-#define FLAC_ERR_STR 1024
+#ifdef OPENMP_ENABLE
+	#include <omp.h>
+#endif
 
 int flacInternalMDFErrors = 0;
 char flacInternalErrorStr[FLAC_ERR_STR];
+#ifdef OPENMP_ENABLE
+	// Reference and Comparison can be decoded at the same time
+	#pragma omp threadprivate(flacInternalMDFErrors, flacInternalErrorStr)
+#endif
 
 extern char *getFilenameExtension(char *filename);
 extern int getExtensionLength(char *filename);
 static FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
 static void metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data);
 static void error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static FLAC__StreamDecoderWriteStatus segment_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
+static void segment_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static FLAC__StreamDecoderWriteStatus streaminfo_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
 
 char* getflacErrorStr(void)
 {
@@ -164,6 +172,14 @@ int FLACtoSignal(char *input, AudioSignal *Signal)
 		}
 	}
 
+	// The MD5 signature is compared once the whole stream went through the decoder
+	if(ok && !FLAC__stream_decoder_finish(decoder))
+	{
+		logmsg("ERROR: FLAC MD5 signature does not match the decoded audio\n");
+		flacInternalMDFErrors = 1;
+		ok = false;
+	}
+
 	FLAC__stream_decoder_delete(decoder);
 
 	if(Signal->header.data.DataSize != (uint32_t)Signal->samplesPosFLAC*Signal->bytesPerSample)
@@ -189,6 +205,226 @@ int FLACtoSignal(char *input, AudioSignal *Signal)
 	return ok ? 1 : 0;
 }
 
+/*
+	Splits the stream in one range per thread, each one is decoded by its
+	own decoder after a seek into its slice of Samples. Returns 0 when the
+	file is too short to split or anything fails, the caller then decodes
+	the whole file in order, which also reports the errors.
+	Only used with -6, the MD5 signature can't be checked this way.
+*/
+int FLACtoSignalSegmented(char *input, AudioSignal *Signal)
+{
+	int					segments = 1, failed = 0;
+	uint64_t			total = 0, length = 0, blocksize = 0;
+	FLACSegment			*segment = NULL;
+
+#ifdef OPENMP_ENABLE
+	segments = omp_get_max_threads();
+#endif
+	if(segments < 2)
+		return 0;
+
+	// Errors are reported by the sequential decoder
+	if(!FLACReadStreamInfo(input, Signal))
+		return 0;
+	blocksize = Signal->blocksizeFLAC;
+
+	total = Signal->numSamples/Signal->header.fmt.NumOfChan;
+	if(total/FLAC_SEGMENT_MIN < (uint64_t)segments)
+		segments = total/FLAC_SEGMENT_MIN;
+	if(segments < 2)
+		return 0;
+
+	// Fixed blocksize streams start each segment at a frame boundary, no partial frame is decoded twice
+	length = (total + segments - 1)/segments;
+	if(blocksize)
+		length = ((length + blocksize - 1)/blocksize)*blocksize;
+
+	segment = (FLACSegment*)malloc(sizeof(FLACSegment)*segments);
+	if(!segment)
+		return 0;
+	Signal->Samples = (SampleValue*)malloc(sizeof(SampleValue)*Signal->numSamples);
+	if(!Signal->Samples)
+	{
+		free(segment);
+		return 0;
+	}
+
+	for(int i = 0; i < segments; i++)
+	{
+		segment[i].Signal = Signal;
+		segment[i].start = length*i < total ? length*i : total;
+		segment[i].end = length*(i+1) < total ? length*(i+1) : total;
+		segment[i].written = 0;
+		segment[i].error = 0;
+		segment[i].errorStr[0] = '\0';
+	}
+
+#ifdef OPENMP_ENABLE
+	#pragma omp parallel for num_threads(segments) schedule(static, 1)
+#endif
+	for(int i = 0; i < segments; i++)
+		DecodeFLACSegment(input, &segment[i]);
+
+	for(int i = 0; i < segments; i++)
+	{
+		if(segment[i].error || segment[i].written != segment[i].end - segment[i].start)
+		{
+			logmsgFileOnly("FLAC segment %d [%llu-%llu] failed after %llu samples: %s\n", i,
+				(unsigned long long)segment[i].start, (unsigned long long)segment[i].end,
+				(unsigned long long)segment[i].written,
+				segment[i].errorStr[0] ? segment[i].errorStr : "incomplete");
+			failed = 1;
+			break;
+		}
+	}
+	free(segment);
+
+	if(failed)
+	{
+		logmsgFileOnly("Decoding FLAC file sequentially\n");
+		free(Signal->Samples);
+		Signal->Samples = NULL;
+		Signal->samplesPosFLAC = 0;
+		Signal->errorFLAC = 0;
+		memset(flacInternalErrorStr, 0, FLAC_ERR_STR);
+		return 0;
+	}
+
+	Signal->samplesPosFLAC = Signal->numSamples;
+	return 1;
+}
+
+// Fills the header from STREAMINFO only, no audio is decoded
+int FLACReadStreamInfo(char *input, AudioSignal *Signal)
+{
+	FLAC__StreamDecoder	*decoder = NULL;
+
+	decoder = FLAC__stream_decoder_new();
+	if(!decoder)
+		return 0;
+
+	// libFLAC rejects a NULL write callback, this one stops at the first frame
+	if(FLAC__stream_decoder_init_file(decoder, input, streaminfo_write_callback, metadata_callback, error_callback, Signal) != FLAC__STREAM_DECODER_INIT_STATUS_OK ||
+		!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
+	{
+		FLAC__stream_decoder_delete(decoder);
+		Signal->errorFLAC = 0;
+		return 0;
+	}
+	FLAC__stream_decoder_delete(decoder);
+
+	if(Signal->errorFLAC)
+	{
+		Signal->errorFLAC = 0;
+		return 0;
+	}
+
+	if(Signal->numSamples <= 0 ||
+		(Signal->header.fmt.bitsPerSample != 16 && Signal->header.fmt.bitsPerSample != 24) ||
+		(Signal->header.fmt.NumOfChan != 2 && Signal->header.fmt.NumOfChan != 1))
+		return 0;
+	return 1;
+}
+
+FLAC__StreamDecoderWriteStatus streaminfo_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	(void)decoder;
+	(void)frame;
+	(void)buffer;
+	(void)client_data;
+
+	return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+}
+
+// MD5 is not checked, seeking disables it since it needs the whole stream in order
+int DecodeFLACSegment(char *input, FLACSegment *segment)
+{
+	FLAC__StreamDecoder *decoder = NULL;
+
+	decoder = FLAC__stream_decoder_new();
+	if(!decoder)
+	{
+		segment->error = 1;
+		strcpy(segment->errorStr, "allocating decoder");
+		return 0;
+	}
+
+	(void)FLAC__stream_decoder_set_md5_checking(decoder, false);
+	if(FLAC__stream_decoder_init_file(decoder, input, segment_write_callback, NULL, segment_error_callback, segment) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+	{
+		segment->error = 1;
+		strcpy(segment->errorStr, "initializing decoder");
+		FLAC__stream_decoder_delete(decoder);
+		return 0;
+	}
+
+	// The frame holding the target sample is delivered by the seek itself
+	if(segment->start && !FLAC__stream_decoder_seek_absolute(decoder, segment->start))
+		segment->error = 1;
+
+	while(!segment->error && segment->written < segment->end - segment->start)
+	{
+		if(!FLAC__stream_decoder_process_single(decoder) ||
+			FLAC__stream_decoder_get_state(decoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
+			break;
+	}
+
+	if(!segment->error && segment->written != segment->end - segment->start && !segment->errorStr[0])
+		strncpy(segment->errorStr, FLAC__StreamDecoderStateString[FLAC__stream_decoder_get_state(decoder)], FLAC_ERR_STR - 1);
+
+	FLAC__stream_decoder_delete(decoder);
+	return !segment->error;
+}
+
+FLAC__StreamDecoderWriteStatus segment_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	FLACSegment	*segment = (FLACSegment*)client_data;
+	AudioSignal	*Signal = segment->Signal;
+	uint64_t	first = 0, last = 0, frameStart = 0;
+	long int	pos = 0;
+	int			channels = Signal->header.fmt.NumOfChan;
+
+	(void)decoder;
+
+	if(channels != (int)frame->header.channels || buffer[0] == NULL || (channels == 2 && buffer[1] == NULL))
+	{
+		segment->error = 1;
+		strcpy(segment->errorStr, "channel definition discrepancy");
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+
+	// Frames can straddle the segment limits, only our range is stored
+	frameStart = frame->header.number.sample_number;
+	first = frameStart < segment->start ? segment->start : frameStart;
+	last = frameStart + frame->header.blocksize;
+	if(last > segment->end)
+		last = segment->end;
+	if(first >= last)
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+
+	pos = (long int)first*channels;
+	for(uint64_t i = first - frameStart; i < last - frameStart; i++)
+	{
+		Signal->Samples[pos++] = (double)(FLAC__int32)buffer[0][i];
+		if(channels == 2)
+			Signal->Samples[pos++] = (double)(FLAC__int32)buffer[1][i];
+	}
+	segment->written += last - first;
+
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void segment_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	FLACSegment	*segment = (FLACSegment*)client_data;
+
+	(void)decoder;
+
+	segment->error = 1;
+	strncpy(segment->errorStr, FLAC__StreamDecoderErrorStatusString[status], FLAC_ERR_STR - 1);
+}
+
 FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
 {
 	AudioSignal *Signal = (AudioSignal*)client_data;
@@ -237,14 +473,14 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 			flacInternalMDFErrors = 1;
 			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 		}
-		Signal->Samples = (double*)malloc(sizeof(double)*Signal->numSamples*Signal->header.fmt.NumOfChan);
+		Signal->Samples = (SampleValue*)malloc(sizeof(SampleValue)*Signal->numSamples*Signal->header.fmt.NumOfChan);
 		if(!Signal->Samples)
 		{
 			logmsg("\tERROR: FLAC data chunks malloc failed!\n");
 			flacInternalMDFErrors = 1;
 			return(FLAC__STREAM_DECODER_WRITE_STATUS_ABORT);
 		}
-		memset(Signal->Samples, 0, sizeof(double)*Signal->numSamples*Signal->header.fmt.NumOfChan);
+		memset(Signal->Samples, 0, sizeof(SampleValue)*Signal->numSamples*Signal->header.fmt.NumOfChan);
 	}
 
 	/* save decoded PCM samples */
@@ -289,6 +525,10 @@ void metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMet
 		Signal->bytesPerSample = bps/8;
 		Signal->SamplesStart = 0;
 		Signal->samplesPosFLAC = 0;
+		if(metadata->data.stream_info.min_blocksize == metadata->data.stream_info.max_blocksize)
+			Signal->blocksizeFLAC = metadata->data.stream_info.max_blocksize;
+		else
+			Signal->blocksizeFLAC = 0;
 	}
 }
 
@@ -31,10 +31,28 @@
 
 #include "mdfourier.h"
 
+// Samples per channel in each segment at least, shorter files are decoded in one go
+#define FLAC_SEGMENT_MIN	1048576
+#define FLAC_ERR_STR		1024
+
+// A range of the stream decoded by its own decoder into its slice of Samples
+typedef struct flac_segment_st {
+	AudioSignal	*Signal;
+	uint64_t	start;
+	uint64_t	end;
+	uint64_t	written;
+	int			error;
+	char		errorStr[FLAC_ERR_STR];
+} FLACSegment;
+
 char* getflacErrorStr(void);
 int flacErrorReported(void);
 int IsFlac(char *name);
+int FillRIFFHeader(wav_hdr *header);
 void renameFLAC(char *flac, char *wav, char *path);
 int FLACtoSignal(char *input, AudioSignal *Signal);
+int FLACtoSignalSegmented(char *input, AudioSignal *Signal);
+int FLACReadStreamInfo(char *input, AudioSignal *Signal);
+int DecodeFLACSegment(char *input, FLACSegment *segment);
 
 #endif
@@ -32,11 +32,11 @@
 #include "plot.h"
 #include "float.h"
 #include "profile.h"
-
-#define SORT_NAME FFT_Frequency_Magnitude
-#define SORT_TYPE Frequency
-#define SORT_CMP(x, y)  ((x).magnitude > (y).magnitude ? -1 : ((x).magnitude == (y).magnitude ? 0 : 1))
-#include "sort.h"  // https://github.com/swenson/sort/
+#include "fftplan.h"
+#include "pool.h"
+#include "windows.h"
+#include "stream.h"
+#include "spectrum.h"
 
 inline int areDoublesEqual(double a, double b)
 {
@@ -288,6 +288,40 @@ long int GetBlockFreqSize(AudioSignal *Signal, int block, char channel, paramete
 	return size;
 }
 
+int CalculateMaxCompare(int block, AudioSignal *Signal, double significant, char channel, parameters *config)
+{
+	long int	size = 0;
+	double		limit = 0;
+	Frequency	*freqCheck = NULL;
+
+	size = GetBlockFreqSize(Signal, block, channel, config);
+	if(channel == CHANNEL_LEFT)
+		freqCheck = Signal->Blocks[block].freq;
+	else
+		freqCheck = Signal->Blocks[block].freqRight;
+
+	if(!freqCheck)
+		return 0;
+
+	limit = significant;
+
+	if(Signal->role == ROLE_COMP)
+		limit += -20;	// Allow going 20 dbfs "deeper"
+
+	for(int freq = 0; freq < size; freq++)
+	{
+		/* Out of valid frequencies */
+		if(!freqCheck[freq].hertz)
+			return(freq);
+
+		/* Amplitude is too low */
+		if(freqCheck[freq].amplitude <= limit)
+			return(freq);
+	}
+
+	return size;
+}
+
 AudioSignal *CreateAudioSignal(parameters *config)
 {
 	AudioSignal *Signal = NULL;
@@ -366,8 +400,10 @@ void InitAudio(AudioSignal *Signal, parameters *config)
 			CleanFrequenciesInBlock(&Signal->Blocks[n], config);
 			
 			Signal->Blocks[n].fftwValues.spectrum = NULL;
+			Signal->Blocks[n].fftwValues.spectrumf = NULL;
 			Signal->Blocks[n].fftwValues.size = 0;
 			Signal->Blocks[n].fftwValues.ENBW = 0;
+			Signal->Blocks[n].fftwValues.shared = 0;
 
 			Signal->Blocks[n].audio.samples = NULL;
 			Signal->Blocks[n].audio.windowed_samples = NULL;
@@ -377,8 +413,10 @@ void InitAudio(AudioSignal *Signal, parameters *config)
 			Signal->Blocks[n].audio.sampleOffset = 0;
 
 			Signal->Blocks[n].fftwValuesRight.spectrum = NULL;
+			Signal->Blocks[n].fftwValuesRight.spectrumf = NULL;
 			Signal->Blocks[n].fftwValuesRight.size = 0;
 			Signal->Blocks[n].fftwValuesRight.ENBW = 0;
+			Signal->Blocks[n].fftwValuesRight.shared = 0;
 
 			Signal->Blocks[n].audioRight.samples = NULL;
 			Signal->Blocks[n].audioRight.windowed_samples = NULL;
@@ -421,6 +459,7 @@ void InitAudio(AudioSignal *Signal, parameters *config)
 	Signal->SamplesStart = 0;
 	Signal->samplesPosFLAC = 0;
 	Signal->errorFLAC = 0;
+	Signal->blocksizeFLAC = 0;
 	Signal->framerate = 0.0;
 	memset(&Signal->header, 0, sizeof(wav_hdr));
 	memset(&Signal->fmtExtra, 0, sizeof(uint8_t)*FMT_EXTRA_SIZE);
@@ -449,6 +488,8 @@ void InitAudio(AudioSignal *Signal, parameters *config)
 
 	memset(&Signal->delayArray, 0, sizeof(double)*DELAYCOUNT);
 	Signal->delayElemCount = 0;
+	memset(&Signal->syncCache, 0, sizeof(SyncCache));
+	memset(&Signal->stream, 0, sizeof(PCMStream));
 
 	Signal->balance = 0;
 	memset(&Signal->clkFrequencies, 0, sizeof(AudioBlocks));
@@ -491,27 +532,49 @@ void CleanAndReleaseFFTW(AudioBlocks * AudioArray)
 	if(!AudioArray)
 		return;
 
-	ReleaseFFTW(AudioArray);
+	ReleaseFFTW(AudioArray, NULL);
 	AudioArray->fftwValues.size = 0;
 	AudioArray->fftwValues.ENBW = 0;
 }
 
-void ReleaseFFTW(AudioBlocks * AudioArray)
+// Spectra go back to the pool if there is one, sizes match the allocations in ExecuteDFFT
+void ReleaseFFTW(AudioBlocks * AudioArray, BufferPool *pool)
 {
+	size_t	bytes = 0;
+
 	if(!AudioArray)
 		return;
 
+	// batched stereo spectra are released with the left channel
+	if(AudioArray->fftwValuesRight.spectrum)
+	{
+		bytes = sizeof(fftw_complex)*(AudioArray->fftwValuesRight.size/2+1);
+		if(!AudioArray->fftwValuesRight.shared)
+			PoolFree(pool, AudioArray->fftwValuesRight.spectrum, bytes);
+		AudioArray->fftwValuesRight.spectrum = NULL;
+	}
+
 	if(AudioArray->fftwValues.spectrum)
 	{
-		fftw_free(AudioArray->fftwValues.spectrum);
+		bytes = sizeof(fftw_complex)*(AudioArray->fftwValues.size/2+1);
+		if(AudioArray->fftwValuesRight.shared)
+			bytes *= 2;
+		PoolFree(pool, AudioArray->fftwValues.spectrum, bytes);
 		AudioArray->fftwValues.spectrum = NULL;
 	}
 
-	if(AudioArray->fftwValuesRight.spectrum)
+	if(AudioArray->fftwValuesRight.spectrumf)
 	{
-		fftw_free(AudioArray->fftwValuesRight.spectrum);
-		AudioArray->fftwValuesRight.spectrum = NULL;
+		PoolFree(pool, AudioArray->fftwValuesRight.spectrumf, sizeof(fftwf_complex)*(AudioArray->fftwValuesRight.size/2+1));
+		AudioArray->fftwValuesRight.spectrumf = NULL;
+	}
+
+	if(AudioArray->fftwValues.spectrumf)
+	{
+		PoolFree(pool, AudioArray->fftwValues.spectrumf, sizeof(fftwf_complex)*(AudioArray->fftwValues.size/2+1));
+		AudioArray->fftwValues.spectrumf = NULL;
 	}
+	AudioArray->fftwValuesRight.shared = 0;
 }
 
 void ReleaseSamples(AudioBlocks * AudioArray)
@@ -609,6 +672,12 @@ void ReleasePCM(AudioSignal *Signal)
 	if(!Signal)
 		return;
 
+	if(Signal->stream.active)
+	{
+		ClosePCMStream(Signal);
+		return;
+	}
+
 	if(Signal->Samples)
 	{
 		free(Signal->Samples);
@@ -633,6 +702,7 @@ void ReleaseAudio(AudioSignal *Signal, parameters *config)
 	if(config->clkMeasure)
 		ReleaseBlock(&Signal->clkFrequencies);
 	ReleasePCM(Signal);
+	ReleasePool(&Signal->pool);
 
 	InitAudio(Signal, config);
 }
@@ -646,23 +716,8 @@ void ReleaseAudioBlockStructure(parameters *config)
 		config->types.typeCount = 0;
 	}
 
-	if(config->model_plan)
-	{
-		fftw_export_wisdom_to_filename("wisdom.fftw");
-
-		fftw_destroy_plan(config->model_plan);
-		config->model_plan = NULL;
-	}
-	if(config->reverse_plan)
-	{
-		fftw_destroy_plan(config->reverse_plan);
-		config->reverse_plan = NULL;
-	}
-	if(config->sync_plan)
-	{
-		fftw_destroy_plan(config->sync_plan);
-		config->sync_plan = NULL;
-	}
+	ReleasePlanCache(config);
+	ReleaseWindowCache();
 	if(config->clkBlocksAdjust)
 	{
 		free(config->clkBlocksAdjust);
@@ -2423,11 +2478,13 @@ void PrintFrequenciesBlockMagnitude(AudioSignal *Signal, Frequency *freq, parame
 	{
 		if(freq[j].hertz)
 		{
-			logmsgFileOnly("Frequency [%5d] %7g Hz Magnitude: %g Phase: %g",
+			logmsgFileOnly("Frequency [%5d] %7g Hz Magnitude: %g",
 				j, 
 				freq[j].hertz,
-				freq[j].magnitude,
-				freq[j].phase);
+				freq[j].magnitude);
+			// Phase is zero when it was not computed
+			if(IsPhaseNeeded(config))
+				logmsgFileOnly(" Phase: %g", freq[j].phase);
 			/* detect VideoRefresh frequency */
 			if(Signal && IsHRefreshNoise(Signal, freq[j].hertz))
 				logmsgFileOnly(" [Horizontal Refresh Noise?]");
@@ -2457,11 +2514,12 @@ void PrintFrequenciesBlock(AudioSignal *Signal, Frequency *freq, long int size,
 
 		if(freq[j].hertz && freq[j].amplitude != NO_AMPLITUDE)
 		{
-			logmsgFileOnly("Frequency [%5d] %7g Hz Amplitude: %g dBFS Phase: %g",
+			logmsgFileOnly("Frequency [%5d] %7g Hz Amplitude: %g dBFS",
 				j, 
 				freq[j].hertz,
-				freq[j].amplitude,
-				freq[j].phase);
+				freq[j].amplitude);
+			if(IsPhaseNeeded(config))
+				logmsgFileOnly(" Phase: %g", freq[j].phase);
 			/* detect VideoRefresh frequency */
 			if(Signal && IsHRefreshNoise(Signal, freq[j].hertz))
 				logmsgFileOnly(" [Horizontal Refresh Noise?]");
@@ -2595,18 +2653,50 @@ int FillFrequencyStructures(AudioSignal *Signal, AudioBlocks *AudioArray, parame
 	}
 	if(!FillFrequencyStructuresInternal(Signal, AudioArray, channel, config))
 		return 0;
-	ReleaseFFTW(AudioArray);
+	ReleaseFFTW(AudioArray, Signal ? &Signal->pool : NULL);
 	return 1;
 }
 
+// Phase is only used by the phase plots, the difference report and the frequency logs
+int IsPhaseNeeded(parameters *config)
+{
+	return(config->plotPhase || config->extendedResults || config->verbose);
+}
+
+// Single precision bins are widened one at a time, same value as a widened copy
+static double CalculateBinPhase(FFTWSpectrum *fftw, long int bin)
+{
+	fftw_complex	value = 0;
+
+	if(fftw->spectrumf)
+		value = crealf(fftw->spectrumf[bin]) + I*cimagf(fftw->spectrumf[bin]);
+	else
+		value = fftw->spectrum[bin];
+	return(CalculatePhase(&value));
+}
+
+static void FillFrequenciesFromBins(Frequency *f_array, BinRank *bins, long int count, FFTWSpectrum *fftw, double boxsize, int usePhase)
+{
+	for(long int i = 0; i < count; i++)
+	{
+		f_array[i].hertz = CalculateFrequency(bins[i].bin, boxsize);
+		f_array[i].magnitude = bins[i].magnitude;
+		f_array[i].amplitude = NO_AMPLITUDE;
+		f_array[i].phase = usePhase ? CalculateBinPhase(fftw, bins[i].bin) : 0;
+		f_array[i].matched = 0;
+	}
+}
+
 int FillFrequencyStructuresInternal(AudioSignal *Signal, AudioBlocks *AudioArray, char channel, parameters *config)
 {
-	long int 		i = 0, startBin= 0, endBin = 0, count = 0, size = 0, amount = 0;
+	long int 		startBin= 0, endBin = 0, count = 0, size = 0, amount = 0;
 	double 			boxsize = 0;
 	int				nyquistLimit = 0;
 	long int		*SilenceSize = NULL;
 	double			ENBW = 0;
 	Frequency		*f_array = NULL, **targetFreq = NULL;
+	BinRank			*bins = NULL;
+	BufferPool		*pool = NULL;
 	FFTWSpectrum	*fftw = NULL;
 
 	if(channel == CHANNEL_LEFT)
@@ -2624,7 +2714,7 @@ int FillFrequencyStructuresInternal(AudioSignal *Signal, AudioBlocks *AudioArray
 	size = fftw->size;
 	ENBW = fftw->ENBW;
 
-	if(!size || !fftw->spectrum || !targetFreq || !(*targetFreq) || !ENBW)
+	if(!size || (!fftw->spectrum && !fftw->spectrumf) || !targetFreq || !(*targetFreq) || !ENBW)
 	{
 		logmsg("ERROR: Invalid FillFrequencyStructures params\n");
 		return 0;
@@ -2654,49 +2744,55 @@ int FillFrequencyStructuresInternal(AudioSignal *Signal, AudioBlocks *AudioArray
 	logmsgFileOnly("Size: %ld BoxSize: %g StartBin: %ld EndBin %ld\n",
 		 size, boxsize, startBin, endBin);
 	*/
-	f_array = (Frequency*)malloc(sizeof(Frequency)*(endBin-startBin));
-	if(!f_array)
+	count = endBin-startBin;
+	if(count < 0)
+		count = 0;
+	pool = Signal ? &Signal->pool : NULL;
+	bins = (BinRank*)PoolAlloc(pool, sizeof(BinRank)*count);
+	if(!bins)
 	{
-		logmsg("ERROR: Not enough memory (f_array)\n");
+		logmsg("ERROR: Not enough memory (bins)\n");
 		return 0;
 	}
-	memset(f_array, 0, sizeof(Frequency)*(endBin-startBin));
 
-	for(i = startBin; i < endBin; i++)
-	{
-		f_array[count].hertz = CalculateFrequency(i, boxsize);
-		f_array[count].magnitude = CalculateMagnitude(&fftw->spectrum[i], ENBW);
-		f_array[count].amplitude = NO_AMPLITUDE;
-		f_array[count].phase = CalculatePhase(&fftw->spectrum[i]);
-		f_array[count].matched = 0;
-		count++;
-	}
+	if(fftw->spectrumf)
+		CalculateBinMagnitudesFloat(fftw->spectrumf, bins, startBin, endBin, ENBW);
+	else
+		CalculateBinMagnitudes(fftw->spectrum, bins, startBin, endBin, ENBW);
 
 	if(config->MaxFreq > count)
 		amount = count;
 	else
 		amount = config->MaxFreq;
 
-	// Sort the array by top magnitudes
-	FFT_Frequency_Magnitude_tim_sort(f_array, count);
-
 	if(AudioArray->type != TYPE_SILENCE)
 	{
-		// Only copy Top amount frequencies
-		memcpy(*targetFreq, f_array, sizeof(Frequency)*amount);
-
-		// release temporal storage
-		free(f_array);
-		f_array = NULL;
+		// Only the Top amount frequencies are kept, select and sort those
+		SelectTopBins(bins, count, amount);
+		SortBins(bins, amount);
+		FillFrequenciesFromBins(*targetFreq, bins, amount, fftw, boxsize, IsPhaseNeeded(config));
 	}
 	else
 	{
-		// We use the whole frequency range for Noise floor analysis
+		// We use the whole frequency range for Noise floor analysis,
+		// and it is compared down to SILENCE_LIMIT, so it is all sorted
+		f_array = (Frequency*)malloc(sizeof(Frequency)*count);
+		if(!f_array)
+		{
+			PoolFree(pool, bins, sizeof(BinRank)*count);
+			logmsg("ERROR: Not enough memory (f_array)\n");
+			return 0;
+		}
+
+		SortBins(bins, count);
+		FillFrequenciesFromBins(f_array, bins, count, fftw, boxsize, IsPhaseNeeded(config));
+
 		free(*targetFreq);
 		*targetFreq = f_array;
 		*SilenceSize = count;	
 	}
 
+	PoolFree(pool, bins, sizeof(BinRank)*count);
 	return 1;
 }
 
@@ -2860,18 +2956,22 @@ void PrintThesholdDifferenceBlocks(AudioBlocks *ReferenceArray, AudioBlocks *Com
 
 double CalculateWeightedError(double pError, parameters *config)
 {
-	int option = 0;
+	int option = 0, reported = 0;
 
 	if(pError < 0.0)  // this should never happen
 	{
-		if(!config->pErrorReport)
+		// Both signals can get here at the same time
+#ifdef OPENMP_ENABLE
+		#pragma omp atomic capture
+#endif
+		reported = ++config->pErrorReport;
+		if(reported == 1)
 			logmsg("WARNING: pERROR < 0! (%g)\n", pError);
-		config->pErrorReport++;
 
 		pError = fabs(pError);
 		if(pError > 1)
 		{
-			if(!config->pErrorReport)
+			if(!reported)
 				logmsg("WARNING: pERROR > 1! (%g)\n", pError);
 			return 1;
 		}
@@ -3257,6 +3357,9 @@ double CalculateFrameRateAndCheckSamplerate(AudioSignal *Signal, parameters *con
 			else
 				config->ComCentsDifferenceSR = centsDifferenceSR;
 			
+#ifdef OPENMP_ENABLE
+			#pragma omp atomic
+#endif
 			config->SRNoMatch |= Signal->role;
 		}
 	}
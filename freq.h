@@ -88,11 +88,12 @@ void CheckSilenceOverride(parameters *config);
 int ConvertAudioTypeForProcessing(int type, parameters *config);
 int getArrayIndexforType(int type, int *typeArray, int typeCount);
 long int GetBlockFreqSize(AudioSignal *Signal, int block, char channel, parameters *config);
+int CalculateMaxCompare(int block, AudioSignal *Signal, double significant, char channel, parameters *config);
 
 AudioSignal *CreateAudioSignal(parameters *config);
 void CleanFrequency(Frequency *freq);
 void CleanFrequenciesInBlock(AudioBlocks * AudioArray, parameters *config);
-void ReleaseFFTW(AudioBlocks * AudioArray);
+void ReleaseFFTW(AudioBlocks * AudioArray, BufferPool *pool);
 void CleanAndReleaseFFTW(AudioBlocks * AudioArray);
 void ReleaseSamples(AudioBlocks * AudioArray);
 void ReleaseFrequencies(AudioBlocks * AudioArray);
@@ -105,6 +106,7 @@ void ReleaseAudio(AudioSignal *Signal, parameters *config);
 void CleanMatched(AudioSignal *ReferenceSignal, AudioSignal *TestSignal, parameters *config);
 int FillFrequencyStructures(AudioSignal *Signal, AudioBlocks *AudioArray, parameters *config);
 int FillFrequencyStructuresInternal(AudioSignal *Signal, AudioBlocks *AudioArray, char channel, parameters *config);
+int IsPhaseNeeded(parameters *config);
 void PrintFrequencies(AudioSignal *Signal, parameters *config);
 void PrintFrequenciesWMagnitudes(AudioSignal *Signal, parameters *config);
 void PrintFrequenciesBlock(AudioSignal *Signal, Frequency *freq, long int size, int type, parameters *config);
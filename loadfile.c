@@ -34,16 +34,28 @@
 #include "loadfile.h"
 #include "profile.h"
 #include "sync.h"
+#include "synccache.h"
+#include "stream.h"
+#include "decode.h"
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__)
+	#include <sys/mman.h>
+	#define WAV_MMAP
+#endif
 
 int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 {
+	int		streaming = 0;
+
 	*Signal = CreateAudioSignal(config);
 	if(!*Signal)
 		return 0;
 	(*Signal)->role = role;
+	sprintf((*Signal)->SourceFile, "%s", fileName);
 
 	logmsg("\n* Loading '%s' audio file %s\n", role == ROLE_REF ? "Reference" : "Comparison", fileName);
 
+	streaming = CanStreamPCM(*Signal, config);
 	if(IsFlac(fileName))
 	{
 		struct	timespec	start, end;
@@ -51,20 +63,43 @@ int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 		if(config->clock)
 			clock_gettime(CLOCK_MONOTONIC, &start);
 
-		if(config->verbose) { logmsg(" - Decoding FLAC\n"); }
-		if(!FLACtoSignal(fileName, *Signal))
+		// Header only, blocks are decoded as they are processed
+		if(streaming)
+		{
+			if(FLACReadStreamInfo(fileName, *Signal) && OpenPCMStream(*Signal, fileName))
+			{
+				(*Signal)->samplesPosFLAC = (*Signal)->numSamples;
+				if(!FillRIFFHeader(&(*Signal)->header))
+					return 0;
+			}
+			else
+			{
+				logmsg(" - WARNING: Could not stream the FLAC file, loading the whole file\n");
+				streaming = 0;
+			}
+		}
+
+		if(!streaming)
 		{
-			char *error  = NULL;
+			int		segmented = 0;
 
-			error = getflacErrorStr();
-			if(!flacErrorReported())
+			if(config->verbose) { logmsg(" - Decoding FLAC\n"); }
+			if(config->segmentFLAC)
+				segmented = FLACtoSignalSegmented(fileName, *Signal) && FillRIFFHeader(&(*Signal)->header);
+			if(!segmented && !FLACtoSignal(fileName, *Signal))
 			{
-				if(!error)
-					logmsg("\nERROR: Invalid FLAC file %s\n", fileName);
-				else
-					logmsg("\nERROR: Invalid FLAC (%s) file %s\n", error, fileName);
+				char *error  = NULL;
+
+				error = getflacErrorStr();
+				if(!flacErrorReported())
+				{
+					if(!error)
+						logmsg("\nERROR: Invalid FLAC file %s\n", fileName);
+					else
+						logmsg("\nERROR: Invalid FLAC (%s) file %s\n", error, fileName);
+				}
+				return 0;
 			}
-			return 0;
 		}
 		if(config->clock)
 		{
@@ -85,7 +120,7 @@ int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 			return 0;
 		}
 
-		if(!LoadWAVFile(file, *Signal, config))
+		if(!LoadWAVFile(file, *Signal, streaming, config))
 		{
 			fclose(file);
 			return 0;
@@ -97,8 +132,6 @@ int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 	if(!AdjustSignalValues(*Signal, config))
 		return 0;
 
-	sprintf((*Signal)->SourceFile, "%s", fileName);
-
 	if(!DetectSync(*Signal, config))
 		return 0;	
 	return 1;
@@ -196,13 +229,167 @@ int CheckFactChunk(FILE *file, AudioSignal *Signal)
 	return 1;
 }
 
-int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config)
+// no endianess considerations, PCM in RIFF is little endian and this code is little endian
+int ConvertWAVBlock(const uint8_t *bytes, SampleValue *samples, long int count, int AudioFormat, int bytesPerSample)
+{
+	if(AudioFormat == WAVE_FORMAT_PCM)
+	{
+		switch(bytesPerSample)
+		{
+			case 1:
+				DecodePCM8(bytes, samples, count);
+				return 1;
+			case 2:
+				DecodePCM16(bytes, samples, count);
+				return 1;
+			case 3:
+				DecodePCM24(bytes, samples, count);
+				return 1;
+			case 4:
+				DecodePCM32(bytes, samples, count);
+				return 1;
+		}
+	}
+
+	if(AudioFormat == WAVE_FORMAT_IEEE_FLOAT && bytesPerSample == 4)
+	{
+		DecodeFloat32(bytes, samples, count);
+		return 1;
+	}
+
+	if(AudioFormat == WAVE_FORMAT_IEEE_FLOAT && bytesPerSample == 8)
+	{
+#ifdef FLOAT_SAMPLES
+		for(long int i = 0; i < count; i++)
+		{
+			double	sample = 0;
+
+			memcpy(&sample, bytes+i*8, sizeof(double));
+			samples[i] = (float)sample;
+		}
+#else
+		// Already doubles
+		memcpy(samples, bytes, sizeof(double)*count);
+#endif
+		return 1;
+	}
+
+	logmsg("ERROR: Unsupported audio format (bytes sample %d)\n", bytesPerSample);
+	return 0;
+}
+
+#ifdef WAV_MMAP
+// Converts straight from the mapped file, pages already converted are released as it goes
+int LoadWAVSamplesMapped(FILE *file, AudioSignal *Signal, long int byteOffset)
+{
+	int			fd = 0;
+	long int	pageSize = 0, mapOffset = 0, samplePos = 0, blockSamples = 0, released = 0;
+	size_t		mapSize = 0;
+	uint8_t		*map = NULL, *data = NULL;
+	struct stat	st;
+
+	fd = fileno(file);
+	pageSize = sysconf(_SC_PAGESIZE);
+	if(fd < 0 || pageSize <= 0 || fstat(fd, &st) != 0)
+		return 0;
+	if((off_t)byteOffset + (off_t)Signal->header.data.DataSize > st.st_size)
+		return 0;
+
+	mapOffset = byteOffset - byteOffset % pageSize;
+	mapSize = (size_t)(byteOffset - mapOffset) + Signal->header.data.DataSize;
+	map = (uint8_t*)mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, mapOffset);
+	if(map == MAP_FAILED)
+		return 0;
+	madvise(map, mapSize, MADV_SEQUENTIAL);
+
+	data = map + (byteOffset - mapOffset);
+	blockSamples = WAV_CONVERT_BLOCK/Signal->bytesPerSample;
+	for(samplePos = 0; samplePos < Signal->numSamples; samplePos += blockSamples)
+	{
+		long int	count = 0, done = 0;
+
+		count = Signal->numSamples - samplePos < blockSamples ? Signal->numSamples - samplePos : blockSamples;
+		if(!ConvertWAVBlock(data + samplePos*Signal->bytesPerSample, Signal->Samples + samplePos, count,
+				Signal->header.fmt.AudioFormat, Signal->bytesPerSample))
+		{
+			munmap(map, mapSize);
+			return -1;
+		}
+
+		done = (data - map) + (samplePos + count)*Signal->bytesPerSample;
+		done -= done % pageSize;
+		if(done > released)
+		{
+			madvise(map + released, done - released, MADV_DONTNEED);
+			released = done;
+		}
+	}
+
+	munmap(map, mapSize);
+	return 1;
+}
+#endif
+
+// Returns 1 when loaded, 0 on failure
+int LoadWAVSamples(FILE *file, AudioSignal *Signal, long int byteOffset)
+{
+	long int	samplePos = 0, blockSamples = 0;
+	uint8_t		*fileBytes = NULL;
+	size_t		bytesRead = 0, totalRead = 0;
+
+#ifdef WAV_MMAP
+	switch(LoadWAVSamplesMapped(file, Signal, byteOffset))
+	{
+		case 1:
+			return 1;
+		case -1:
+			return 0;
+	}
+#endif
+
+	// Read based fallback, in blocks so the raw data is never held whole
+	if(fseek(file, byteOffset, SEEK_SET) != 0)
+		return 0;
+
+	fileBytes = (uint8_t*)malloc(sizeof(uint8_t)*WAV_CONVERT_BLOCK);
+	if(!fileBytes)
+	{
+		logmsg("\tERROR: Sample block malloc failed! [WAV_CONVERT_BLOCK]\n");
+		return(0);
+	}
+
+	blockSamples = WAV_CONVERT_BLOCK/Signal->bytesPerSample;
+	for(samplePos = 0; samplePos < Signal->numSamples; samplePos += blockSamples)
+	{
+		long int	count = 0;
+
+		count = Signal->numSamples - samplePos < blockSamples ? Signal->numSamples - samplePos : blockSamples;
+		bytesRead = fread(fileBytes, 1, count*Signal->bytesPerSample, file);
+		totalRead += bytesRead;
+		if(bytesRead != (size_t)(count*Signal->bytesPerSample))
+		{
+			free(fileBytes);
+			logmsg("\tERROR: Corrupt RIFF Header\n\tCould not read the whole sample block from disk to RAM.\n\tBytes Read: %ld Expected: %ld\n",
+				totalRead, sizeof(int8_t)*Signal->header.data.DataSize);
+			return(0);
+		}
+
+		if(!ConvertWAVBlock(fileBytes, Signal->Samples + samplePos, count, Signal->header.fmt.AudioFormat, Signal->bytesPerSample))
+		{
+			free(fileBytes);
+			return 0;
+		}
+	}
+
+	free(fileBytes);
+	return 1;
+}
+
+int LoadWAVFile(FILE *file, AudioSignal *Signal, int streaming, parameters *config)
 {
 	int					found = 0, samplesLoaded = 0, validformat = 0;
-	size_t				bytesRead = 0;
 	struct timespec		start, end;
-	long int			samplePos = 0, srcPos = 0, byteOffset = 0;
-	uint8_t				*fileBytes = NULL;
+	long int			byteOffset = 0;
 
 	if(config->clock)
 		clock_gettime(CLOCK_MONOTONIC, &start);
@@ -400,138 +587,104 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config)
 	byteOffset = ftell(file);
 	Signal->SamplesStart = byteOffset;
 
-	fileBytes = (uint8_t*)malloc(sizeof(uint8_t)*Signal->header.data.DataSize);
-	if(!fileBytes)
-	{
-		logmsg("\tERROR: All Chunks malloc failed! [Signal->header.data.DataSize]\n");
-		return(0);
-	}
-
-	memset(fileBytes, 0, sizeof(uint8_t)*Signal->header.data.DataSize);
-
-	bytesRead = fread(fileBytes, 1, sizeof(uint8_t)*Signal->header.data.DataSize, file);
-	if(bytesRead != sizeof(uint8_t)*Signal->header.data.DataSize)
-	{
-		free(fileBytes);
-		logmsg("\tERROR: Corrupt RIFF Header\n\tCould not read the whole sample block from disk to RAM.\n\tBytes Read: %ld Expected: %ld\n",
-			bytesRead, sizeof(int8_t)*Signal->header.data.DataSize);
-		return(0);
-	}
-
+	// The fact chunk of extensible files follows the data
 	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_EXTENSIBLE)
 	{
-		if(!CheckFactChunk(file, Signal))
-		{
-			free(fileBytes);
+		if(fseek(file, byteOffset + Signal->header.data.DataSize, SEEK_SET) != 0 || !CheckFactChunk(file, Signal))
 			return 0;
-		}
 		validformat = 1;
 	}
 
 	if(Signal->header.fmt.AudioFormat != WAVE_FORMAT_PCM && /* If fact chunk check didn't remove EXTENSIBLE... */
 		Signal->header.fmt.AudioFormat != WAVE_FORMAT_IEEE_FLOAT)
 	{
-		free(fileBytes);
 		logmsg("\tERROR: Only 8/16/24/32bit PCM or 32/64 bit IEEE float supported.\n\tPlease convert file sample format.\n");
 		return(0);
 	}
 
-	// Convert samples to internal double ones
-	Signal->Samples = (double*)malloc(sizeof(double)*Signal->numSamples);
+#ifdef FLOAT_SAMPLES
+	// float holds up to 24 bit PCM and 32 bit float exactly, wider ones are rounded
+	if(Signal->header.fmt.bitsPerSample > 24 &&
+		!(Signal->header.fmt.AudioFormat == WAVE_FORMAT_IEEE_FLOAT && Signal->header.fmt.bitsPerSample == 32))
+		logmsg(" - WARNING: %d bit samples are rounded to float in this build\n", Signal->header.fmt.bitsPerSample);
+#endif
+
+	// Samples are converted as each block is processed
+	if(streaming)
+	{
+		if(OpenPCMStream(Signal, Signal->SourceFile))
+			return 1;
+		logmsg(" - WARNING: Could not stream the file, loading it whole\n");
+	}
+
+	// Convert samples to the internal representation, double unless built with FLOAT_SAMPLES
+	Signal->Samples = (SampleValue*)malloc(sizeof(SampleValue)*Signal->numSamples);
 	if(!Signal->Samples)
 	{
-		free(fileBytes);
 		logmsg("\tERROR: Internal sample array malloc failed! [Signal->numSamples]\n");
 		return(0);
 	}
-	memset(Signal->Samples, 0, sizeof(double)*Signal->numSamples);
 
-	// no endianess considerations, PCM in RIFF is little endian and this code is little endian
-	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_PCM)
-	{
-		for(samplePos = 0; samplePos < Signal->numSamples; samplePos++)
-		{
-			int32_t	sample = 0;
-			int8_t	signSample = 0;
-	
-			switch(Signal->bytesPerSample)
-			{
-				case 1:
-					sample = fileBytes[srcPos]-0x80;	// 8 bit is unsigned. Convert to signed
-					break;
-				case 2:
-					signSample = fileBytes[srcPos+1];
-					if(signSample < 0)
-						sample = 0xffff0000;
-					sample |= (fileBytes[srcPos+1] << 8) | fileBytes[srcPos];
-					break;
-				case 3:
-					signSample = fileBytes[srcPos+2];
-					if(signSample < 0)
-						sample = 0xff000000;
-					sample |= (fileBytes[srcPos+2] << 16) | (fileBytes[srcPos+1] << 8) | fileBytes[srcPos];
-					break;
-				case 4:
-					sample = (fileBytes[srcPos+3] << 24) | (fileBytes[srcPos+2] << 16) | (fileBytes[srcPos+1] << 8) | fileBytes[srcPos];
-					break;
-				default:
-					logmsg("ERROR: Unsupported audio format (bytes sample %d)\n", Signal->bytesPerSample);
-					free(fileBytes);
-					return 0;
-			}
-			srcPos += Signal->bytesPerSample;
-	
-			Signal->Samples[samplePos] = (double)sample;
-		}
+	samplesLoaded = LoadWAVSamples(file, Signal, byteOffset);
 
-		samplesLoaded = 1;
-	}
+	if(!samplesLoaded)
+		return 0;
 
-	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_IEEE_FLOAT && Signal->header.fmt.bitsPerSample == 32)
+	if(config->clock)
 	{
-		for(samplePos = 0; samplePos < Signal->numSamples; samplePos++)
-		{
-			float	sample = 0;
-	
-			ConvertByteArrayToIEEE32Sample(fileBytes+srcPos, &sample);
-			Signal->Samples[samplePos] = (double)sample;
-			srcPos += 4;
-		}
-
-		samplesLoaded = 1;
+		double	elapsedSeconds;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
+		logmsg(" - clk: Loading Audio took %0.2fs", elapsedSeconds);
+		if(elapsedSeconds > 0)
+			logmsg(" (%0.1f MB/s)", Signal->header.data.DataSize/1048576.0/elapsedSeconds);
+		logmsg("\n");
 	}
 
-	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_IEEE_FLOAT && Signal->header.fmt.bitsPerSample == 64)
-	{
-		for(samplePos = 0; samplePos < Signal->numSamples; samplePos++)
-		{
-			double	sample = 0;
-	
-			ConvertByteArrayToIEEE64Sample(fileBytes+srcPos, &sample);
-			Signal->Samples[samplePos] = (double)sample;
-			srcPos += 8;
-		}
-
-		samplesLoaded = 1;
-	}
+	return 1;
+}
 
-	free(fileBytes);
-	fileBytes = NULL;
+/*
+	Streamed signals look for the start pulse in windows from the start of the
+	file and stop at the first one that has it, only the audio each scan reads
+	is in memory. Windows overlap by a whole scan, so a train across the limit
+	is found whole. Short captures have a short lead and are read at once.
+*/
+static int DetectStreamedPulse(AudioSignal *Signal, long int *offset, parameters *config)
+{
+	long int	searchEnd = 0, before = 0, after = 0, window = 0;
 
-	if(!samplesLoaded)
+	*offset = -1;
+	searchEnd = GetStartPulseSearchEnd(Signal->header, Signal->role, config);
+	GetPulseReadMargins(Signal->header, Signal->role, &before, &after, config);
+	window = searchEnd;
+	if(IsLongCapture(Signal->header, Signal->role, config))
 	{
-		logmsg("ERROR: Unsupported audio format, samples were not loaded\n");
-		return 0;
+#ifdef OPENMP_ENABLE
+		#pragma omp atomic write
+#endif
+		config->trimmingNeeded = 1;
+		window = STREAM_SYNC_WINDOW - STREAM_SYNC_WINDOW % Signal->AudioChannels;
 	}
 
-	if(config->clock)
+	for(long int first = 0; first < searchEnd; first += window)
 	{
-		double	elapsedSeconds;
-		clock_gettime(CLOCK_MONOTONIC, &end);
-		elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
-		logmsg(" - clk: Loading Audio took %0.2fs\n", elapsedSeconds);
+		long int	last = 0;
+
+		last = first + window + after;
+		if(last > searchEnd)
+			last = searchEnd;
+		if(!StreamSamples(Signal, first - before, last + after))
+			return 0;
+
+		*offset = DetectPulseInRange(Signal->Samples, Signal->header, first, last, Signal->role, config);
+		if(*offset != -1)
+			return 1;
 	}
 
+	if(!StreamSamples(Signal, 0, GetSignalStartSearchEnd(Signal->header, Signal->role, config)))
+		return 0;
+	*offset = DetectPulseAfterSignalStart(Signal->Samples, Signal->header, Signal->role, config);
 	return 1;
 }
 
@@ -600,14 +753,41 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 	
 	if(GetFirstSyncIndex(config) != NO_INDEX && !config->noSyncProfile)
 	{
+		int		cached = 0, useCache = 0, SRNoMatch = 0;
+		double	SampleRate = 0, originalSR = 0, originalFrameRate = 0, EstimatedSR = 0, centsDifferenceSR = 0;
+
 		if(config->clock)
 			clock_gettime(CLOCK_MONOTONIC, &start);
 
+		// The cache key hashes all samples, streamed files are never whole in memory
+		useCache = config->useSyncCache && !Signal->stream.active;
+		if(useCache)
+			cached = LoadSyncCache(Signal, config);
+		if(cached)
+		{
+			// The frame rate check can adjust the sample rate, undone if the cache is dropped
+			SampleRate = Signal->SampleRate;
+			originalSR = Signal->originalSR;
+			originalFrameRate = Signal->originalFrameRate;
+			EstimatedSR = Signal->EstimatedSR;
+			SRNoMatch = config->SRNoMatch & Signal->role;
+			centsDifferenceSR = Signal->role == ROLE_REF ? config->RefCentsDifferenceSR : config->ComCentsDifferenceSR;
+		}
+
 		/* Find the start offset */
 		if(config->verbose) { 
 			logmsg(" - Sync pulse train: "); 
 		}
-		Signal->startOffset = DetectPulse(Signal->Samples, Signal->header, Signal->role, config);
+		if(!cached)
+		{
+			if(Signal->stream.active)
+			{
+				if(!DetectStreamedPulse(Signal, &Signal->startOffset, config))
+					return 0;
+			}
+			else
+				Signal->startOffset = DetectPulse(Signal->Samples, Signal->header, Signal->role, config);
+		}
 		if(Signal->startOffset == -1)
 		{
 			int format = 0;
@@ -632,7 +812,6 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 				logmsg(" - Leading/tailing silence too long, if sync detection fails please consider trimming\n");
 			return 0;
 		}
-		config->syncAlignIterator++;
 		
 		if(config->verbose || config->debugSync) {
 			logmsg("\n\t   %gs [%ld samples", 
@@ -652,7 +831,18 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 			if(config->verbose) { 
 				logmsg("\t to");
 			}
-			Signal->endOffset = DetectEndPulse(Signal->Samples, Signal->startOffset, Signal->header, Signal->role, config);
+			if(!cached && Signal->stream.active)
+			{
+				long int	startSearch = 0, endSearch = 0, before = 0, after = 0;
+
+				// Every end pulse scan starts within the range
+				GetEndPulseSearchRange(Signal->startOffset, Signal->header, Signal->role, &startSearch, &endSearch, config);
+				GetPulseReadMargins(Signal->header, Signal->role, &before, &after, config);
+				if(!StreamSamples(Signal, startSearch - before, endSearch + after))
+					return 0;
+			}
+			if(!cached)
+				Signal->endOffset = DetectEndPulse(Signal->Samples, Signal->startOffset, Signal->header, Signal->role, config);
 			if(Signal->endOffset == -1)
 			{
 				int format = 0;
@@ -670,8 +860,6 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 				return 0;
 			}
 
-			config->syncAlignIterator++;
-
 			if(config->verbose) {
 				logmsg(" %gs [%ld samples", 
 					SamplesToSeconds(Signal->SampleRate, Signal->endOffset, Signal->AudioChannels),
@@ -690,6 +878,29 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 				return 0;
 			}
 
+			if(cached && !CheckSyncCache(Signal, config))
+			{
+				Signal->SampleRate = SampleRate;
+				Signal->originalSR = originalSR;
+				Signal->originalFrameRate = originalFrameRate;
+				Signal->EstimatedSR = EstimatedSR;
+				if(Signal->role == ROLE_REF)
+					config->RefCentsDifferenceSR = centsDifferenceSR;
+				else
+					config->ComCentsDifferenceSR = centsDifferenceSR;
+				if(!SRNoMatch)
+				{
+#ifdef OPENMP_ENABLE
+					#pragma omp atomic
+#endif
+					config->SRNoMatch &= ~Signal->role;
+				}
+				return(DetectSync(Signal, config));
+			}
+
+			if(useCache && !cached)
+				StoreSyncCache(Signal, config);
+
 			if(Signal->originalSR != 0.0)
 				logmsg(" - Using adjusted %.8g Hz signal (%.8gms per frame) from Audio signal duration\n",
 					roundFloat(CalculateScanRate(Signal)), Signal->framerate);
@@ -717,6 +928,7 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 			PrintAudioBlocks(config);
 			return 0;
 		}
+		StreamSamples(Signal, 0, 0);
 
 		if(config->clock)
 		{
@@ -853,6 +1065,9 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 										GetSignalTotalDuration(Signal->framerate, config), 
 										Signal->AudioChannels, NULL, NULL);
 			}
+#ifdef OPENMP_ENABLE
+			#pragma omp atomic write
+#endif
 			config->significantAmplitude = -90;
 			break;
 			default:
@@ -908,6 +1123,9 @@ int AdjustSignalValues(AudioSignal *Signal, parameters *config)
 	{
 		logmsg(" - WARNING: Estimated file length is shorter than the expected %g seconds\n",
 				GetSignalTotalDuration(Signal->framerate, config));
+#ifdef OPENMP_ENABLE
+		#pragma omp atomic
+#endif
 		config->smallFile |= Signal->role;
 	}
 
@@ -915,6 +1133,9 @@ int AdjustSignalValues(AudioSignal *Signal, parameters *config)
 	{
 		if(!config->allowStereoVsMono)
 		{
+#ifdef OPENMP_ENABLE
+			#pragma omp atomic
+#endif
 			config->stereoNotFound |= Signal->role;
 			logmsg(" - ERROR: Profile requests Stereo and file is Mono\n");
 			return 0;
@@ -926,7 +1147,7 @@ int AdjustSignalValues(AudioSignal *Signal, parameters *config)
 
 int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos, long int signalStartOffset, parameters *config)
 {
-	double		*sampleBuffer = NULL;
+	SampleValue	*sampleBuffer = NULL;
 	double		signalLengthSeconds = 0;
 	long int	signalLengthFrames = 0, signalLengthSamples = 0;
 
@@ -955,14 +1176,14 @@ int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos,
 				SamplesForDisplay(signalLengthSamples, Signal->AudioChannels));
 	}
 
-	sampleBuffer = (double*)malloc(sizeof(double)*signalLengthSamples);
+	sampleBuffer = (SampleValue*)malloc(sizeof(SampleValue)*signalLengthSamples);
 	if(!sampleBuffer)
 	{
 		logmsg("\tERROR: Out of memory [signalLengthSamples]\n");
 		return 0;
 	}
 
-	memset(sampleBuffer, 0, sizeof(double)*signalLengthSamples);
+	memset(sampleBuffer, 0, sizeof(SampleValue)*signalLengthSamples);
 
 	/*
 	if(config->verbose)
@@ -980,9 +1201,9 @@ int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos,
 	}
 	*/
 
-	memcpy(sampleBuffer, Signal->Samples + pos + signalStartOffset, signalLengthSamples*sizeof(double));
-	memset(Signal->Samples + pos + signalStartOffset, 0, signalLengthSamples*sizeof(double));
-	memcpy(Signal->Samples + pos, sampleBuffer, signalLengthSamples*sizeof(double));
+	memcpy(sampleBuffer, Signal->Samples + pos + signalStartOffset, signalLengthSamples*sizeof(SampleValue));
+	memset(Signal->Samples + pos + signalStartOffset, 0, signalLengthSamples*sizeof(SampleValue));
+	memcpy(Signal->Samples + pos, sampleBuffer, signalLengthSamples*sizeof(SampleValue));
 
 	free(sampleBuffer);
 	return 1;
@@ -990,7 +1211,7 @@ int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos,
 
 int MoveSampleBlockExternal(AudioSignal *Signal, long int element, long int pos, long int signalStartOffset, parameters *config)
 {
-	double		*sampleBuffer = NULL;
+	SampleValue	*sampleBuffer = NULL;
 	double		signalLengthSeconds = 0;
 	long int	signalLengthFrames = 0, signalLengthSamples = 0;
 
@@ -1018,13 +1239,13 @@ int MoveSampleBlockExternal(AudioSignal *Signal, long int element, long int pos,
 				SamplesForDisplay(signalLengthSamples, Signal->AudioChannels));
 	}
 
-	sampleBuffer = (double*)malloc(sizeof(double)*signalLengthSamples);
+	sampleBuffer = (SampleValue*)malloc(sizeof(SampleValue)*signalLengthSamples);
 	if(!sampleBuffer)
 	{
 		logmsg("\tERROR: Out of memory while performing internal Sync adjustments. [signalLengthSamples]\n");
 		return 0;
 	}
-	memset(sampleBuffer, 0, sizeof(double)*signalLengthSamples);
+	memset(sampleBuffer, 0, sizeof(SampleValue)*signalLengthSamples);
 
 	/*
 	if(config->verbose)
@@ -1042,9 +1263,9 @@ int MoveSampleBlockExternal(AudioSignal *Signal, long int element, long int pos,
 	}
 	*/
 
-	memcpy(sampleBuffer, Signal->Samples + pos + signalStartOffset, signalLengthSamples*sizeof(double));
-	memset(Signal->Samples + pos, 0, (Signal->numSamples-pos)*sizeof(double));
-	memcpy(Signal->Samples + pos, sampleBuffer, signalLengthSamples*sizeof(double));
+	memcpy(sampleBuffer, Signal->Samples + pos + signalStartOffset, signalLengthSamples*sizeof(SampleValue));
+	memset(Signal->Samples + pos, 0, (Signal->numSamples-pos)*sizeof(SampleValue));
+	memcpy(Signal->Samples + pos, sampleBuffer, signalLengthSamples*sizeof(SampleValue));
 
 	free(sampleBuffer);
 	return 1;
@@ -1075,15 +1296,22 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 	syncLengthSamples = SecondsToSamples(Signal->SampleRate, syncLenSeconds, Signal->AudioChannels, NULL, NULL);
 
 	// we send , syncLengthSamples/2 since it is half silence half pulse
-	internalSyncOffset = DetectSignalStart(Signal->Samples, Signal->header, pos, syncToneFreq, syncLengthSamples/2, &endPulseSamples, &toleranceIssue, config);
-	if(internalSyncOffset == -1)
+	if(!GetCachedInternalSync(Signal, pos, &internalSyncOffset, &endPulseSamples, &toleranceIssue))
 	{
-		logmsg("\tERROR: No signal found while in internal sync detection.\n");
-		return 0;  // Was warning with -1
+		internalSyncOffset = DetectSignalStart(Signal->Samples, Signal->header, pos, syncToneFreq, syncLengthSamples/2, &endPulseSamples, &toleranceIssue, config);
+		if(internalSyncOffset == -1)
+		{
+			logmsg("\tERROR: No signal found while in internal sync detection.\n");
+			return 0;  // Was warning with -1
+		}
+		StoreInternalSync(Signal, pos, internalSyncOffset, endPulseSamples, toleranceIssue);
 	}
 	*syncinternal = 1;
 
 	if(toleranceIssue)
+#ifdef OPENMP_ENABLE
+		#pragma omp atomic
+#endif
 		config->internalSyncTolerance |= Signal->role;
 	
 	pulseLengthSamples = endPulseSamples - internalSyncOffset;
@@ -1259,7 +1487,7 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 	return 1;
 }
 
-int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, double *samples, size_t size, int slotForSamples, double *window, int AudioChannels, parameters *config)
+int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, SampleValue *samples, size_t size, int slotForSamples, double *window, int AudioChannels, parameters *config)
 {
 	char			channel = 0;
 	long			stereoSignalSize = 0;	
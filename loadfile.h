@@ -28,8 +28,13 @@
 #ifndef MDFLOADFILE_H
 #define MDFLOADFILE_H
 
+// Bytes converted per step, a multiple of every sample size
+#define WAV_CONVERT_BLOCK	(24*256*1024)
+
 int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config);
-int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config);
+int LoadWAVFile(FILE *file, AudioSignal *Signal, int streaming, parameters *config);
+int LoadWAVSamples(FILE *file, AudioSignal *Signal, long int byteOffset);
+int ConvertWAVBlock(const uint8_t *bytes, SampleValue *samples, long int count, int AudioFormat, int bytesPerSample);
 int DetectSync(AudioSignal *Signal, parameters *config);
 int AdjustSignalValues(AudioSignal *Signal, parameters *config);
 
@@ -37,6 +42,6 @@ int AdjustSignalValues(AudioSignal *Signal, parameters *config);
 int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos, long int signalStartOffset, parameters *config);
 int MoveSampleBlockExternal(AudioSignal *Signal, long int element, long int pos, long int signalStartOffset, parameters *config);
 int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int *syncinternal, long int *advanceBytes, int knownLength, parameters *config);
-int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, double *samples, size_t size, int slotForSamples, double *window, int AudioChannels, parameters *config);
+int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, SampleValue *samples, size_t size, int slotForSamples, double *window, int AudioChannels, parameters *config);
 
 #endif
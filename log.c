@@ -37,6 +37,12 @@ int do_log = 0;
 char log_file[T_BUFFER_SIZE];
 FILE *logfile = NULL;
 
+// Output from this thread is held here while set, see SetLogBuffer
+LogBuffer *threadLog = NULL;
+#ifdef OPENMP_ENABLE
+	#pragma omp threadprivate(threadLog)
+#endif
+
 void EnableLog(void) { do_log = CONSOLE_ENABLED; }
 void DisableLog(void) { do_log = 0; }
 int IsLogEnabled(void) { return do_log; }
@@ -47,10 +53,117 @@ void initLog(void)
 	logfile = NULL;
 }
 
+int AppendToLogBuffer(char **text, size_t *len, size_t *size, char *fmt, va_list arguments)
+{
+	int		needed = 0;
+	va_list	arguments_c;
+
+	va_copy(arguments_c, arguments);
+	needed = vsnprintf(NULL, 0, fmt, arguments_c);
+	va_end(arguments_c);
+	if(needed <= 0)
+		return 0;
+
+	if(*len + needed + 1 > *size)
+	{
+		char	*tmp = NULL;
+		size_t	newSize = 0;
+
+		newSize = *size ? *size : BUFFER_SIZE;
+		while(*len + needed + 1 > newSize)
+			newSize *= 2;
+		tmp = (char*)realloc(*text, newSize);
+		if(!tmp)
+			return 0;
+		*text = tmp;
+		*size = newSize;
+	}
+	vsnprintf(*text + *len, needed + 1, fmt, arguments);
+	*len += needed;
+	return 1;
+}
+
+/*
+	Used when the Reference and Comparison signals are processed at the
+	same time, output from the second one is held and written after the
+	first one is done, so the log reads as if they were sequential.
+*/
+void SetLogBuffer(LogBuffer *buffer)
+{
+	threadLog = buffer;
+}
+
+LogBuffer *GetLogBuffer(void)
+{
+	return threadLog;
+}
+
+static int AppendTextToLogBuffer(char **text, size_t *len, size_t *size, char *fmt, ...)
+{
+	int		ret = 0;
+	va_list	arguments;
+
+	va_start(arguments, fmt);
+	ret = AppendToLogBuffer(text, len, size, fmt, arguments);
+	va_end(arguments);
+	return ret;
+}
+
+void FlushLogBuffer(LogBuffer *buffer)
+{
+	if(!buffer)
+		return;
+
+	// Nested buffers are passed on to the one this thread is holding
+	if(threadLog && threadLog != buffer)
+	{
+		if(buffer->console)
+			AppendTextToLogBuffer(&threadLog->console, &threadLog->consoleLen, &threadLog->consoleSize, "%s", buffer->console);
+		if(buffer->file)
+			AppendTextToLogBuffer(&threadLog->file, &threadLog->fileLen, &threadLog->fileSize, "%s", buffer->file);
+		ReleaseLogBuffer(buffer);
+		return;
+	}
+
+	if(buffer->console)
+	{
+		fwrite(buffer->console, 1, buffer->consoleLen, stdout);
+		fflush(stdout);
+	}
+	if(buffer->file && do_log && logfile)
+		fwrite(buffer->file, 1, buffer->fileLen, logfile);
+	ReleaseLogBuffer(buffer);
+}
+
+void ReleaseLogBuffer(LogBuffer *buffer)
+{
+	if(!buffer)
+		return;
+
+	free(buffer->console);
+	free(buffer->file);
+	memset(buffer, 0, sizeof(LogBuffer));
+}
+
 void logmsg(char *fmt, ... )
 {
 	va_list arguments;
 
+	if(threadLog)
+	{
+		va_start(arguments, fmt);
+		AppendToLogBuffer(&threadLog->console, &threadLog->consoleLen, &threadLog->consoleSize, fmt, arguments);
+		va_end(arguments);
+
+		if(do_log && logfile)
+		{
+			va_start(arguments, fmt);
+			AppendToLogBuffer(&threadLog->file, &threadLog->fileLen, &threadLog->fileSize, fmt, arguments);
+			va_end(arguments);
+		}
+		return;
+	}
+
 	va_start(arguments, fmt);
 	vprintf(fmt, arguments);
 	fflush(stdout);  // output to Front end ASAP
@@ -76,6 +189,12 @@ void logmsgFileOnly(char *fmt, ... )
 		va_list arguments;
 
 		va_start(arguments, fmt);
+		if(threadLog)
+		{
+			AppendToLogBuffer(&threadLog->file, &threadLog->fileLen, &threadLog->fileSize, fmt, arguments);
+			va_end(arguments);
+			return;
+		}
 		vfprintf(logfile, fmt, arguments);
 		va_end(arguments);
 #ifdef DEBUG
@@ -156,7 +275,7 @@ void ConvertPCMSampleToByteArray(double sample, char *bytes, int size)
 	return;
 }
 
-int SaveWAVEChunk(char *filename, AudioSignal *Signal, double *buffer, long int block, long int loadedBlockSize, int diff, parameters *config)
+int SaveWAVEChunk(char *filename, AudioSignal *Signal, SampleValue *buffer, long int block, long int loadedBlockSize, int diff, parameters *config)
 {
 	FILE 		*chunk = NULL;
 	wav_hdr		cheader;
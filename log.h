@@ -36,13 +36,27 @@ void EnableLog(void);
 void DisableLog(void);
 int IsLogEnabled(void);
 
+typedef struct log_buffer_st {
+	char	*console;
+	size_t	consoleLen;
+	size_t	consoleSize;
+	char	*file;
+	size_t	fileLen;
+	size_t	fileSize;
+} LogBuffer;
+
 void logmsg(char *fmt, ... );
 void logmsgFileOnly(char *fmt, ... );
 
+void SetLogBuffer(LogBuffer *buffer);
+LogBuffer *GetLogBuffer(void);
+void FlushLogBuffer(LogBuffer *buffer);
+void ReleaseLogBuffer(LogBuffer *buffer);
+
 int setLogName(char *name);
 void endLog(void);
 
 void ConvertSampleToByteArray(double sample, char *bytes, int size);
-int SaveWAVEChunk(char *filename, AudioSignal *Signal, double *buffer, long int block, long int loadedBlockSize, int diff, parameters *config);
+int SaveWAVEChunk(char *filename, AudioSignal *Signal, SampleValue *buffer, long int block, long int loadedBlockSize, int diff, parameters *config);
 
 #endif
@@ -37,13 +37,49 @@
 #include "balance.h"
 #include "loadfile.h"
 #include "profile.h"
+#include "fftplan.h"
+#include "pool.h"
+#include "stream.h"
+#include "synccache.h"
+#include "float.h"
+#ifdef OPENMP_ENABLE
+	#include <omp.h>
+#endif
+
+typedef struct hertz_index_st {
+	double	hertz;
+	int		index;
+} HertzIndex;
+
+#define HERTZ_INDEX_BEFORE(x, y) ((x).hertz < (y).hertz || ((x).hertz == (y).hertz && (x).index < (y).index))
+
+#define SORT_NAME HertzIndex
+#define SORT_TYPE HertzIndex
+#define SORT_CMP(x, y)  (HERTZ_INDEX_BEFORE(x, y) ? -1 : (HERTZ_INDEX_BEFORE(y, x) ? 1 : 0))
+#include "sort.h"  // https://github.com/swenson/sort/
+
+// Hertz index for one block and channel, built the first time it is searched
+typedef struct peak_lookup_st {
+	HertzIndex	*index;
+	int			size;
+	int			built;
+} PeakLookup;
 
 int LoadAndProcessAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config);
 int ProcessSignal(AudioSignal *Signal, parameters *config);
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, int AudioChannels, int ZeroPad, parameters *config);
-int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, char channel, int AudioChannels, int ZeroPad, parameters *config);
+int ProcessClockBlock(AudioSignal *Signal, long int pos, long int size, double framerate, parameters *config);
+long int GetStreamBatchEnd(AudioSignal *Signal, long int first, long int count, long int window);
+int LoadStreamedBlocks(AudioSignal *Signal, long int first, long int last, windowUnit **blockWindows, parameters *config);
+int UseConcurrentSignals(parameters *config);
+int LoadAudioFilesConcurrently(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config);
+int ProcessSignalsConcurrently(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
+int ExecuteDFFT(AudioBlocks *AudioArray, SampleValue *samples, size_t size, double samplerate, windowUnit *window, int AudioChannels, int ZeroPad, BufferPool *pool, parameters *config);
+int ExecuteDFFTInternal(AudioBlocks *AudioArray, SampleValue *samples, size_t size, double samplerate, windowUnit *window, char channel, int AudioChannels, int ZeroPad, BufferPool *pool, parameters *config);
+int ExecuteDFFTStereo(AudioBlocks *AudioArray, SampleValue *samples, size_t size, double samplerate, windowUnit *window, int ZeroPad, BufferPool *pool, parameters *config);
+int ExecuteDFFTSingle(AudioBlocks *AudioArray, SampleValue *samples, long int monoSignalSize, long int zeropadding, double seconds, double samplerate, windowUnit *window, char channel, int AudioChannels, BufferPool *pool, parameters *config);
+int ValidateSinglePrecision(long int size, double *signal, fftw_complex *spectrum, BufferPool *pool, parameters *config);
 int CompareAudioBlocks(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
-int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_t size, size_t diff, double *window, int AudioChannels, int forcecopy, parameters *config);
+int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, SampleValue *samples, size_t size, size_t diff, double *window, int AudioChannels, int forcecopy, parameters *config);
 void CleanUp(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config);
 void NormalizeTimeDomainByFrequencyRatio(AudioSignal *Signal, double normalizationRatio, parameters *config);
 double FindRatio(AudioSignal *Signal, double normalizationRatio, parameters *config);
@@ -69,7 +105,8 @@ double FindLocalMaximumAroundSample(AudioSignal *Signal, MaxSample refMax);
 void NormalizeMagnitudesByRatio(AudioSignal *Signal, double ratio, parameters *config);
 MaxMagn FindMaxMagnitudeBlock(AudioSignal *Signal, parameters *config);
 int FindMultiMaxMagnitudeBlock(AudioSignal *Signal, MaxMagn	*MaxMag, int *size, parameters *config);
-double FindLocalMaximumInBlock(AudioSignal *Signal, MaxMagn refMax, int allowDifference, parameters *config);
+double FindLocalMaximumInBlock(AudioSignal *Signal, PeakLookup *lookups, MaxMagn refMax, int allowDifference, parameters *config);
+void ReleasePeakLookups(PeakLookup *lookups, int count);
 double FindFundamentalMagnitudeAverage(AudioSignal *Signal, parameters *config);
 double FindFundamentalMagnitudeStdDev(AudioSignal *Signal, double AvgFundMag, parameters *config);
 
@@ -128,6 +165,10 @@ int main(int argc, char *argv[])
 	ReleasePCM(ReferenceSignal);
 	ReleasePCM(ComparisonSignal);
 
+	if(config.singlePrecision == SINGLE_PRECISION_VALIDATE)
+		logmsg(" - Single precision FFT validation: max deviation %g dB over %ld transforms\n",
+			config.singlePrecisionMaxDev, config.singlePrecisionBlocks);
+
 	AdjustTimeDomainData(ReferenceSignal, ComparisonSignal, &config);
 
 	logmsg("\n* Comparing frequencies: ");
@@ -408,15 +449,132 @@ int ReportClockResults(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 	return 1;
 }
 
-int LoadAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config)
+/*
+	Reference and Comparison are independent until they are compared, so
+	loading, sync detection and the DFFTs can run on both at the same time.
+	The Comparison output is held and logged after the Reference one.
+*/
+int UseConcurrentSignals(parameters *config)
 {
-	AudioSignal *higher = NULL;
+#ifdef OPENMP_ENABLE
+	// Comparison length is taken from the Reference in this mode
+	if(config->noSyncProfile && config->noSyncProfileType == NO_SYNC_MANUAL)
+		return 0;
+	return omp_get_max_threads() > 1;
+#else
+	(void)config;
+	return 0;
+#endif
+}
+
+int LoadAudioFilesConcurrently(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config)
+{
+	int			loaded[2] = { 0, 0 };
+	LogBuffer	compLog;
+#ifdef OPENMP_ENABLE
+	int			levels = 0, threads = 0;
+
+	// Each signal keeps half the threads for its own sync search
+	levels = omp_get_max_active_levels();
+	threads = omp_get_max_threads();
+	omp_set_max_active_levels(2);
+#endif
+
+	memset(&compLog, 0, sizeof(LogBuffer));
+#ifdef OPENMP_ENABLE
+	#pragma omp parallel for num_threads(2)
+#endif
+	for(int i = 0; i < 2; i++)
+	{
+#ifdef OPENMP_ENABLE
+		omp_set_num_threads(threads > 3 ? threads/2 : 1);
+#endif
+		if(i == 0)
+			loaded[i] = LoadFile(ReferenceSignal, config->referenceFile, ROLE_REF, config);
+		else
+		{
+			SetLogBuffer(&compLog);
+			loaded[i] = LoadFile(ComparisonSignal, config->comparisonFile, ROLE_COMP, config);
+			SetLogBuffer(NULL);
+		}
+	}
+#ifdef OPENMP_ENABLE
+	omp_set_max_active_levels(levels);
+#endif
 
-	if(!LoadFile(ReferenceSignal, config->referenceFile, ROLE_REF, config))
+	// Comparison would not have been loaded
+	if(!loaded[0])
+	{
+		ReleaseLogBuffer(&compLog);
 		return 0;
+	}
+	FlushLogBuffer(&compLog);
+	return loaded[1];
+}
+
+int ProcessSignalsConcurrently(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
+{
+	int			processed[2] = { 0, 0 };
+	LogBuffer	compLog;
+#ifdef OPENMP_ENABLE
+	int			levels = 0, threads = 0;
+
+	// Each signal keeps half the threads for its own block DFFTs
+	levels = omp_get_max_active_levels();
+	threads = omp_get_max_threads();
+	omp_set_max_active_levels(2);
+#endif
 
-	if(!LoadFile(ComparisonSignal, config->comparisonFile, ROLE_COMP, config))
+	memset(&compLog, 0, sizeof(LogBuffer));
+	logmsg("\n* Executing Discrete Fast Fourier Transforms on 'Reference' file\n");
+#ifdef OPENMP_ENABLE
+	#pragma omp parallel for num_threads(2)
+#endif
+	for(int i = 0; i < 2; i++)
+	{
+#ifdef OPENMP_ENABLE
+		omp_set_num_threads(threads > 3 ? threads/2 : 1);
+#endif
+		if(i == 0)
+			processed[i] = ProcessSignal(ReferenceSignal, config);
+		else
+		{
+			SetLogBuffer(&compLog);
+			logmsg("* Executing Discrete Fast Fourier Transforms on 'Comparison' file\n");
+			processed[i] = ProcessSignal(ComparisonSignal, config);
+			SetLogBuffer(NULL);
+		}
+	}
+#ifdef OPENMP_ENABLE
+	omp_set_max_active_levels(levels);
+#endif
+
+	if(!processed[0])
+	{
+		ReleaseLogBuffer(&compLog);
 		return 0;
+	}
+	FlushLogBuffer(&compLog);
+	return processed[1];
+}
+
+int LoadAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config)
+{
+	AudioSignal *higher = NULL;
+
+	if(UseConcurrentSignals(config))
+	{
+		if(!LoadAudioFilesConcurrently(ReferenceSignal, ComparisonSignal, config))
+			return 0;
+	}
+	else
+	{
+		if(!LoadFile(ReferenceSignal, config->referenceFile, ROLE_REF, config))
+			return 0;
+
+		if(!LoadFile(ComparisonSignal, config->comparisonFile, ROLE_COMP, config))
+			return 0;
+	}
 
 	if(GetSignalMaxInt(*ReferenceSignal) >= GetSignalMaxInt(*ComparisonSignal))
 		higher = *ReferenceSignal;
@@ -484,6 +642,7 @@ int FrequencyDomainNormalize(AudioSignal **ReferenceSignal, AudioSignal **Compar
 	double				RefAvg = 0;
 	double				CompAvg = 0;
 	double				ratio = 0, maxRatiodBFS = fabs(FREQDOMRATIO);
+	PeakLookup			*lookups = NULL;
 
 	// Find Normalization factors
 	MaxRef = FindMaxMagnitudeBlock(*ReferenceSignal, config);
@@ -499,7 +658,14 @@ int FrequencyDomainNormalize(AudioSignal **ReferenceSignal, AudioSignal **Compar
 		return 0;
 	}
 
-	ComparisonLocalMaximum = FindLocalMaximumInBlock(*ComparisonSignal, MaxRef, 0, config);
+	lookups = (PeakLookup*)calloc(config->types.totalBlocks*2, sizeof(PeakLookup));
+	if(!lookups)
+	{
+		logmsg("ERROR: Not enough memory for normalization\n");
+		return 0;
+	}
+
+	ComparisonLocalMaximum = FindLocalMaximumInBlock(*ComparisonSignal, lookups, MaxRef, 0, config);
 	if(ComparisonLocalMaximum)
 		ratioRef = ComparisonLocalMaximum/MaxRef.magnitude;
 
@@ -545,7 +711,7 @@ int FrequencyDomainNormalize(AudioSignal **ReferenceSignal, AudioSignal **Compar
 					}
 
 					ratioRefArray = 0;
-					ComparisonLocalMaximumArray = FindLocalMaximumInBlock(*ComparisonSignal, MaxRefArray[pos], allowDifference, config);
+					ComparisonLocalMaximumArray = FindLocalMaximumInBlock(*ComparisonSignal, lookups, MaxRefArray[pos], allowDifference, config);
 					if(ComparisonLocalMaximumArray)
 					{
 						double dbfsratioArray = 0;
@@ -621,6 +787,9 @@ int FrequencyDomainNormalize(AudioSignal **ReferenceSignal, AudioSignal **Compar
 	else
 		config->frequencyNormalizationTries = 0;
 
+	ReleasePeakLookups(lookups, config->types.totalBlocks*2);
+	lookups = NULL;
+
 	if(!ComparisonLocalMaximum || !ratioRef)
 	{
 		logmsg("ERROR: Could not detect Local Maximum in 'Comparison' file for normalization\n");
@@ -889,13 +1058,21 @@ int LoadAndProcessAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **Compar
 
 	SetAmplitudeMatchByDuration(*ReferenceSignal, config);
 
-	logmsg("\n* Executing Discrete Fast Fourier Transforms on 'Reference' file\n");
-	if(!ProcessSignal(*ReferenceSignal, config))
-		return 0;
+	if(UseConcurrentSignals(config))
+	{
+		if(!ProcessSignalsConcurrently(*ReferenceSignal, *ComparisonSignal, config))
+			return 0;
+	}
+	else
+	{
+		logmsg("\n* Executing Discrete Fast Fourier Transforms on 'Reference' file\n");
+		if(!ProcessSignal(*ReferenceSignal, config))
+			return 0;
 
-	logmsg("* Executing Discrete Fast Fourier Transforms on 'Comparison' file\n");
-	if(!ProcessSignal(*ComparisonSignal, config))
-		return 0;
+		logmsg("* Executing Discrete Fast Fourier Transforms on 'Comparison' file\n");
+		if(!ProcessSignal(*ComparisonSignal, config))
+			return 0;
+	}
 
 	CalculateFrequencyBrackets(*ReferenceSignal, config);
 	CalculateFrequencyBrackets(*ComparisonSignal, config);
@@ -1107,7 +1284,7 @@ int CopySamplesForTimeDomainPlotWindowOnly(AudioBlocks *AudioArray, double *wind
 	return(1);
 }
 
-int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_t size, size_t diff, double *window, int AudioChannels, int copywindow, parameters *config)
+int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, SampleValue *samples, size_t size, size_t diff, double *window, int AudioChannels, int copywindow, parameters *config)
 {
 	long			stereoSignalSize = 0;
 	long			i = 0, monoSignalSize = 0, diffSize = 0, difference = 0;
@@ -1305,23 +1482,12 @@ int IsTypeInCLKLArray(int type, parameters *config)
 int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 {
 	long int		i = 0;	
-	double			*sampleBuffer = NULL;
-	long int		sampleBufferSize = 0;
-	double			*windowUsed = NULL, longest = 0;
+	windowUnit		*windowUsed = NULL;
 	windowManager	windows;
 
 	if(!config->doClkAdjust)
 		return 0;
 
-	longest = FramesToSeconds(Signal->framerate, GetLongestElementFrames(config));
-	sampleBufferSize = SecondsToSamples(Signal->SampleRate, longest, Signal->AudioChannels, NULL, NULL);
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
-	{
-		logmsg("\tERROR: malloc failed RecalculateFFTW.\n");
-		return(0);
-	}
-
 	if(!initWindows(&windows, Signal->SampleRate, config->window, config))
 		return 0;
 
@@ -1331,34 +1497,36 @@ int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 			IsTypeInCLKLArray(Signal->Blocks[i].type, config))
 		{
 			long int frames = 0, cutFrames = 0, currSamplesSize = 0;
+			SampleValue	*blockSamples = NULL;
 
 			frames = GetBlockFrames(config, i);
 			cutFrames = GetBlockCutFrames(config, i);
 
-			windowUsed = getWindowByLength(&windows, frames, cutFrames, config->smallerFramerate, config);
+			windowUsed = getWindowUnitByLength(&windows, frames, cutFrames, config->smallerFramerate, config);
 
+			// The block is read in place, ExecuteDFFT only reads currSamplesSize samples
 			currSamplesSize = Signal->Blocks[i].loadSize - Signal->Blocks[i].difference;
-
-			memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-			memcpy(sampleBuffer, Signal->Samples + Signal->Blocks[i].offset, currSamplesSize*sizeof(double));
+			if(!StreamSamples(Signal, Signal->Blocks[i].offset, Signal->Blocks[i].offset + currSamplesSize))
+			{
+				freeWindows(&windows);
+				return 0;
+			}
+			blockSamples = Signal->Samples + Signal->Blocks[i].offset;
 
 			CleanFrequenciesInBlock(&Signal->Blocks[i], config);
-			if(!ExecuteDFFT(&Signal->Blocks[i], sampleBuffer, currSamplesSize, Signal->SampleRate, windowUsed, Signal->AudioChannels, config->ZeroPad, config))
+			if(!ExecuteDFFT(&Signal->Blocks[i], blockSamples, currSamplesSize, Signal->SampleRate, windowUsed, Signal->AudioChannels, config->ZeroPad, &Signal->pool, config))
 			{
-				free(sampleBuffer);
 				freeWindows(&windows);
 				return 0;
 			}
 			if(!FillFrequencyStructures(Signal, &Signal->Blocks[i], config))
 			{
-				free(sampleBuffer);
 				freeWindows(&windows);
 				return 0;
 			}
 
-			if(config->plotAllNotesWindowed && !CopySamplesForTimeDomainPlotWindowOnly(&Signal->Blocks[i], windowUsed, Signal->AudioChannels, config))
+			if(config->plotAllNotesWindowed && !CopySamplesForTimeDomainPlotWindowOnly(&Signal->Blocks[i], windowUsed ? windowUsed->window : NULL, Signal->AudioChannels, config))
 			{
-				free(sampleBuffer);
 				freeWindows(&windows);
 				return 0;
 			}
@@ -1371,18 +1539,16 @@ int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 				// Force a Hamming window for the clock signal
 				if(!initWindows(&clockWindows, Signal->SampleRate, 'm', config))
 				{
-					free(sampleBuffer);
 					freeWindows(&windows);
 					freeWindows(&clockWindows);
 					return 0;
 				}
 
 				// We only use ZeroPadFactor for the CLK, the rest is zero padded to 1hz
-				windowUsed = getWindowByLength(&clockWindows, config->ZeroPadFactor*1000.0/Signal->framerate, 0, Signal->framerate, config);
+				windowUsed = getWindowUnitByLength(&clockWindows, config->ZeroPadFactor*1000.0/Signal->framerate, 0, Signal->framerate, config);
 				CleanFrequenciesInBlock(&Signal->clkFrequencies, config);
-				if(!ExecuteDFFT(&Signal->clkFrequencies, sampleBuffer, currSamplesSize, Signal->SampleRate, windowUsed, Signal->AudioChannels, 1*config->ZeroPadFactor , config)) // zeropad on 
+				if(!ExecuteDFFT(&Signal->clkFrequencies, blockSamples, currSamplesSize, Signal->SampleRate, windowUsed, Signal->AudioChannels, 1*config->ZeroPadFactor, &Signal->pool, config)) // zeropad on 
 				{
-					free(sampleBuffer);
 					freeWindows(&windows);
 					freeWindows(&clockWindows);
 					return 0;
@@ -1390,7 +1556,6 @@ int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 
 				if(!FillFrequencyStructures(Signal, &Signal->clkFrequencies, config))
 				{
-					free(sampleBuffer);
 					freeWindows(&windows);
 					freeWindows(&clockWindows);
 					return 0;
@@ -1408,8 +1573,8 @@ int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 	if(config->drawWindows)
 		VisualizeWindows(&windows, "CLK-RECALC", Signal->role, config);
 
-	free(sampleBuffer);
 	freeWindows(&windows);
+	StreamSamples(Signal, 0, 0);
 
 	if(config->normType != max_frequency)
 		FindMaxMagnitude(Signal, config);
@@ -1559,16 +1724,24 @@ int DuplicateSamplesForWaveformPlots(AudioSignal *Signal, long int element, long
 }
 
 
+/*
+	Blocks are processed in two passes. The first one is sequential and
+	computes offsets, sizes and windows, and applies internal sync, since
+	each block depends on where the previous one ended. The second pass
+	runs the DFFTs and fills the frequency structures, and each block is
+	independent there, so it runs in parallel when OpenMP is enabled.
+*/
 int ProcessSignal(AudioSignal *Signal, parameters *config)
 {
 	long int		pos = 0;
 	double			longest = 0;
-	double			*sampleBuffer = NULL;
 	long int		sampleBufferSize = 0;
 	windowManager	windows;
-	long int		loadedBlockSize = 0, i = 0, syncAdvance = 0;
+	windowUnit		**blockWindows = NULL;
+	LogBuffer		*blockLogs = NULL;
+	long int		loadedBlockSize = 0, i = 0, syncAdvance = 0, window = 0;
 	struct timespec	start, end;
-	int				discardSamples = 0, syncinternal = 0;
+	int				discardSamples = 0, syncinternal = 0, failed = 0;
 	double			leftDecimals = 0;
 #ifdef DEBUG
 	long int		totalDiscarded = 0, totalProcessed = 0, totalDifference = 0;
@@ -1585,16 +1758,17 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 	}
 
 	sampleBufferSize = SecondsToSamples(Signal->SampleRate, longest, Signal->AudioChannels, NULL, NULL);
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
+	blockWindows = (windowUnit**)malloc(sizeof(windowUnit*)*config->types.totalBlocks);
+	if(!blockWindows)
 	{
 		logmsg("\tERROR: malloc failed.\n");
 		return(0);
 	}
+	memset(blockWindows, 0, sizeof(windowUnit*)*config->types.totalBlocks);
 
 	if(!initWindows(&windows, Signal->SampleRate, config->window, config))
 	{
-		free(sampleBuffer);
+		free(blockWindows);
 		logmsg("\tERROR: Could not create FFTW windows.\n");
 		return 0;
 	}
@@ -1605,7 +1779,7 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 	while(i < config->types.totalBlocks)
 	{
 		int			endProcess = 0;
-		double		*windowUsed = NULL;
+		windowUnit	*windowUsed = NULL;
 		double		duration = 0, framerate = 0;
 		long int	frames = 0, difference = 0, cutFrames = 0;
 
@@ -1639,9 +1813,9 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		if(Signal->Blocks[i].type >= TYPE_SILENCE || Signal->Blocks[i].type == TYPE_WATERMARK)
 		{
 			if(!syncinternal && Signal->Blocks[i].maskType == MASK_USE_WINDOW)
-				windowUsed = getWindowByLength(&windows, frames, cutFrames, config->smallerFramerate, config); // We get the smaller window, since we'll truncate
+				windowUsed = getWindowUnitByLength(&windows, frames, cutFrames, config->smallerFramerate, config); // We get the smaller window, since we'll truncate
 			else
-				windowUsed = getWindowByLength(&windows, frames, cutFrames, framerate, config);
+				windowUsed = getWindowUnitByLength(&windows, frames, cutFrames, framerate, config);
 		}
 
 		if(pos + loadedBlockSize > Signal->numSamples)
@@ -1650,9 +1824,19 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 			endProcess = 1;
 		}
 
-		if(!DuplicateSamplesForWaveformPlots(Signal, i, pos, loadedBlockSize, difference, framerate, windowUsed, config, syncAdvance))
+		// Streamed blocks are copied when their batch is loaded, this one will not be in any
+		if(Signal->stream.active && endProcess &&
+			!StreamSamples(Signal, pos - SecondsToSamples(Signal->SampleRate, FramesToSeconds(framerate, 1), Signal->AudioChannels, NULL, NULL), pos + loadedBlockSize))
+		{
+			free(blockWindows);
+			freeWindows(&windows);
+			return 0;
+		}
+
+		if((!Signal->stream.active || endProcess) &&
+			!DuplicateSamplesForWaveformPlots(Signal, i, pos, loadedBlockSize, difference, framerate, windowUsed ? windowUsed->window : NULL, config, syncAdvance))
 		{
-			free(sampleBuffer);
+			free(blockWindows);
 			freeWindows(&windows);
 			return 0;
 		}
@@ -1665,6 +1849,9 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 #endif
 			if(i != config->types.totalBlocks - 1)
 			{
+#ifdef OPENMP_ENABLE
+				#pragma omp atomic
+#endif
 				config->smallFile |= Signal->role;
 				logmsg("\tUnexpected end of File, please record the full Audio Test from the 240p Test Suite.\n");
 				if(config->verbose)
@@ -1686,66 +1873,19 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 				GetTypeName(config, Signal->Blocks[i].type), i);
 #endif
 		
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Signal->Samples + pos, (loadedBlockSize-difference)*sizeof(double));
-
 		Signal->Blocks[i].offset = pos;
 		Signal->Blocks[i].loadSize = loadedBlockSize;
 		Signal->Blocks[i].difference = difference;
-		if(Signal->Blocks[i].type >= TYPE_SILENCE || Signal->Blocks[i].type == TYPE_WATERMARK)
-		{
-			if(!ExecuteDFFT(&Signal->Blocks[i], sampleBuffer, loadedBlockSize-difference, Signal->SampleRate, windowUsed, Signal->AudioChannels, config->ZeroPad, config))
-			{
-				free(sampleBuffer);
-				freeWindows(&windows);
-				return 0;
-			}
-#ifdef DEBUG
-			if(config->verbose >= 3)
-				logmsg("estimated %g (difference %ld)\n", Signal->Blocks[i].frames*Signal->framerate/1000.0, difference);
-#endif
-			if(!FillFrequencyStructures(Signal, &Signal->Blocks[i], config))
-			{
-				free(sampleBuffer);
-				freeWindows(&windows);
-				return 0;
-			}
-		}
+		blockWindows[i] = windowUsed;
 
-		if(config->clkMeasure && config->clkBlock == i)
+		if(config->clkMeasure && config->clkBlock == i && !Signal->stream.active)
 		{
-			windowManager clockWindows;
-
-			// Force a Hamming window for the clock signal
-			if(!initWindows(&clockWindows, Signal->SampleRate, 'm', config))
-			{
-				free(sampleBuffer);
-				freeWindows(&windows);
-				freeWindows(&clockWindows);
-				return 0;
-			}
-
-			// We only use ZeroPadFactor for the CLK, the rest is zero padded to 1hz
-			windowUsed = getWindowByLength(&clockWindows, config->ZeroPadFactor*1000.0/framerate, 0, framerate, config);
-			if(!ExecuteDFFT(&Signal->clkFrequencies, sampleBuffer, loadedBlockSize-difference, Signal->SampleRate, windowUsed, Signal->AudioChannels, 1*config->ZeroPadFactor /* force ZeroPad */, config))
-			{
-				free(sampleBuffer);
-				freeWindows(&windows);
-				freeWindows(&clockWindows);
-				return 0;
-			}
-
-			if(!FillFrequencyStructures(Signal, &Signal->clkFrequencies, config))
+			if(!ProcessClockBlock(Signal, pos, loadedBlockSize-difference, framerate, config))
 			{
-				free(sampleBuffer);
+				free(blockWindows);
 				freeWindows(&windows);
-				freeWindows(&clockWindows);
 				return 0;
 			}
-			if(config->drawWindows)
-				VisualizeWindows(&clockWindows, "CLK", Signal->role, config);
-
-			freeWindows(&clockWindows);
 		}
 
 		pos += loadedBlockSize;
@@ -1763,7 +1903,7 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		{
 			if(!ProcessInternalSync(Signal, i, pos, &syncinternal, &syncAdvance, TYPE_INTERNAL_KNOWN, config))
 			{
-				free(sampleBuffer);
+				free(blockWindows);
 				freeWindows(&windows);
 				return 0;
 			}
@@ -1773,7 +1913,7 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		{
 			if(!ProcessInternalSync(Signal, i, pos, &syncinternal, &syncAdvance, TYPE_INTERNAL_UNKNOWN, config))
 			{
-				free(sampleBuffer);
+				free(blockWindows);
 				freeWindows(&windows);
 				return 0;
 			}
@@ -1802,6 +1942,95 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		logmsg("Total Time at Estimated SR: %.10g @ %g\n", totalTimeEst, Signal->EstimatedSR);
 #endif
 
+	FlushInternalSync(Signal, config);
+
+	// Workers don't inherit this thread's log buffer, each block holds its output until the batch is done
+	blockLogs = (LogBuffer*)calloc(i ? i : 1, sizeof(LogBuffer));
+	if(!blockLogs)
+	{
+		logmsg("\tERROR: malloc failed.\n");
+		free(blockWindows);
+		freeWindows(&windows);
+		return 0;
+	}
+
+	// Internal sync only moves samples after each sync block, so
+	// every block has its final samples and window at this point.
+	// Streamed signals go in batches that fit the window, all at once otherwise
+	window = GetStreamWindowSamples(Signal, sampleBufferSize);
+	for(long int first = 0, last = 0; first < i && !failed; first = last)
+	{
+		last = GetStreamBatchEnd(Signal, first, i, window);
+		if(Signal->stream.active && !LoadStreamedBlocks(Signal, first, last, blockWindows, config))
+		{
+			failed = 1;
+			break;
+		}
+
+#ifdef OPENMP_ENABLE
+		#pragma omp parallel for schedule(dynamic)
+#endif
+		for(long int b = first; b < last; b++)
+		{
+			LogBuffer	*previousLog = NULL;
+			int			stop = 0;
+
+			// Other workers set it when their block fails
+#ifdef OPENMP_ENABLE
+			#pragma omp atomic read
+#endif
+			stop = failed;
+			if(stop)
+				continue;
+
+			if(Signal->Blocks[b].type >= TYPE_SILENCE || Signal->Blocks[b].type == TYPE_WATERMARK)
+			{
+				previousLog = GetLogBuffer();
+				SetLogBuffer(&blockLogs[b]);
+				if(!ExecuteDFFT(&Signal->Blocks[b], Signal->Samples + Signal->Blocks[b].offset,
+						Signal->Blocks[b].loadSize - Signal->Blocks[b].difference, Signal->SampleRate,
+						blockWindows[b], Signal->AudioChannels, config->ZeroPad, &Signal->pool, config))
+				{
+#ifdef OPENMP_ENABLE
+					#pragma omp atomic write
+#endif
+					failed = 1;
+				}
+				else
+				{
+#ifdef DEBUG
+					if(config->verbose >= 3)
+						logmsg("estimated %g (difference %ld)\n", Signal->Blocks[b].frames*Signal->framerate/1000.0, Signal->Blocks[b].difference);
+#endif
+					if(!FillFrequencyStructures(Signal, &Signal->Blocks[b], config))
+					{
+#ifdef OPENMP_ENABLE
+						#pragma omp atomic write
+#endif
+						failed = 1;
+					}
+				}
+				SetLogBuffer(previousLog);
+			}
+		}
+
+		// In block order, through the buffer this thread holds if any
+		for(long int b = first; b < last; b++)
+			FlushLogBuffer(&blockLogs[b]);
+	}
+	StreamSamples(Signal, 0, 0);
+
+	free(blockLogs);
+	blockLogs = NULL;
+	free(blockWindows);
+	blockWindows = NULL;
+
+	if(failed)
+	{
+		freeWindows(&windows);
+		return 0;
+	}
+
 	if(config->normType != max_frequency)
 		FindMaxMagnitude(Signal, config);
 
@@ -1811,6 +2040,8 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		clock_gettime(CLOCK_MONOTONIC, &end);
 		elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
 		logmsg(" - clk: Processing took %0.2fs\n", elapsedSeconds);
+		PrintPoolStats(&Signal->pool, Signal->role == ROLE_REF ? "Reference" : "Comparison");
+		PrintStreamStats(Signal);
 	}
 
 	if(config->drawWindows)
@@ -1819,13 +2050,85 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		PlotBetaFunctions(config);
 	}
 
-	free(sampleBuffer);
 	freeWindows(&windows);
 
 	return i;
 }
 
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, int AudioChannels, int ZeroPad, parameters *config)
+int ProcessClockBlock(AudioSignal *Signal, long int pos, long int size, double framerate, parameters *config)
+{
+	windowManager	clockWindows;
+	windowUnit		*windowUsed = NULL;
+
+	// Force a Hamming window for the clock signal
+	if(!initWindows(&clockWindows, Signal->SampleRate, 'm', config))
+	{
+		freeWindows(&clockWindows);
+		return 0;
+	}
+
+	// We only use ZeroPadFactor for the CLK, the rest is zero padded to 1hz
+	windowUsed = getWindowUnitByLength(&clockWindows, config->ZeroPadFactor*1000.0/framerate, 0, framerate, config);
+	if(!ExecuteDFFT(&Signal->clkFrequencies, Signal->Samples + pos, size, Signal->SampleRate, windowUsed, Signal->AudioChannels, 1*config->ZeroPadFactor /* force ZeroPad */, &Signal->pool, config))
+	{
+		freeWindows(&clockWindows);
+		return 0;
+	}
+
+	if(!FillFrequencyStructures(Signal, &Signal->clkFrequencies, config))
+	{
+		freeWindows(&clockWindows);
+		return 0;
+	}
+	if(config->drawWindows)
+		VisualizeWindows(&clockWindows, "CLK", Signal->role, config);
+
+	freeWindows(&clockWindows);
+	return 1;
+}
+
+// Blocks from first that fit in the stream window, always at least one
+long int GetStreamBatchEnd(AudioSignal *Signal, long int first, long int count, long int window)
+{
+	long int	last = first + 1;
+
+	if(!Signal->stream.active)
+		return count;
+
+	while(last < count && Signal->Blocks[last].offset + Signal->Blocks[last].loadSize - Signal->Blocks[first].offset <= window)
+		last++;
+	return last;
+}
+
+/*
+	Loads the samples for a batch of blocks and does what the first pass
+	in ProcessSignal skips for streamed signals: waveform copies and the
+	clock DFFT. Streamed signals have no internal sync, so the framerate
+	is the signal one and there is no sync advance.
+*/
+int LoadStreamedBlocks(AudioSignal *Signal, long int first, long int last, windowUnit **blockWindows, parameters *config)
+{
+	long int	oneFrameSamples = 0;
+
+	oneFrameSamples = SecondsToSamples(Signal->SampleRate, FramesToSeconds(Signal->framerate, 1), Signal->AudioChannels, NULL, NULL);
+	if(!StreamSamples(Signal, Signal->Blocks[first].offset - oneFrameSamples,
+			Signal->Blocks[last-1].offset + Signal->Blocks[last-1].loadSize))
+		return 0;
+
+	for(long int b = first; b < last; b++)
+	{
+		if(!DuplicateSamplesForWaveformPlots(Signal, b, Signal->Blocks[b].offset, Signal->Blocks[b].loadSize,
+				Signal->Blocks[b].difference, Signal->framerate, blockWindows[b] ? blockWindows[b]->window : NULL, config, 0))
+			return 0;
+
+		if(config->clkMeasure && config->clkBlock == b &&
+			!ProcessClockBlock(Signal, Signal->Blocks[b].offset, Signal->Blocks[b].loadSize - Signal->Blocks[b].difference, Signal->framerate, config))
+			return 0;
+	}
+	return 1;
+}
+
+int ExecuteDFFT(AudioBlocks *AudioArray, SampleValue *samples, size_t size, double samplerate, windowUnit *window, int AudioChannels, int ZeroPad, BufferPool *pool, parameters *config)
 {
 	char channel = CHANNEL_STEREO;
 
@@ -1839,23 +2142,28 @@ int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, size_t size, double sa
 
 		if(AudioArray->channel == CHANNEL_STEREO)
 		{
+			if(!config->singlePrecision)
+				return(ExecuteDFFTStereo(AudioArray, samples, size, samplerate, window, ZeroPad, pool, config));
+
 			channel = CHANNEL_RIGHT;
-			if(!ExecuteDFFTInternal(AudioArray, samples, size, samplerate, window, channel, AudioChannels, ZeroPad, config))
+			if(!ExecuteDFFTInternal(AudioArray, samples, size, samplerate, window, channel, AudioChannels, ZeroPad, pool, config))
 				return 0;
 			channel = CHANNEL_LEFT;
 		}
 	}
-	return(ExecuteDFFTInternal(AudioArray, samples, size, samplerate, window, channel, AudioChannels, ZeroPad, config));
+	return(ExecuteDFFTInternal(AudioArray, samples, size, samplerate, window, channel, AudioChannels, ZeroPad, pool, config));
 }
 
-// we use this for normalization now that we zeropad
-// https://holometer.fnal.gov/GH_FFT.pdf
-int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, char channel, int AudioChannels, int ZeroPad, parameters *config)
+/*
+	Both channels of a stereo block are deinterleaved in one pass and
+	transformed together as a batch. Same values as ExecuteDFFTInternal
+	called for each channel, the right spectrum shares the left buffer.
+*/
+int ExecuteDFFTStereo(AudioBlocks *AudioArray, SampleValue *samples, size_t size, double samplerate, windowUnit *window, int ZeroPad, BufferPool *pool, parameters *config)
 {
-	fftw_plan		p = NULL;
-	long			stereoSignalSize = 0;
-	long			i = 0, monoSignalSize = 0, zeropadding = 0;
-	double			*signal = NULL;
+	long			i = 0, monoSignalSize = 0, zeropadding = 0, dist = 0;
+	size_t			signalBytes = 0, spectrumBytes = 0;
+	double			*signal = NULL, *signalRight = NULL;
 	fftw_complex	*spectrum = NULL;
 	double			seconds = 0, S2 = 0;
 
@@ -1865,9 +2173,8 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, d
 		return 0;
 	}
 
-	stereoSignalSize = (long)size;
-	monoSignalSize = stereoSignalSize/AudioChannels;
-	seconds = (double)size/(samplerate*(double)AudioChannels);
+	monoSignalSize = (long)size/2;
+	seconds = (double)size/(samplerate*2.0);
 
 	if(config->padBlockSizes)
 		zeropadding = GetBlockZeroPadValues(&monoSignalSize, &seconds, config->maxBlockSeconds, samplerate);
@@ -1875,85 +2182,162 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, d
 	if(ZeroPad)  /* disabled by default */
 		zeropadding = GetZeroPadValues(&monoSignalSize, &seconds, samplerate, ZeroPad);
 
-#ifdef DEBUG
-	if(config->verbose >= 2)
-		logmsg("ExecuteDFFTInternal> stereoSignalSize: %ld monoSignalSize: %ld zeropadding: %ld windowed: %ld seconds: %g\n", 
-			stereoSignalSize, monoSignalSize, zeropadding, monoSignalSize - zeropadding, seconds);
-#endif
-
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+	dist = BATCH_REAL_DIST(monoSignalSize);
+	signalBytes = sizeof(double)*(2*dist+1);
+	spectrumBytes = sizeof(fftw_complex)*2*(monoSignalSize/2+1);
+	signal = (double*)PoolAlloc(pool, signalBytes);
 	if(!signal)
 	{
 		logmsg("Not enough memory\n");
 		return(0);
 	}
-	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
+	spectrum = (fftw_complex*)PoolAlloc(pool, spectrumBytes);
 	if(!spectrum)
 	{
-		free(signal);
+		PoolFree(pool, signal, signalBytes);
 		logmsg("Not enough memory\n");
 		return(0);
 	}
+	signalRight = signal + dist;
 
-	if(!config->model_plan)
+	for(i = 0; i < monoSignalSize - zeropadding; i++)
 	{
-		config->model_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->model_plan)
+		signal[i] = samples[i*2];
+		signalRight[i] = samples[i*2+1];
+	}
+	if(window)
+	{
+		double *w = window->window;
+
+		for(long int j = 0; j < i; j++)
 		{
-			logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			return 0;
+			signal[j] *= w[j];
+			signalRight[j] *= w[j];
 		}
+		S2 = GetWindowEnergy(window, i);
 	}
+	memset(signal+i, 0, sizeof(double)*(dist-i));
+	memset(signalRight+i, 0, sizeof(double)*(dist-i+1));
 
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-	if(!p)
+	if(!ExecuteRealToComplexBatch(monoSignalSize, 2, signal, spectrum, config))
 	{
-		logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-		free(signal);
-		signal = NULL;
+		PoolFree(pool, signal, signalBytes);
+		PoolFree(pool, spectrum, spectrumBytes);
 		return 0;
 	}
 
-	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
-	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
+	AudioArray->fftwValues.spectrum = spectrum;
+	AudioArray->fftwValues.size = monoSignalSize;
+	AudioArray->fftwValues.ENBW = samplerate*S2;
 
-#ifdef DEBUG
-	if(config->verbose >= 3)
-		logmsg("monoSignalSize: %ld zeropadding: %ld monoSignalSize - zeropadding: %ld\n",
-			monoSignalSize, zeropadding, monoSignalSize - zeropadding);
-#endif
+	AudioArray->fftwValuesRight.spectrum = spectrum + monoSignalSize/2+1;
+	AudioArray->fftwValuesRight.size = monoSignalSize;
+	AudioArray->fftwValuesRight.ENBW = samplerate*S2;
+	AudioArray->fftwValuesRight.shared = 1;
 
-	for(i = 0; i < monoSignalSize - zeropadding; i++)
-	{
-		if(channel == CHANNEL_LEFT)
-			signal[i] = samples[i*AudioChannels];
-		if(channel == CHANNEL_RIGHT)
-			signal[i] = samples[i*AudioChannels+1];
-		if(channel == CHANNEL_STEREO)
-			signal[i] = (samples[i*AudioChannels]+samples[i*AudioChannels+1])/2.0;
+	AudioArray->seconds = seconds;
+	PoolFree(pool, signal, signalBytes);
 
-		if(window)
-		{
-			signal[i] *= window[i];
-			S2 += window[i]*window[i];
-			if(isinf(S2)) {
-				logmsg("i: %ld S2: %g window[i]: %g\n", i, S2, window[i]);
-				logmsg("monoSignalSize: %ld zeropadding: %ld monoSignalSize - zeropadding: %ld\n",
-					monoSignalSize, zeropadding, monoSignalSize - zeropadding);
-				logmsg("ERROR: Window error in code detected\n");
-				return 0;
-			}
-		}
-	}
+	return(1);
+}
 
-	fftw_execute(p);
-	fftw_destroy_plan(p);
-	p = NULL;
+// we use this for normalization now that we zeropad
+// https://holometer.fnal.gov/GH_FFT.pdf
+int ExecuteDFFTInternal(AudioBlocks *AudioArray, SampleValue *samples, size_t size, double samplerate, windowUnit *window, char channel, int AudioChannels, int ZeroPad, BufferPool *pool, parameters *config)
+{
+	long			stereoSignalSize = 0;
+	long			i = 0, monoSignalSize = 0, zeropadding = 0;
+	double			*signal = NULL;
+	fftw_complex	*spectrum = NULL;
+	double			seconds = 0, S2 = 0;
+	size_t			signalBytes = 0, spectrumBytes = 0;
 
-#ifdef DEBUG
-	if(config->verbose >= 3)
+	if(!AudioArray)
+	{
+		logmsg("No Array for results\n");
+		return 0;
+	}
+
+	stereoSignalSize = (long)size;
+	monoSignalSize = stereoSignalSize/AudioChannels;
+	seconds = (double)size/(samplerate*(double)AudioChannels);
+
+	if(config->padBlockSizes)
+		zeropadding = GetBlockZeroPadValues(&monoSignalSize, &seconds, config->maxBlockSeconds, samplerate);
+	
+	if(ZeroPad)  /* disabled by default */
+		zeropadding = GetZeroPadValues(&monoSignalSize, &seconds, samplerate, ZeroPad);
+
+#ifdef DEBUG
+	if(config->verbose >= 2)
+		logmsg("ExecuteDFFTInternal> stereoSignalSize: %ld monoSignalSize: %ld zeropadding: %ld windowed: %ld seconds: %g\n", 
+			stereoSignalSize, monoSignalSize, zeropadding, monoSignalSize - zeropadding, seconds);
+#endif
+
+	if(config->singlePrecision == SINGLE_PRECISION_FFT)
+		return(ExecuteDFFTSingle(AudioArray, samples, monoSignalSize, zeropadding, seconds, samplerate, window, channel, AudioChannels, pool, config));
+
+	signalBytes = sizeof(double)*(monoSignalSize+1);
+	spectrumBytes = sizeof(fftw_complex)*(monoSignalSize/2+1);
+	signal = (double*)PoolAlloc(pool, signalBytes);
+	if(!signal)
+	{
+		logmsg("Not enough memory\n");
+		return(0);
+	}
+	spectrum = (fftw_complex*)PoolAlloc(pool, spectrumBytes);
+	if(!spectrum)
+	{
+		PoolFree(pool, signal, signalBytes);
+		logmsg("Not enough memory\n");
+		return(0);
+	}
+
+#ifdef DEBUG
+	if(config->verbose >= 3)
+		logmsg("monoSignalSize: %ld zeropadding: %ld monoSignalSize - zeropadding: %ld\n",
+			monoSignalSize, zeropadding, monoSignalSize - zeropadding);
+#endif
+
+	// Deinterleave and window straight from the source, only the padding is cleared
+	for(i = 0; i < monoSignalSize - zeropadding; i++)
+	{
+		if(channel == CHANNEL_LEFT)
+			signal[i] = samples[i*AudioChannels];
+		if(channel == CHANNEL_RIGHT)
+			signal[i] = samples[i*AudioChannels+1];
+		if(channel == CHANNEL_STEREO)
+			signal[i] = (samples[i*AudioChannels]+samples[i*AudioChannels+1])/2.0;
+	}
+	// The energy sum comes precomputed with the window, it was checked when created
+	if(window)
+	{
+		double *w = window->window;
+
+		for(long int j = 0; j < i; j++)
+			signal[j] *= w[j];
+		S2 = GetWindowEnergy(window, i);
+	}
+	memset(signal+i, 0, sizeof(double)*(monoSignalSize+1-i));
+
+	if(config->singlePrecision == SINGLE_PRECISION_VALIDATE)
+	{
+		if(!ValidateSinglePrecision(monoSignalSize, signal, spectrum, pool, config))
+		{
+			PoolFree(pool, signal, signalBytes);
+			PoolFree(pool, spectrum, spectrumBytes);
+			return 0;
+		}
+	}
+	else if(!ExecuteRealToComplex(monoSignalSize, signal, spectrum, config))
+	{
+		PoolFree(pool, signal, signalBytes);
+		PoolFree(pool, spectrum, spectrumBytes);
+		return 0;
+	}
+
+#ifdef DEBUG
+	if(config->verbose >= 3)
 		logmsg("Seconds %g was %g. S2: %ld\n", seconds, AudioArray->seconds, S2);
 #endif
 
@@ -1970,49 +2354,78 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, d
 		AudioArray->fftwValuesRight.ENBW = samplerate*S2;
 	}
 	AudioArray->seconds = seconds;
-	free(signal);
+	PoolFree(pool, signal, signalBytes);
 	signal = NULL;
 
 	return(1);
 }
 
-int CalculateMaxCompare(int block, AudioSignal *Signal, double significant, char channel, parameters *config)
+/*
+	Comparison bins are indexed by absolute hertz, which is what
+	areDoublesEqual measures its tolerance on. Every value it could accept
+	lies within the window, and of those the lowest index that is still
+	unmatched wins, the same one a linear scan over the bins would find.
+*/
+static HertzIndex *IndexFrequencies(Frequency *freqs, int size)
 {
-	long int	size = 0;
-	double		limit = 0;
-	Frequency	*freqCheck = NULL;
+	HertzIndex	*sorted = NULL;
 
-	size = GetBlockFreqSize(Signal, block, channel, config);
-	if(channel == CHANNEL_LEFT)
-		freqCheck = Signal->Blocks[block].freq;
-	else
-		freqCheck = Signal->Blocks[block].freqRight;
+	sorted = (HertzIndex*)malloc(sizeof(HertzIndex)*(size > 0 ? size : 1));
+	if(!sorted)
+		return NULL;
 
-	if(!freqCheck)
-		return 0;
-
-	limit = significant;
+	for(int i = 0; i < size; i++)
+	{
+		sorted[i].hertz = fabs(freqs[i].hertz);
+		sorted[i].index = i;
+	}
+	if(size > 1)
+		HertzIndex_tim_sort(sorted, size);
+	return sorted;
+}
 
-	if(Signal->role == ROLE_COMP)
-		limit += -20;	// Allow going 20 dbfs "deeper"
+// First position in the index at or above hertz
+static int FindHertzLowerBound(HertzIndex *sorted, int size, double hertz)
+{
+	int		low = 0, high = size;
 
-	for(int freq = 0; freq < size; freq++)
+	while(low < high)
 	{
-		/* Out of valid frequencies */
-		if(!freqCheck[freq].hertz)
-			return(freq);
+		int mid = low + (high - low)/2;
 
-		/* Amplitude is too low */
-		if(freqCheck[freq].amplitude <= limit)
-			return(freq);
+		if(sorted[mid].hertz < hertz)
+			low = mid + 1;
+		else
+			high = mid;
 	}
+	return low;
+}
+
+static int FindMatchingFrequency(HertzIndex *sorted, int size, Frequency *freqComp, double hertz)
+{
+	int		low = 0, match = -1;
+	double	key = 0, window = 0;
+
+	key = fabs(hertz);
+	window = 2*DBL_PERFECT_MATCH + 4*DBL_EPSILON*key;
+
+	low = FindHertzLowerBound(sorted, size, key - window);
+	for(int i = low; i < size && sorted[i].hertz <= key + window; i++)
+	{
+		int comp = sorted[i].index;
 
-	return size;
+		if(match != -1 && comp > match)
+			continue;
+		if(!freqComp[comp].matched && areDoublesEqual(hertz, freqComp[comp].hertz))
+			match = comp;
+	}
+	return match;
 }
 
 int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, char channel, int block, int refSize, int testSize, parameters *config)
 {
 	Frequency	*freqRef = NULL, *freqComp = NULL;
+	HertzIndex	*sorted = NULL;
 
 	if(channel == CHANNEL_LEFT)
 	{
@@ -2031,6 +2444,13 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 		return 0;
 	}
 
+	sorted = IndexFrequencies(freqComp, testSize);
+	if(!sorted)
+	{
+		logmsg("Not enough memory\n");
+		return 0;
+	}
+
 	for(int freq = 0; freq < refSize; freq++)
 	{
 		int found = 0, index = 0;
@@ -2038,21 +2458,19 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 		if(!IncrementCompared(block, channel, config))
 		{
 			logmsg("Internal consistency failure, please send error log (compare)\n");
+			free(sorted);
 			return 0;
 		}
 
-		for(int comp = 0; comp < testSize; comp++)
+		if(!freqRef[freq].matched)
 		{
-			if(!freqRef[freq].matched && !freqComp[comp].matched &&
-				areDoublesEqual(freqRef[freq].hertz, freqComp[comp].hertz))
+			index = FindMatchingFrequency(sorted, testSize, freqComp, freqRef[freq].hertz);
+			if(index >= 0)
 			{
-				freqComp[comp].matched = freq + 1;
-				freqRef[freq].matched = comp + 1;
+				freqComp[index].matched = freq + 1;
+				freqRef[freq].matched = index + 1;
 
 				found = 1;
-				index = comp;
-
-				break;
 			}
 		}
 
@@ -2064,6 +2482,7 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 				if(!InsertAmplDifference(block, freqRef[freq], freqComp[index], channel, config))
 				{
 					logmsg("Internal consistency failure, please send error log (AmplDiff)\n");
+					free(sorted);
 					return 0;
 				}
 			}
@@ -2072,6 +2491,7 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 				if(!IncrementPerfectMatch(block, channel, config))
 				{
 					logmsg("Internal consistency failure, please send error log (perfect)\n");
+					free(sorted);
 					return 0;
 				}
 			}
@@ -2081,6 +2501,7 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 				if(!InsertPhaseDifference(block, freqRef[freq], freqComp[index], channel, config))
 				{
 					logmsg("Internal consistency failure, please send error log (PhaseDiff)\n");
+					free(sorted);
 					return 0;
 				}
 			}
@@ -2093,16 +2514,169 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 			if(!InsertFreqNotFound(block, freqRef[freq].hertz, freqRef[freq].amplitude, channel, config))
 			{
 				logmsg("Internal consistency failure, please send error log (Not found)\n");
+				free(sorted);
 				return 0;
 			}
 		}
 	}
+	free(sorted);
+	return 1;
+}
+
+/*
+	-U, the block is windowed straight from the samples into a float buffer
+	and the fftwf spectrum is kept as is, FillFrequencyStructures reads it
+	bin by bin. Same transform input as rounding the double windowed block.
+*/
+int ExecuteDFFTSingle(AudioBlocks *AudioArray, SampleValue *samples, long int monoSignalSize, long int zeropadding, double seconds, double samplerate, windowUnit *window, char channel, int AudioChannels, BufferPool *pool, parameters *config)
+{
+	long int		i = 0;
+	float			*signal = NULL;
+	fftwf_complex	*spectrum = NULL;
+	double			*w = NULL, S2 = 0;
+	size_t			signalBytes = 0, spectrumBytes = 0;
+
+	signalBytes = sizeof(float)*(monoSignalSize+1);
+	spectrumBytes = sizeof(fftwf_complex)*(monoSignalSize/2+1);
+	signal = (float*)PoolAlloc(pool, signalBytes);
+	if(!signal)
+	{
+		logmsg("Not enough memory\n");
+		return(0);
+	}
+	spectrum = (fftwf_complex*)PoolAlloc(pool, spectrumBytes);
+	if(!spectrum)
+	{
+		PoolFree(pool, signal, signalBytes);
+		logmsg("Not enough memory\n");
+		return(0);
+	}
+
+	if(window)
+		w = window->window;
+	for(i = 0; i < monoSignalSize - zeropadding; i++)
+	{
+		double	sample = 0;
+
+		if(channel == CHANNEL_LEFT)
+			sample = samples[i*AudioChannels];
+		if(channel == CHANNEL_RIGHT)
+			sample = samples[i*AudioChannels+1];
+		if(channel == CHANNEL_STEREO)
+			sample = (samples[i*AudioChannels]+samples[i*AudioChannels+1])/2.0;
+		signal[i] = (float)(w ? sample*w[i] : sample);
+	}
+	if(window)
+		S2 = GetWindowEnergy(window, i);
+	memset(signal+i, 0, sizeof(float)*(monoSignalSize+1-i));
+
+	if(!ExecuteRealToComplexFloat(monoSignalSize, signal, spectrum, config))
+	{
+		PoolFree(pool, signal, signalBytes);
+		PoolFree(pool, spectrum, spectrumBytes);
+		return 0;
+	}
+
+	if(channel != CHANNEL_RIGHT)
+	{
+		AudioArray->fftwValues.spectrumf = spectrum;
+		AudioArray->fftwValues.size = monoSignalSize;
+		AudioArray->fftwValues.ENBW = samplerate*S2;
+	}
+	else
+	{
+		AudioArray->fftwValuesRight.spectrumf = spectrum;
+		AudioArray->fftwValuesRight.size = monoSignalSize;
+		AudioArray->fftwValuesRight.ENBW = samplerate*S2;
+	}
+	AudioArray->seconds = seconds;
+	PoolFree(pool, signal, signalBytes);
+
+	return(1);
+}
+
+/*
+	Runs both transforms, keeps the double precision result and records
+	the largest magnitude deviation in dB of the single precision one.
+	Only bins above the significant amplitude relative to the block peak
+	are compared, the rest are discarded by the analysis anyway.
+*/
+int ValidateSinglePrecision(long int size, double *signal, fftw_complex *spectrum, BufferPool *pool, parameters *config)
+{
+	double			maxMag = 0, limit = 0, maxDev = 0;
+	float			*signalf = NULL;
+	fftwf_complex	*spectrumf = NULL;
+	size_t			signalBytes = 0, spectrumBytes = 0;
+
+	signalBytes = sizeof(float)*(size+1);
+	spectrumBytes = sizeof(fftwf_complex)*(size/2+1);
+	signalf = (float*)PoolAlloc(pool, signalBytes);
+	if(!signalf)
+	{
+		logmsg("Not enough memory\n");
+		return 0;
+	}
+	spectrumf = (fftwf_complex*)PoolAlloc(pool, spectrumBytes);
+	if(!spectrumf)
+	{
+		PoolFree(pool, signalf, signalBytes);
+		logmsg("Not enough memory\n");
+		return 0;
+	}
+
+	for(long int i = 0; i < size+1; i++)
+		signalf[i] = (float)signal[i];
+
+	// c2r would destroy the input, but r2c keeps it, so both use the same signal
+	if(!ExecuteRealToComplexFloat(size, signalf, spectrumf, config) ||
+		!ExecuteRealToComplex(size, signal, spectrum, config))
+	{
+		PoolFree(pool, signalf, signalBytes);
+		PoolFree(pool, spectrumf, spectrumBytes);
+		return 0;
+	}
+	PoolFree(pool, signalf, signalBytes);
+
+	for(long int i = 1; i < size/2+1; i++)
+	{
+		double mag = cabs(spectrum[i]);
+
+		if(mag > maxMag)
+			maxMag = mag;
+	}
+
+	limit = maxMag*pow(10, config->significantAmplitude/20);
+	for(long int i = 1; i < size/2+1; i++)
+	{
+		double mag = 0, magSingle = 0, dev = 0;
+
+		mag = cabs(spectrum[i]);
+		if(mag == 0 || mag < limit)
+			continue;
+		magSingle = cabs(crealf(spectrumf[i]) + I*cimagf(spectrumf[i]));
+		if(magSingle == 0)
+			dev = fabs(config->significantAmplitude);
+		else
+			dev = fabs(20*log10(magSingle/mag));
+		if(dev > maxDev)
+			maxDev = dev;
+	}
+	PoolFree(pool, spectrumf, spectrumBytes);
+
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (single_precision_validation)
+#endif
+	{
+		if(maxDev > config->singlePrecisionMaxDev)
+			config->singlePrecisionMaxDev = maxDev;
+		config->singlePrecisionBlocks++;
+	}
 	return 1;
 }
 
 int CompareAudioBlocks(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
 {
-	int		block = 0, warn = 0;
+	int		block = 0, warn = 0, failed = 0;
 	struct	timespec	start, end;
 
 	if(config->clock)
@@ -2114,11 +2688,18 @@ int CompareAudioBlocks(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 	if(config->extendedResults || config->showAll)
 		logmsg("\n");
 
+	// Blocks only write to their own frequencies and differences
+#ifdef OPENMP_ENABLE
+	#pragma omp parallel for schedule(dynamic)
+#endif
 	for(block = 0; block < config->types.totalBlocks; block++)
 	{
 		char	channel = CHANNEL_MONO;
 		int 	refSize = 0, testSize = 0, type = 0;
 
+		if(failed)
+			continue;
+
 		type = GetBlockType(config, block);
 		channel = GetBlockChannel(config, block);
  
@@ -2129,23 +2710,43 @@ int CompareAudioBlocks(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 		refSize = CalculateMaxCompare(block, ReferenceSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_LEFT, config);
 		testSize = CalculateMaxCompare(block, ComparisonSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_LEFT, config);
 
-		if(config->verbose)
+		if(!CompareFrequencies(ReferenceSignal, ComparisonSignal, CHANNEL_LEFT, block, refSize, testSize, config))
 		{
-			logmsgFileOnly("Comparing %s# %d (%d) %ld vs %ld\n",
-					GetBlockName(config, block), GetBlockSubIndex(config, block), block,
-					refSize, testSize);
+			failed = 1;
+			continue;
 		}
 
-		if(!CompareFrequencies(ReferenceSignal, ComparisonSignal, CHANNEL_LEFT, block, refSize, testSize, config))
-			return 0;
-
 		if(channel == CHANNEL_STEREO)
 		{
 			refSize = CalculateMaxCompare(block, ReferenceSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_RIGHT, config);
 			testSize = CalculateMaxCompare(block, ComparisonSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_RIGHT, config);
 
 			if(!CompareFrequencies(ReferenceSignal, ComparisonSignal, CHANNEL_RIGHT, block, refSize, testSize, config))
-				return 0;
+				failed = 1;
+		}
+	}
+
+	if(failed)
+		return 0;
+
+	ReduceDifferenceTotals(config);
+
+	for(block = 0; block < config->types.totalBlocks; block++)
+	{
+		int 	type = 0;
+
+		type = GetBlockType(config, block);
+
+		/* Ignore Control blocks */
+		if(type < TYPE_CONTROL)
+			continue;
+
+		if(config->verbose)
+		{
+			logmsgFileOnly("Comparing %s# %d (%d) %ld vs %ld\n",
+					GetBlockName(config, block), GetBlockSubIndex(config, block), block,
+					CalculateMaxCompare(block, ReferenceSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_LEFT, config),
+					CalculateMaxCompare(block, ComparisonSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_LEFT, config));
 		}
 
 		if(type > TYPE_CONTROL)
@@ -2192,6 +2793,7 @@ int CompareAudioBlocks(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 		if(!warn)
 			logmsg("\n");
 		logmsg(" - clk: Comparing frequencies took %0.2fs\n", elapsedSeconds);
+		PrintDifferenceArenaStats(config);
 	}
 	return 1;
 }
@@ -2235,7 +2837,7 @@ void NormalizeAudio(AudioSignal *Signal)
 void NormalizeAudioByRatio(AudioSignal *Signal, double ratio)
 {
 	long int 	i = 0, start = 0, end = 0;
-	double		*samples = NULL;
+	SampleValue	*samples = NULL;
 
 	if(!Signal)
 		return;
@@ -2512,7 +3114,7 @@ void NormalizeBlockByRatio(AudioBlocks *AudioArray, double ratio)
 MaxSample FindMaxSampleAmplitude(AudioSignal *Signal)
 {
 	long int 		i = 0, start = 0, end = 0;
-	double			*samples = NULL;
+	SampleValue		*samples = NULL;
 	MaxSample		maxSampleValue;
 
 	maxSampleValue.maxSample = 0;
@@ -2545,7 +3147,8 @@ MaxSample FindMaxSampleAmplitude(AudioSignal *Signal)
 double FindLocalMaximumAroundSample(AudioSignal *Signal, MaxSample refMax)
 {
 	long int 		i, start = 0, end = 0, pos = 0;
-	double			*samples = NULL, MaxLocalSample = 0;
+	SampleValue		*samples = NULL;
+	double			MaxLocalSample = 0;
 	double			refSeconds = 0, refFrames = 0, tarSeconds = 0, fraction = 0;
 
 	if(!Signal)
@@ -2658,36 +3261,29 @@ MaxMagn FindMaxMagnitudeBlock(AudioSignal *Signal, parameters *config)
 		int type = TYPE_NOTYPE;
 
 		type = GetBlockType(config, block);
+		// Frequencies are ranked by magnitude, the first one is the block's peak
 		if(type > TYPE_CONTROL || type == TYPE_WATERMARK)
 		{
 			size = GetBlockFreqSize(Signal, block, CHANNEL_LEFT, config);
-			for(long int i = 0; i < size; i++)
+			if(size > 0 && Signal->Blocks[block].freq[0].hertz &&
+				Signal->Blocks[block].freq[0].magnitude > MaxMag.magnitude)
 			{
-				if(!Signal->Blocks[block].freq[i].hertz)
-					break;
-				if(Signal->Blocks[block].freq[i].magnitude > MaxMag.magnitude)
-				{
-					MaxMag.magnitude = Signal->Blocks[block].freq[i].magnitude;
-					MaxMag.hertz = Signal->Blocks[block].freq[i].hertz;
-					MaxMag.block = block;
-					MaxMag.channel = CHANNEL_LEFT;
-				}
+				MaxMag.magnitude = Signal->Blocks[block].freq[0].magnitude;
+				MaxMag.hertz = Signal->Blocks[block].freq[0].hertz;
+				MaxMag.block = block;
+				MaxMag.channel = CHANNEL_LEFT;
 			}
 
 			if(Signal->Blocks[block].freqRight)
 			{
 				size = GetBlockFreqSize(Signal, block, CHANNEL_RIGHT, config);
-				for(long int i = 0; i < size; i++)
+				if(size > 0 && Signal->Blocks[block].freqRight[0].hertz &&
+					Signal->Blocks[block].freqRight[0].magnitude > MaxMag.magnitude)
 				{
-					if(!Signal->Blocks[block].freqRight[i].hertz)
-						break;
-					if(Signal->Blocks[block].freqRight[i].magnitude > MaxMag.magnitude)
-					{
-						MaxMag.magnitude = Signal->Blocks[block].freqRight[i].magnitude;
-						MaxMag.hertz = Signal->Blocks[block].freqRight[i].hertz;
-						MaxMag.block = block;
-						MaxMag.channel = CHANNEL_RIGHT;
-					}
+					MaxMag.magnitude = Signal->Blocks[block].freqRight[0].magnitude;
+					MaxMag.hertz = Signal->Blocks[block].freqRight[0].hertz;
+					MaxMag.block = block;
+					MaxMag.channel = CHANNEL_RIGHT;
 				}
 			}
 		}
@@ -2719,26 +3315,25 @@ MaxMagn FindMaxMagnitudeBlock(AudioSignal *Signal, parameters *config)
 	return MaxMag;
 }
 
-void swapMagnitudes(MaxMagn *xp, MaxMagn *yp)
+/*
+	Drops the last entry and places the new one after the larger
+	magnitudes and before the equal ones, the order sorting the shifted
+	array used to give.
+*/
+void InsertMagnitude(MaxMagn *arr, int n, double magnitude, double hertz, long int block, char channel)
 {
-    MaxMagn temp = *xp;
+	int pos = 0;
 
-    *xp = *yp;
-    *yp = temp;
-}
- 
-void bubbleSortMagnitudes(MaxMagn *arr, int n)
-{
-	int i, j;
+	while(pos < n - 1 && arr[pos].magnitude > magnitude)
+		pos++;
 
-	for (i = 0; i < n-1; i++)
-	{
-		for (j = 0; j < n-i-1; j++)
-		{
-			if (arr[j].magnitude < arr[j+1].magnitude)
-				swapMagnitudes(&arr[j], &arr[j+1]);
-		}
-	}
+	if(n - 1 > pos)
+		memmove(arr + pos + 1, arr + pos, sizeof(MaxMagn)*(n - 1 - pos));
+
+	arr[pos].magnitude = magnitude;
+	arr[pos].hertz = hertz;
+	arr[pos].block = block;
+	arr[pos].channel = channel;
 }
 
 int FindMultiMaxMagnitudeBlock(AudioSignal *Signal, MaxMagn	*MaxMag, int *size, parameters *config)
@@ -2773,24 +3368,18 @@ int FindMultiMaxMagnitudeBlock(AudioSignal *Signal, MaxMagn	*MaxMag, int *size,
 		type = GetBlockType(config, block);
 		if(type > TYPE_CONTROL || type == TYPE_WATERMARK)
 		{
+			// Ranked by magnitude, once one falls short the rest of the block does too
 			blocksize = GetBlockFreqSize(Signal, block, CHANNEL_LEFT, config);
 			for(long int i = 0; i < blocksize; i++)
 			{
 				if(!Signal->Blocks[block].freq[i].hertz)
 					break;
-				if(threshold < Signal->Blocks[block].freq[i].magnitude && 
-					Signal->Blocks[block].freq[i].magnitude > MaxMag[*size-1].magnitude)
-				{
-					for(long int j = *size - 1; j > 0; j--)
-						MaxMag[j] = MaxMag[j - 1];
-
-					MaxMag[0].magnitude = Signal->Blocks[block].freq[i].magnitude;
-					MaxMag[0].hertz = Signal->Blocks[block].freq[i].hertz;
-					MaxMag[0].block = block;
-					MaxMag[0].channel = CHANNEL_LEFT;
+				if(threshold >= Signal->Blocks[block].freq[i].magnitude ||
+					Signal->Blocks[block].freq[i].magnitude <= MaxMag[*size-1].magnitude)
+					break;
 
-					bubbleSortMagnitudes(MaxMag, *size);
-				}
+				InsertMagnitude(MaxMag, *size, Signal->Blocks[block].freq[i].magnitude,
+					Signal->Blocks[block].freq[i].hertz, block, CHANNEL_LEFT);
 			}
 
 			if(Signal->Blocks[block].freqRight)
@@ -2800,19 +3389,12 @@ int FindMultiMaxMagnitudeBlock(AudioSignal *Signal, MaxMagn	*MaxMag, int *size,
 				{
 					if(!Signal->Blocks[block].freqRight[i].hertz)
 						break;
-					if(threshold < Signal->Blocks[block].freqRight[i].magnitude && 
-						Signal->Blocks[block].freqRight[i].magnitude > MaxMag[*size-1].magnitude)
-					{
-						for(int j = *size - 1; j > 0; j--)
-							MaxMag[j] = MaxMag[j - 1];
-
-						MaxMag[0].magnitude = Signal->Blocks[block].freqRight[i].magnitude;
-						MaxMag[0].hertz = Signal->Blocks[block].freqRight[i].hertz;
-						MaxMag[0].block = block;
-						MaxMag[0].channel = CHANNEL_RIGHT;
+					if(threshold >= Signal->Blocks[block].freqRight[i].magnitude ||
+						Signal->Blocks[block].freqRight[i].magnitude <= MaxMag[*size-1].magnitude)
+						break;
 
-						bubbleSortMagnitudes(MaxMag, *size);
-					}
+					InsertMagnitude(MaxMag, *size, Signal->Blocks[block].freqRight[i].magnitude,
+						Signal->Blocks[block].freqRight[i].hertz, block, CHANNEL_RIGHT);
 				}
 			}
 		}
@@ -2853,145 +3435,143 @@ int FindMultiMaxMagnitudeBlock(AudioSignal *Signal, MaxMagn	*MaxMag, int *size,
 	return 1;
 }
 
-double FindLocalMaximumInBlock(AudioSignal *Signal, MaxMagn refMax, int allowDifference, parameters *config)
+static PeakLookup *GetPeakLookup(AudioSignal *Signal, PeakLookup *lookups, long int block, char channel, parameters *config)
+{
+	PeakLookup	*lookup = NULL;
+	Frequency	*freqs = NULL;
+
+	lookup = &lookups[block*2 + (channel == CHANNEL_RIGHT ? 1 : 0)];
+	if(lookup->built)
+		return lookup;
+
+	freqs = channel == CHANNEL_RIGHT ? Signal->Blocks[block].freqRight : Signal->Blocks[block].freq;
+
+	// The bins a scan would visit, up to MaxFreq or the first empty one
+	lookup->size = 0;
+	while(lookup->size < config->MaxFreq && freqs[lookup->size].hertz)
+		lookup->size++;
+
+	lookup->index = IndexFrequencies(freqs, lookup->size);
+	if(!lookup->index)
+	{
+		logmsg("ERROR: Not enough memory for normalization\n");
+		return NULL;
+	}
+	lookup->built = 1;
+	return lookup;
+}
+
+void ReleasePeakLookups(PeakLookup *lookups, int count)
+{
+	if(!lookups)
+		return;
+
+	for(int i = 0; i < count; i++)
+	{
+		if(lookups[i].index)
+			free(lookups[i].index);
+	}
+	free(lookups);
+}
+
+/*
+	Looks the reference hertz up in the block's hertz index. When several
+	bins qualify the one with the highest magnitude, the lowest rank, wins,
+	which is the first one a scan over the ranked bins would find.
+*/
+double FindLocalMaximumInBlock(AudioSignal *Signal, PeakLookup *lookups, MaxMagn refMax, int allowDifference, parameters *config)
 {
 	double		highest = 0;
+	int			match = -1, pos = 0;
+	Frequency	*freqs = NULL;
+	PeakLookup	*lookup = NULL;
 
 	if(!Signal)
 		return highest;
 
-	// we first try a perfect match
 	if(refMax.channel == CHANNEL_LEFT)
+		freqs = Signal->Blocks[refMax.block].freq;
+
+	if(refMax.channel == CHANNEL_RIGHT)
 	{
-		for(int i = 0; i < config->MaxFreq; i++)
+		freqs = Signal->Blocks[refMax.block].freqRight;
+		if(!freqs)
 		{
-			double diff = 0;
-			double magnitude = 0;
-
-			if(!Signal->Blocks[refMax.block].freq[i].hertz)
-				break;
-
-			magnitude = Signal->Blocks[refMax.block].freq[i].magnitude;
-			diff = fabs(refMax.hertz - Signal->Blocks[refMax.block].freq[i].hertz);
-
-			if(diff == 0)
-			{
-				if(config->verbose >= 2) {
-					logmsg(" - Comparison Local Max magnitude for [R:%g->C:%g] Hz is %g at %s# %d (%d)\n",
-						refMax.hertz, Signal->Blocks[refMax.block].freq[i].hertz,
-						magnitude, GetBlockName(config, refMax.block), GetBlockSubIndex(config, refMax.block), refMax.block);
-				}
-				return (magnitude);
-			}
+			if(config->verbose)
+				logmsg("WARNING: Comparison has no right Channel data for match\n");
 		}
 	}
 
-	if(refMax.channel == CHANNEL_RIGHT)
+	if(freqs)
+		lookup = GetPeakLookup(Signal, lookups, refMax.block, refMax.channel, config);
+
+	if(lookup)
 	{
-		if(Signal->Blocks[refMax.block].freqRight)
+		// we first try a perfect match
+		pos = FindHertzLowerBound(lookup->index, lookup->size, fabs(refMax.hertz));
+		for(; pos < lookup->size && lookup->index[pos].hertz == fabs(refMax.hertz); pos++)
 		{
-			for(int i = 0; i < config->MaxFreq; i++)
+			if(freqs[lookup->index[pos].index].hertz == refMax.hertz)
 			{
-				double diff = 0;
-				double magnitude = 0;
-
-				if(!Signal->Blocks[refMax.block].freqRight[i].hertz)
-					break;
-
-				magnitude = Signal->Blocks[refMax.block].freqRight[i].magnitude;
-				diff = fabs(refMax.hertz - Signal->Blocks[refMax.block].freqRight[i].hertz);
-
-				if(diff == 0)
-				{
-					if(config->verbose) {
-						logmsg(" - Comparison Local Max magnitude for [R:%g->C:%g] Hz is %g at %s# %d (%d)\n",
-							refMax.hertz, Signal->Blocks[refMax.block].freqRight[i].hertz,
-							magnitude, GetBlockName(config, refMax.block), GetBlockSubIndex(config, refMax.block), refMax.block);
-					}
-					return (magnitude);
-				}
+				match = lookup->index[pos].index;
+				break;
 			}
 		}
-		else
+
+		if(match != -1)
 		{
-			if(config->verbose)
-				logmsg("WARNING: Comparison has no right Channel data for match\n");
+			if(config->verbose >= (refMax.channel == CHANNEL_LEFT ? 2 : 1)) {
+				logmsg(" - Comparison Local Max magnitude for [R:%g->C:%g] Hz is %g at %s# %d (%d)\n",
+					refMax.hertz, freqs[match].hertz,
+					freqs[match].magnitude, GetBlockName(config, refMax.block), GetBlockSubIndex(config, refMax.block), refMax.block);
+			}
+			return (freqs[match].magnitude);
 		}
 	}
 
-	if(allowDifference)
+	if(allowDifference && lookup)
 	{
+		double	binSize = 0, window = 0;
+
 		// Now with the tolerance
 		// we regularly end in a case where the
 		// peak is a few bins lower or higher
 		// and we don't want to normalize against
 		// the magnitude of a harmonic sine wave
 		// we allow a difference of +/- 5 frequency bins
-		if(refMax.channel == CHANNEL_LEFT)
-		{
-			for(int i = 0; i < config->MaxFreq; i++)
-			{
-				double diff = 0, binSize = 0;
-				double magnitude = 0;
+		binSize = FindFrequencyBinSizeForBlock(Signal, refMax.block);
+		window = 10*binSize;	// twice the tolerance, candidates are checked below
 
-				if(!Signal->Blocks[refMax.block].freq[i].hertz)
-					break;
+		pos = FindHertzLowerBound(lookup->index, lookup->size, fabs(refMax.hertz) - window);
+		for(; pos < lookup->size && lookup->index[pos].hertz <= fabs(refMax.hertz) + window; pos++)
+		{
+			int		i = lookup->index[pos].index;
+			double	diff = 0;
 
-				magnitude = Signal->Blocks[refMax.block].freq[i].magnitude;
-				diff = fabs(refMax.hertz - Signal->Blocks[refMax.block].freq[i].hertz);
+			if(match != -1 && i > match)
+				continue;
 
-				binSize = FindFrequencyBinSizeForBlock(Signal, refMax.block);
-				if(diff < 5*binSize)
-				{
-					if(config->verbose) {
-						logmsg(" - Comparison Local Max magnitude with tolerance for [R:%g->C:%g] Hz is %g at %s# %d (%d)\n",
-							refMax.hertz, Signal->Blocks[refMax.block].freq[i].hertz,
-							magnitude, GetBlockName(config, refMax.block), GetBlockSubIndex(config, refMax.block), refMax.block);
-					}
-					config->frequencyNormalizationTolerant = diff/binSize;
-					return (magnitude);
-				}
-				if(magnitude > highest)
-					highest = magnitude;
-			}
+			diff = fabs(refMax.hertz - freqs[i].hertz);
+			if(diff < 5*binSize)
+				match = i;
 		}
 
-		if(refMax.channel == CHANNEL_RIGHT)
+		if(match != -1)
 		{
-			if(Signal->Blocks[refMax.block].freqRight)
-			{
-				for(int i = 0; i < config->MaxFreq; i++)
-				{
-					double diff = 0, binSize = 0;
-					double magnitude = 0;
-
-					if(!Signal->Blocks[refMax.block].freqRight[i].hertz)
-						break;
-
-					magnitude = Signal->Blocks[refMax.block].freqRight[i].magnitude;
-					diff = fabs(refMax.hertz - Signal->Blocks[refMax.block].freqRight[i].hertz);
+			double	diff = 0;
 
-					binSize = FindFrequencyBinSizeForBlock(Signal, refMax.block);
-					if(diff < 5*binSize)
-					{
-						if(config->verbose) {
-							logmsg(" - Comparison Local Max magnitude with tolerance for [R:%g->C:%g] Hz is %g at %s# %d (%d)\n",
-								refMax.hertz, Signal->Blocks[refMax.block].freqRight[i].hertz,
-								magnitude, GetBlockName(config, refMax.block), GetBlockSubIndex(config, refMax.block), refMax.block);
-						}
-						config->frequencyNormalizationTolerant = diff/binSize;
-						return (magnitude);
-					}
-					if(magnitude > highest)
-						highest = magnitude;
-				}
-			}
-			else
-			{
-				if(config->verbose)
-					logmsg("WARNING: Comparison has no right Channel data for match\n");
+			diff = fabs(refMax.hertz - freqs[match].hertz);
+			if(config->verbose) {
+				logmsg(" - Comparison Local Max magnitude with tolerance for [R:%g->C:%g] Hz is %g at %s# %d (%d)\n",
+					refMax.hertz, freqs[match].hertz,
+					freqs[match].magnitude, GetBlockName(config, refMax.block), GetBlockSubIndex(config, refMax.block), refMax.block);
 			}
+			config->frequencyNormalizationTolerant = diff/binSize;
+			return (freqs[match].magnitude);
 		}
+
+		if(lookup->size)
+			highest = freqs[0].magnitude;
 	}
 
 	if(config->verbose) {
@@ -63,6 +63,9 @@
 
 #define DBL_PERFECT_MATCH			 0.00001	// double difference to be considered a "perfect" match
 
+#define SINGLE_PRECISION_FFT		1		// block spectra are transformed with fftwf
+#define SINGLE_PRECISION_VALIDATE	2		// both are run, double is kept and the deviation reported
+
 #define SIGNIFICANT_AMPLITUDE		-66.0
 #define NS_LOWEST_AMPLITUDE			-200
 #define	PCM_8BIT_MIN_AMPLITUDE		-48.16
@@ -376,8 +379,10 @@ typedef struct FrequencySt {
 
 typedef struct fftw_spectrum_st {
 	fftw_complex  	*spectrum;
+	fftwf_complex	*spectrumf;	// set instead of spectrum by the single precision transform
 	size_t			size;
 	size_t			ENBW;
+	int				shared;		// spectrum is part of the left channel allocation
 } FFTWSpectrum;
 
 typedef struct samples_st {
@@ -420,6 +425,65 @@ typedef struct AudioBlock_st {
 	double			extraPercent;
 } AudioBlocks;
 
+#define POOL_CLASSES	48
+
+typedef struct pool_class_st {
+	void		**buffers;
+	int			count;
+	int			max;
+} PoolClass;
+
+typedef struct buffer_pool_st {
+	PoolClass	classes[POOL_CLASSES];
+	long int	allocations;
+	long int	reused;
+	size_t		inUseBytes;
+	size_t		peakBytes;
+} BufferPool;
+
+typedef struct internal_sync_cache_st {
+	long int	pos;
+	long int	offset;
+	long int	endPulse;
+	int			toleranceIssue;
+} InternalSyncCache;
+
+typedef struct sync_cache_st {
+	int					valid;
+	int					rejected;
+	uint64_t			hash;
+	long int			startOffset;
+	long int			endOffset;
+	double				framerate;
+	double				EstimatedSR;
+	double				alignPct[2];
+	int					alignTolerance[2];
+	int					internalCount;
+	int					internalPending;
+	InternalSyncCache	internal[DELAYCOUNT];
+} SyncCache;
+
+typedef struct pcm_stream_st {
+	int			active;
+	int			isFlac;
+	FILE		*file;
+	size_t		reserved;
+	long int	residentStart;
+	long int	residentEnd;
+	long int	peakResident;
+	long int	loaded;
+	double		gain[2];
+	long int	gainStart;
+	long int	gainEnd;
+} PCMStream;
+
+// Whole file sample storage, -DFLOAT_SAMPLES keeps it in float for 16 and 24 bit sources
+#ifdef FLOAT_SAMPLES
+typedef float SampleValue;
+#else
+typedef double SampleValue;
+#endif
+
 typedef struct AudioSt {
 	char		SourceFile[BUFFER_SIZE];
 	int			AudioChannels;
@@ -429,13 +493,14 @@ typedef struct AudioSt {
 	double		floorFreq;
 	double		floorAmplitude;
 
-	double		*Samples;
+	SampleValue	*Samples;
 	double		SampleRate;
 	int			bytesPerSample;
 	long int	numSamples;
 	long int	SamplesStart;
 	long int	samplesPosFLAC;
 	int			errorFLAC;
+	uint64_t	blocksizeFLAC;
 	double		framerate;
 	wav_hdr		header;
 	uint8_t		fmtExtra[24];
@@ -476,6 +541,9 @@ typedef struct AudioSt {
 	double		originalFrameRate;
 
 	AudioBlocks *Blocks;
+	BufferPool	pool;
+	SyncCache	syncCache;
+	PCMStream	stream;
 }  AudioSignal;
 
 /********************************************************/
@@ -488,10 +556,16 @@ typedef struct window_unit_st {
 	long int	clkAdjust;
 	long int	sizePadding;
 	long int	realMemSize;
+	double		S2;
+	double		coherentGain;
+	char		winType;
+	double		SampleRate;
+	int			ZeroPad;
+	struct window_unit_st *next;
 } windowUnit;
 
 typedef struct window_st {
-	windowUnit	*windowArray;
+	windowUnit	**windowArray;
 	int windowCount;
 	int MaxWindow;
 	double SampleRate;
@@ -543,12 +617,21 @@ typedef struct blk_diff_st {
 	long int		cntPhaseBlkDiff;
 	long int		cmpPhaseBlkDiff;
 
+	long int		size;	// entries reserved in each of the three arrays
+
 	int				type;
 	char			channel;
 } BlockDifference;
 
+typedef struct diff_arena_st {
+	char			*memory;
+	size_t			reserved;
+	size_t			used;
+} DifferenceArena;
+
 typedef struct block_diff_st {
 	BlockDifference	*BlockDiffArray;
+	DifferenceArena	arena;
 
 	long int		cntPerfectAmplMatch;
 	long int 		cntFreqAudioDiff;
@@ -651,9 +734,14 @@ typedef struct parameters_st {
 	int				weightedAveragePlot;
 	int				drawWindows;
 	int				outputCSV;
+	int				outputBinary;
 	int				whiteBG;
 	int				smallFile;
 	int				syncTolerance;
+	int				syncCorrelation;
+	int				useSyncCache;
+	int				streamPCM;
+	int				segmentFLAC;
 	int				usesStereo;
 	int				allowStereoVsMono;
 	double			AmpBarRange;
@@ -686,7 +774,6 @@ typedef struct parameters_st {
 	double			warningRatioTooHigh;
 	double			syncAlignPct[4];
 	int				syncAlignTolerance[4];
-	int				syncAlignIterator;
 
 	int				substractAveragePlot;
 	double			averageDifference;
@@ -695,9 +782,10 @@ typedef struct parameters_st {
 	double 			plotResX;
 	double			plotResY;
 
-	fftw_plan		sync_plan;
-	fftw_plan		model_plan;
-	fftw_plan		reverse_plan;
+	char			wisdomFile[BUFFER_SIZE];
+	int				singlePrecision;
+	double			singlePrecisionMaxDev;
+	long int		singlePrecisionBlocks;
 
 	double			refNoiseMin;
 	double			refNoiseMax;
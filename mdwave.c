@@ -40,10 +40,13 @@
 #include "balance.h"
 #include "loadfile.h"
 #include "profile.h"
+#include "fftplan.h"
+#include "pool.h"
+#include "synccache.h"
 
 int ProcessSignalMDW(AudioSignal *Signal, parameters *config);
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, long int size, double samplerate, double *window, parameters *config, int fftw_direction, AudioSignal *Signal);
-int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size, double samplerate, double *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal);
+int ExecuteDFFT(AudioBlocks *AudioArray, SampleValue *samples, long int size, double samplerate, double *window, parameters *config, int fftw_direction, AudioSignal *Signal);
+int ExecuteDFFTInternal(AudioBlocks *AudioArray, SampleValue *samples, long int size, double samplerate, double *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal);
 int commandline_wave(int argc , char *argv[], parameters *config);
 void PrintUsage_wave(void);
 void Header_wave(int log);
@@ -249,7 +252,6 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 {
 	long int		pos = 0;
 	double			longest = 0;
-	double			*sampleBuffer;
 	long int		sampleBufferSize = 0;
 	windowManager	windows;
 	double			*windowUsed = NULL;
@@ -270,12 +272,6 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 	}
 
 	sampleBufferSize = SecondsToSamples(Signal->SampleRate, longest, Signal->AudioChannels, NULL, NULL);
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
-	{
-		logmsg("\tERROR: malloc failed.\n");
-		return(0);
-	}
 
 	if(!initWindows(&windows, Signal->SampleRate, config->window, config))
 	{
@@ -335,13 +331,10 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 			break;
 		}
 
-		// Clean Buffer and fill it
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Signal->Samples + pos, loadedBlockSize*sizeof(double));
-
+		// The block is read in place, only loadedBlockSize-difference samples are used
 		if(Signal->Blocks[i].type >= TYPE_SILENCE && config->executefft)
 		{
-			if(!ExecuteDFFT(&Signal->Blocks[i], sampleBuffer, loadedBlockSize-difference, Signal->SampleRate, windowUsed, config, FORWARD_FFTW, Signal))
+			if(!ExecuteDFFT(&Signal->Blocks[i], Signal->Samples + pos, loadedBlockSize-difference, Signal->SampleRate, windowUsed, config, FORWARD_FFTW, Signal))
 				return 0;
 		}
 		
@@ -351,7 +344,7 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 				config->folderName, FOLDERCHAR, FOLDERCHAR, FOLDERCHAR,
 				i, SamplesForDisplay(pos+syncAdvance, Signal->AudioChannels), 
 				GetBlockName(config, i), GetBlockSubIndex(config, i));
-			SaveWAVEChunk(Name, Signal, sampleBuffer, 0, loadedBlockSize, 0, config); 
+			SaveWAVEChunk(Name, Signal, Signal->Samples + pos, 0, loadedBlockSize, 0, config); 
 		}
 
 		pos += loadedBlockSize;
@@ -382,6 +375,8 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 		i++;
 	}
 
+	FlushInternalSync(Signal, config);
+
 	if(config->executefft)
 	{
 		GlobalNormalize(Signal, config);
@@ -463,42 +458,39 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 				break;
 			}
 
-			// Clean Buffer and fill it
-			memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-			memcpy(sampleBuffer, Signal->Samples + pos, loadedBlockSize*sizeof(double));
-			// Empty original signal, and overlap
+			// Empty the overlap around the block
 			if(pos > 4 && pos+loadedBlockSize+discardSamples+4 <= Signal->numSamples)
-				memset(Signal->Samples + pos-4, 0, (loadedBlockSize+discardSamples+4)*sizeof(double));
-			else
-				memset(Signal->Samples + pos, 0, loadedBlockSize*sizeof(double));
-		
+			{
+				memset(Signal->Samples + pos-4, 0, 4*sizeof(SampleValue));
+				memset(Signal->Samples + pos+loadedBlockSize, 0, discardSamples*sizeof(SampleValue));
+			}
+
+			// The iFFT is written back in place, the samples past loadedBlockSize-difference are kept
 			if(Signal->Blocks[i].type >= TYPE_SILENCE)
 			{
-				if(!ExecuteDFFT(&Signal->Blocks[i], sampleBuffer, loadedBlockSize-difference, Signal->SampleRate, windowUsed, config, REVERSE_FFTW, Signal))
+				if(!ExecuteDFFT(&Signal->Blocks[i], Signal->Samples + pos, loadedBlockSize-difference, Signal->SampleRate, windowUsed, config, REVERSE_FFTW, Signal))
 					return 0;
 			}
 
+			// Control notes are emptied, sync pulses are kept for reference
 			if(Signal->Blocks[i].type < TYPE_SILENCE && !config->discardMDW)
 			{
-				if(Signal->Blocks[i].type != TYPE_SYNC)  // Copy control notes to discarded for reference
-					memcpy(sampleBuffer, Signal->Samples + pos, loadedBlockSize*sizeof(double));
+				if(Signal->Blocks[i].type != TYPE_SYNC)
+					memset(Signal->Samples + pos, 0, loadedBlockSize*sizeof(SampleValue));
 			}
 
-			// Fill back original signal with whatever we have in sampleBuffer
-			memcpy(Signal->Samples + pos, sampleBuffer, loadedBlockSize*sizeof(double));
-	
-			pos += loadedBlockSize;
-			pos += discardSamples;
-	
 			if(config->chunks && (Signal->Blocks[i].type >= TYPE_SILENCE || Signal->Blocks[i].type == TYPE_WATERMARK))
 			{
 				sprintf(tempName, "Chunks%cProcessed%c%03ld_%s_%s_%03d_chunk", FOLDERCHAR, FOLDERCHAR, i, 
 					GenerateFileNamePrefix(config), GetBlockName(config, i), 
 					GetBlockSubIndex(config, i));
 				ComposeFileName(Name, tempName, ".wav", config);
-				SaveWAVEChunk(Name, Signal, sampleBuffer, 0, loadedBlockSize, 0, config);
+				SaveWAVEChunk(Name, Signal, Signal->Samples + pos, 0, loadedBlockSize, 0, config);
 			}
 
+			pos += loadedBlockSize;
+			pos += discardSamples;
+
 			// Use original framerate for CD-DA chunks
 			if(Signal->Blocks[i].type == TYPE_INTERNAL_KNOWN || Signal->Blocks[i].type == TYPE_INTERNAL_UNKNOWN)
 				syncinternal = !syncinternal;
@@ -507,7 +499,7 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 		}
 
 		// clear the rest of the buffer
-		memset(Signal->Samples + pos, 0, (sizeof(double)*(Signal->numSamples - pos)));
+		memset(Signal->Samples + pos, 0, (sizeof(SampleValue)*(Signal->numSamples - pos)));
 
 		ComposeFileName(Name, GenerateFileNamePrefix(config), ".wav", config);
 		processed = fopen(Name, "wb");
@@ -552,13 +544,12 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 		logmsg(" - clk: iFFTW on Audio chunks took %0.2fs\n", elapsedSeconds);
 	}
 
-	free(sampleBuffer);
 	freeWindows(&windows);
 
 	return 1;
 }
 
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, long int size, double samplerate, double *window, parameters *config, int fftw_direction, AudioSignal *Signal)
+int ExecuteDFFT(AudioBlocks *AudioArray, SampleValue *samples, long int size, double samplerate, double *window, parameters *config, int fftw_direction, AudioSignal *Signal)
 {
 	int AudioChannels = Signal->AudioChannels;
 	char channel = CHANNEL_STEREO;
@@ -592,9 +583,8 @@ int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, long int size, double
 	return 1;
 }
 
-int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size, double samplerate, double *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal)
+int ExecuteDFFTInternal(AudioBlocks *AudioArray, SampleValue *samples, long int size, double samplerate, double *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal)
 {
-	fftw_plan		p = NULL, pBack = NULL;
 	long int		stereoSignalSize = 0, blanked = 0;	
 	long int		i = 0, monoSignalSize = 0, zeropadding = 0; 
 	double			*signal = NULL;
@@ -603,6 +593,7 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 	double			CutOff = 0;
 	long int		startBin = 0, endBin = 0;
 	int				AudioChannels = Signal->AudioChannels;
+	size_t			signalBytes = 0, spectrumBytes = 0;
 	
 	if(!AudioArray)
 	{
@@ -627,66 +618,23 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 	if(Signal->nyquistLimit && endBin > size/2)
 		endBin = ceil(size/2);
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+	signalBytes = sizeof(double)*(monoSignalSize+1);
+	spectrumBytes = sizeof(fftw_complex)*(monoSignalSize/2+1);
+	signal = (double*)PoolAlloc(&Signal->pool, signalBytes);
 	if(!signal)
 	{
-		logmsg("Not enough memory (malloc)\n");
+		logmsg("Not enough memory (fftw_malloc)\n");
 		return(0);
 	}
-	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
+	spectrum = (fftw_complex*)PoolAlloc(&Signal->pool, spectrumBytes);
 	if(!spectrum)
 	{
+		PoolFree(&Signal->pool, signal, signalBytes);
 		logmsg("Not enough memory (fftw_malloc)\n");
 		return(0);
 	}
 
-	if(!config->model_plan)
-	{
-		config->model_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->model_plan)
-		{
-			logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			return 0;
-		}
-	}
-
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-	if(!p)
-	{
-		logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-		free(signal);
-		signal = NULL;
-		return 0;
-	}
-
-	if(fftw_direction == REVERSE_FFTW)
-	{
-		if(!config->reverse_plan)
-		{
-			config->reverse_plan = fftw_plan_dft_c2r_1d(monoSignalSize, spectrum, signal, FFTW_MEASURE);
-			if(!config->reverse_plan)
-			{
-				logmsg("FFTW failed to create FFTW_MEASURE reverse plan\n");
-				free(signal);
-				signal = NULL;
-				return 0;
-			}
-		}
-		pBack = fftw_plan_dft_c2r_1d(monoSignalSize, spectrum, signal, FFTW_MEASURE);
-		if(!pBack)
-		{
-			logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			return 0;
-		}
-	}
-
-	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
-	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
-
+	// Deinterleave and window straight from the source, only the padding is cleared
 	for(i = 0; i < monoSignalSize - zeropadding; i++)
 	{
 		if(channel == CHANNEL_LEFT)
@@ -699,10 +647,14 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 		if(window)
 			signal[i] = signal[i]*window[i];
 	}
+	memset(signal+i, 0, sizeof(double)*(monoSignalSize+1-i));
 
-	fftw_execute(p); 
-	fftw_destroy_plan(p);
-	p = NULL;
+	if(!ExecuteRealToComplex(monoSignalSize, signal, spectrum, config))
+	{
+		PoolFree(&Signal->pool, signal, signalBytes);
+		PoolFree(&Signal->pool, spectrum, spectrumBytes);
+		return 0;
+	}
 
 	if(fftw_direction == FORWARD_FFTW)
 	{
@@ -736,6 +688,8 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 		if(!targetFreq)
 		{
 			logmsg("Invalid channel data\n");
+			PoolFree(&Signal->pool, signal, signalBytes);
+			PoolFree(&Signal->pool, spectrum, spectrumBytes);
 			return 0;
 		}
 
@@ -795,9 +749,12 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 		}
 		
 		// Magic! iFFTW
-		fftw_execute(pBack); 
-		fftw_destroy_plan(pBack);
-		pBack = NULL;
+		if(!ExecuteComplexToReal(monoSignalSize, spectrum, signal, config))
+		{
+			PoolFree(&Signal->pool, signal, signalBytes);
+			PoolFree(&Signal->pool, spectrum, spectrumBytes);
+			return 0;
+		}
 	
 		for(i = 0; i < monoSignalSize - zeropadding; i++)
 		{
@@ -819,10 +776,10 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 		//logmsg("Blanked %ld frequencies from a total of %ld\n", blanked, monoSignalSize/2);
 		if(blanked > config->maxBlanked)
 			config->maxBlanked = blanked;
-		fftw_free(spectrum);
+		PoolFree(&Signal->pool, spectrum, spectrumBytes);
 	}
 
-	free(signal);
+	PoolFree(&Signal->pool, signal, signalBytes);
 	signal = NULL;
 
 	return(1);
@@ -843,7 +800,7 @@ int commandline_wave(int argc , char *argv[], parameters *config)
 	config->useCompProfile = 0;
 	config->executefft = 1;
 
-	while ((c = getopt (argc, argv, "qnhvzcklyCBis:e:f:m:t:p:w:r:P:IY:T0:9")) != -1)
+	while ((c = getopt (argc, argv, "qnhvzcK:klyCBis:e:f:m:t:p:w:r:P:IY:T0:9")) != -1)
 	switch (c)
 	  {
 	  case 'h':
@@ -859,6 +816,9 @@ int commandline_wave(int argc , char *argv[], parameters *config)
 	  case 'c':
 		config->chunks = 1;
 		break;
+	  case 'K':
+		snprintf(config->wisdomFile, BUFFER_SIZE, "%s", optarg);
+		break;
 	  case 'k':
 		config->clock = 1;
 		break;
@@ -1107,6 +1067,7 @@ void PrintUsage_wave(void)
 	logmsg("	 -v: Enable <v>erbose mode, spits all the FFTW results\n");
 	logmsg("	 -l: Do not <l>og output to file [reference]_vs_[compare].txt\n");
 	logmsg("	 -k: cloc<k> FFTW operations\n");
+	logmsg("	 -K: Load and save FFTW wisdom from this file (default %s)\n", WISDOM_FILE);
 	logmsg("	 -0: Change output folder\n");
 }
 
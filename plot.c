@@ -248,6 +248,9 @@ void PlotResults(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, pa
 	MainPath = PushMainPath(config);
 	CurrentPath = GetCurrentPathAndChangeToResultsFolder(config);
 
+	if(config->outputBinary && !SaveBinaryDifferences(config->compareName, config))
+		logmsg(" - WARNING: Binary differences were not exported\n");
+
 	if(config->plotDifferences || config->averagePlot)
 	{
 		struct	timespec lstart, lend;
@@ -3399,13 +3402,10 @@ void VisualizeWindows(windowManager *wm, char *type, int role, parameters *confi
 		return;
 	for(int i = 0; i < wm->windowCount; i++)
 	{
-		//logmsg("Factor len %ld: %g\n", wm->windowArray[i].frames,
-			//CalculateCorrectionFactor(wm, wm->windowArray[i].frames));
-
-		//for(long int j = 0; j < wm->windowArray[i].size; j++)
-			//logmsg("Window %ld %g\n", j, wm->windowArray[i].window[j]);
+		//for(long int j = 0; j < wm->windowArray[i]->size; j++)
+			//logmsg("Window %ld %g\n", j, wm->windowArray[i]->window[j]);
 
-		PlotWindow(&wm->windowArray[i], i, role, type, wm->winType, config);
+		PlotWindow(wm->windowArray[i], i, role, type, wm->winType, config);
 	}
 	ReturnToMainPath(&returnFolder);
 	ReturnToMainPath(&CurrentPath);
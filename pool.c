@@ -0,0 +1,163 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+
+/*
+ * Per signal pool for the block FFT buffers. Requests are rounded up to
+ * a power of two size class, and released buffers are kept for the next
+ * block instead of going back to the system. Everything is freed in one
+ * go by ReleasePool from ReleaseAudio.
+ *
+ * A NULL pool falls back to fftw_malloc/fftw_free. Only buffers that
+ * came from the same pool can be returned to it, with the requested
+ * size. Pool buffers can still be released with fftw_free.
+ */
+
+#include "pool.h"
+#include "log.h"
+
+#define POOL_MIN_CLASS	12
+#define POOL_STEP		16
+
+static int GetPoolClass(size_t size)
+{
+	int	c = POOL_MIN_CLASS;
+
+	while(c < POOL_CLASSES - 1 && ((size_t)1 << c) < size)
+		c++;
+	return c;
+}
+
+void *PoolAlloc(BufferPool *pool, size_t size)
+{
+	int			c = 0;
+	void		*buffer = NULL;
+	PoolClass	*pc = NULL;
+
+	if(!pool)
+		return fftw_malloc(size);
+
+	c = GetPoolClass(size);
+	pc = &pool->classes[c];
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (buffer_pool)
+#endif
+	{
+		if(pc->count)
+		{
+			buffer = pc->buffers[--pc->count];
+			pool->reused++;
+		}
+		pool->inUseBytes += (size_t)1 << c;
+		if(pool->inUseBytes > pool->peakBytes)
+			pool->peakBytes = pool->inUseBytes;
+	}
+
+	if(!buffer)
+	{
+		buffer = fftw_malloc((size_t)1 << c);
+#ifdef OPENMP_ENABLE
+		#pragma omp critical (buffer_pool)
+#endif
+		{
+			if(buffer)
+				pool->allocations++;
+			else
+				pool->inUseBytes -= (size_t)1 << c;
+		}
+	}
+	return buffer;
+}
+
+void PoolFree(BufferPool *pool, void *buffer, size_t size)
+{
+	int			c = 0;
+	PoolClass	*pc = NULL;
+
+	if(!buffer)
+		return;
+
+	if(!pool)
+	{
+		fftw_free(buffer);
+		return;
+	}
+
+	c = GetPoolClass(size);
+	pc = &pool->classes[c];
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (buffer_pool)
+#endif
+	{
+		if(pc->count == pc->max)
+		{
+			void **tmp = NULL;
+
+			tmp = (void**)realloc(pc->buffers, sizeof(void*)*(pc->max + POOL_STEP));
+			if(tmp)
+			{
+				pc->buffers = tmp;
+				pc->max += POOL_STEP;
+			}
+		}
+		if(pc->count < pc->max)
+		{
+			pc->buffers[pc->count++] = buffer;
+			buffer = NULL;
+		}
+		if(pool->inUseBytes >= ((size_t)1 << c))
+			pool->inUseBytes -= (size_t)1 << c;
+	}
+
+	// no room to keep it
+	if(buffer)
+		fftw_free(buffer);
+}
+
+void ReleasePool(BufferPool *pool)
+{
+	if(!pool)
+		return;
+
+	for(int c = 0; c < POOL_CLASSES; c++)
+	{
+		for(int i = 0; i < pool->classes[c].count; i++)
+			fftw_free(pool->classes[c].buffers[i]);
+		free(pool->classes[c].buffers);
+	}
+	memset(pool, 0, sizeof(BufferPool));
+}
+
+void PrintPoolStats(BufferPool *pool, char *name)
+{
+	if(!pool)
+		return;
+
+	logmsg(" - %s buffer pool: %ld allocations, %ld reused, peak %0.2f MB\n",
+		name, pool->allocations, pool->reused, (double)pool->peakBytes/(1024.0*1024.0));
+}
@@ -0,0 +1,139 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+/*
+ * Ranking of the spectrum bins of a block, kept apart from freq.c so the
+ * selection can be checked and timed on its own (make ranktest).
+ */
+
+#include "spectrum.h"
+
+#define SORT_NAME FFT_Bin_Rank
+#define SORT_TYPE BinRank
+#define SORT_CMP(x, y)  (BIN_RANK_BEFORE(x, y) ? -1 : (BIN_RANK_BEFORE(y, x) ? 1 : 0))
+#include "sort.h"  // https://github.com/swenson/sort/
+
+static inline void SwapBins(BinRank *a, BinRank *b)
+{
+	BinRank tmp;
+
+	tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+/*
+	Moves the highest ranked 'amount' bins to the start of the array in
+	no particular order. Quickselect with a median of three pivot, falls
+	back to heap sort if the partitions go bad.
+*/
+void SelectTopBins(BinRank *bins, long int count, long int amount)
+{
+	long int	left = 0, right = count - 1;
+	int			depth = 0;
+
+	if(amount <= 0 || amount >= count)
+		return;
+
+	while(left < right)
+	{
+		long int	mid = 0, store = 0;
+		BinRank		pivot;
+
+		if(++depth > 64)
+		{
+			FFT_Bin_Rank_heap_sort(bins + left, right - left + 1);
+			return;
+		}
+
+		mid = left + (right - left)/2;
+		if(BIN_RANK_BEFORE(bins[mid], bins[left]))
+			SwapBins(&bins[mid], &bins[left]);
+		if(BIN_RANK_BEFORE(bins[right], bins[left]))
+			SwapBins(&bins[right], &bins[left]);
+		if(BIN_RANK_BEFORE(bins[right], bins[mid]))
+			SwapBins(&bins[right], &bins[mid]);
+
+		pivot = bins[mid];
+		SwapBins(&bins[mid], &bins[right]);
+		store = left;
+		for(long int i = left; i < right; i++)
+		{
+			if(BIN_RANK_BEFORE(bins[i], pivot))
+			{
+				SwapBins(&bins[i], &bins[store]);
+				store++;
+			}
+		}
+		SwapBins(&bins[store], &bins[right]);
+
+		if(store == amount)
+			return;
+		if(store > amount)
+			right = store - 1;
+		else
+			left = store + 1;
+	}
+}
+
+/*
+	Same math as CalculateMagnitude, kept branch free over contiguous
+	storage so the compiler vectorizes it (needs -fno-math-errno for sqrt)
+*/
+void CalculateBinMagnitudes(fftw_complex *spectrum, BinRank *bins, long int startBin, long int endBin, double ENBW)
+{
+	for(long int i = startBin; i < endBin; i++)
+	{
+		double r1 = 0, i1 = 0;
+
+		r1 = creal(spectrum[i]);
+		i1 = cimag(spectrum[i]);
+		bins[i-startBin].magnitude = (2*sqrt(r1*r1 + i1*i1))/ENBW;
+		bins[i-startBin].bin = i;
+	}
+}
+
+// Same magnitudes as a widened copy of the single precision spectrum
+void CalculateBinMagnitudesFloat(fftwf_complex *spectrum, BinRank *bins, long int startBin, long int endBin, double ENBW)
+{
+	for(long int i = startBin; i < endBin; i++)
+	{
+		double r1 = 0, i1 = 0;
+
+		r1 = crealf(spectrum[i]);
+		i1 = cimagf(spectrum[i]);
+		bins[i-startBin].magnitude = (2*sqrt(r1*r1 + i1*i1))/ENBW;
+		bins[i-startBin].bin = i;
+	}
+}
+
+// In rank order, stable so equal ranks keep their place
+void SortBins(BinRank *bins, long int count)
+{
+	FFT_Bin_Rank_tim_sort(bins, count);
+}
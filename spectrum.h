@@ -0,0 +1,51 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_SPECTRUM_H
+#define MDFOURIER_SPECTRUM_H
+
+#include "mdfourier.h"
+
+/*
+	Bins are ranked on a compact magnitude/bin pair array, the Frequency
+	structures are only built for the bins that are kept. Ties are broken
+	by the lower bin, which is the order a stable magnitude sort gives.
+*/
+typedef struct bin_rank_st {
+	double		magnitude;
+	long int	bin;
+} BinRank;
+
+#define BIN_RANK_BEFORE(x, y) ((x).magnitude > (y).magnitude || ((x).magnitude == (y).magnitude && (x).bin < (y).bin))
+
+void CalculateBinMagnitudes(fftw_complex *spectrum, BinRank *bins, long int startBin, long int endBin, double ENBW);
+void CalculateBinMagnitudesFloat(fftwf_complex *spectrum, BinRank *bins, long int startBin, long int endBin, double ENBW);
+void SelectTopBins(BinRank *bins, long int count, long int amount);
+void SortBins(BinRank *bins, long int count);
+
+#endif
@@ -0,0 +1,349 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library:
+ *	  http://www.fftw.org/
+ *
+ */
+
+/*
+ * Streamed signals reserve address space for all samples, but only the
+ * range in use is converted from disk. Pages that leave the range are
+ * handed back, so Signal->Samples keeps absolute positions for the rest
+ * of the code while the resident size stays that of the range.
+ */
+
+#include "stream.h"
+#include "log.h"
+#include "freq.h"
+#include "flac.h"
+#include "loadfile.h"
+
+#ifdef PCM_STREAM
+	#include <sys/mman.h>
+
+	#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+		#define MAP_ANONYMOUS MAP_ANON
+	#endif
+	#ifndef MAP_NORESERVE
+		#define MAP_NORESERVE 0
+	#endif
+#endif
+
+int CanStreamPCM(AudioSignal *Signal, parameters *config)
+{
+	if(!config->streamPCM)
+		return 0;
+
+#ifndef PCM_STREAM
+	(void)Signal;
+	logmsg(" - WARNING: Streaming is not available on this platform, loading the whole file\n");
+	return 0;
+#else
+	if(config->noSyncProfile)
+	{
+		logmsg(" - WARNING: Streaming needs a profile with sync pulses, loading the whole file\n");
+		return 0;
+	}
+
+	if(config->normType == max_time)
+	{
+		logmsg(" - WARNING: Time domain normalization needs the whole file, it will not be streamed\n");
+		return 0;
+	}
+
+	// Internal sync moves the rest of the file in memory after each sync block
+	for(int i = 0; i < config->types.totalBlocks; i++)
+	{
+		if(Signal->Blocks[i].type == TYPE_INTERNAL_KNOWN || Signal->Blocks[i].type == TYPE_INTERNAL_UNKNOWN)
+		{
+			logmsg(" - WARNING: Streaming is not possible with internal sync profiles, loading the whole file\n");
+			return 0;
+		}
+	}
+	return 1;
+#endif
+}
+
+// Header values must be loaded, no samples are read until requested
+int OpenPCMStream(AudioSignal *Signal, char *fileName)
+{
+#ifdef PCM_STREAM
+	PCMStream	*stream = &Signal->stream;
+	void		*map = NULL;
+	size_t		size = 0;
+
+	if(Signal->numSamples <= 0)
+		return 0;
+
+	memset(stream, 0, sizeof(PCMStream));
+	stream->isFlac = IsFlac(fileName);
+	if(!stream->isFlac)
+	{
+		stream->file = fopen(fileName, "rb");
+		if(!stream->file)
+			return 0;
+	}
+
+	size = sizeof(SampleValue)*Signal->numSamples;
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(map == MAP_FAILED)
+	{
+		if(stream->file)
+			fclose(stream->file);
+		memset(stream, 0, sizeof(PCMStream));
+		return 0;
+	}
+
+	Signal->Samples = (SampleValue*)map;
+	stream->reserved = size;
+	stream->gain[0] = 1.0;
+	stream->gain[1] = 1.0;
+	stream->active = 1;
+
+	logmsg(" - Streaming samples from disk as needed\n");
+	return 1;
+#else
+	(void)Signal;
+	(void)fileName;
+	return 0;
+#endif
+}
+
+void ClosePCMStream(AudioSignal *Signal)
+{
+	PCMStream	*stream = &Signal->stream;
+
+	if(!stream->active)
+		return;
+
+#ifdef PCM_STREAM
+	if(Signal->Samples)
+		munmap(Signal->Samples, stream->reserved);
+#endif
+	Signal->Samples = NULL;
+	if(stream->file)
+		fclose(stream->file);
+	memset(stream, 0, sizeof(PCMStream));
+}
+
+#ifdef PCM_STREAM
+static void ReleaseStreamRange(AudioSignal *Signal, long int first, long int last)
+{
+	if(last > first)
+		madvise(Signal->Samples + first, sizeof(SampleValue)*(last - first), MADV_DONTNEED);
+}
+
+// Same samples BalanceAudioChannel scales when the whole file is loaded
+static void ApplyStreamGain(AudioSignal *Signal, long int first, long int last)
+{
+	PCMStream	*stream = &Signal->stream;
+	SampleValue	*samples = Signal->Samples;
+	long int	i = 0, end = 0;
+
+	if(Signal->AudioChannels != 2 || (stream->gain[0] == 1.0 && stream->gain[1] == 1.0))
+		return;
+
+	i = first > stream->gainStart ? first : stream->gainStart;
+	i += (i - stream->gainStart) % 2;
+	end = last < stream->gainEnd ? last : stream->gainEnd;
+	for(; i < end; i += 2)
+	{
+		if(stream->gain[0] != 1.0)
+			samples[i] = samples[i]*stream->gain[0];
+		if(stream->gain[1] != 1.0)
+			samples[i+1] = samples[i+1]*stream->gain[1];
+	}
+}
+
+static int LoadStreamRange(AudioSignal *Signal, long int first, long int last)
+{
+	PCMStream	*stream = &Signal->stream;
+
+	if(last <= first)
+		return 1;
+
+	if(stream->isFlac)
+	{
+		FLACSegment	segment;
+
+		memset(&segment, 0, sizeof(FLACSegment));
+		segment.Signal = Signal;
+		segment.start = first/Signal->AudioChannels;
+		segment.end = last/Signal->AudioChannels;
+		if(!DecodeFLACSegment(Signal->SourceFile, &segment) || segment.written != segment.end - segment.start)
+		{
+			logmsg("\tERROR: Could not decode FLAC samples %ld to %ld (%s)\n",
+				SamplesForDisplay(first, Signal->AudioChannels), SamplesForDisplay(last, Signal->AudioChannels),
+				segment.errorStr[0] ? segment.errorStr : "incomplete");
+			return 0;
+		}
+	}
+	else
+	{
+		uint8_t		*fileBytes = NULL;
+		long int	blockSamples = 0;
+
+		if(fseek(stream->file, Signal->SamplesStart + first*Signal->bytesPerSample, SEEK_SET) != 0)
+		{
+			logmsg("\tERROR: Could not seek to sample %ld in audio file\n", SamplesForDisplay(first, Signal->AudioChannels));
+			return 0;
+		}
+
+		fileBytes = (uint8_t*)malloc(sizeof(uint8_t)*WAV_CONVERT_BLOCK);
+		if(!fileBytes)
+		{
+			logmsg("\tERROR: Sample block malloc failed! [WAV_CONVERT_BLOCK]\n");
+			return 0;
+		}
+
+		blockSamples = WAV_CONVERT_BLOCK/Signal->bytesPerSample;
+		for(long int pos = first; pos < last; pos += blockSamples)
+		{
+			long int	count = 0;
+
+			count = last - pos < blockSamples ? last - pos : blockSamples;
+			if(fread(fileBytes, 1, count*Signal->bytesPerSample, stream->file) != (size_t)(count*Signal->bytesPerSample) ||
+				!ConvertWAVBlock(fileBytes, Signal->Samples + pos, count, Signal->header.fmt.AudioFormat, Signal->bytesPerSample))
+			{
+				logmsg("\tERROR: Could not read samples %ld to %ld from audio file\n",
+					SamplesForDisplay(pos, Signal->AudioChannels), SamplesForDisplay(pos + count, Signal->AudioChannels));
+				free(fileBytes);
+				return 0;
+			}
+		}
+		free(fileBytes);
+	}
+
+	ApplyStreamGain(Signal, first, last);
+	stream->loaded += last - first;
+	return 1;
+}
+#endif
+
+/*
+	Makes [start, end) available in Signal->Samples and releases everything
+	else, start == end releases all. Only the parts that were not resident
+	are read, so moving forward block by block reads each sample once.
+*/
+int StreamSamples(AudioSignal *Signal, long int start, long int end)
+{
+#ifdef PCM_STREAM
+	PCMStream	*stream = &Signal->stream;
+	long int	page = 0, oldStart = 0, oldEnd = 0;
+	int			disjoint = 0;
+
+	if(!stream->active)
+		return 1;
+
+	// Whole pages, partial ones would be zeroed when released
+	page = sysconf(_SC_PAGESIZE)/sizeof(SampleValue);
+	if(page <= 0)
+		page = 512;
+	if(start < 0)
+		start = 0;
+	if(end > Signal->numSamples)
+		end = Signal->numSamples;
+	if(end <= start)
+		start = end = 0;
+	else
+	{
+		start -= start % page;
+		end += (page - end % page) % page;
+		if(end > Signal->numSamples)
+			end = Signal->numSamples;
+	}
+
+	oldStart = stream->residentStart;
+	oldEnd = stream->residentEnd;
+	disjoint = oldEnd <= oldStart || end <= start || end <= oldStart || start >= oldEnd;
+
+	if(disjoint)
+		ReleaseStreamRange(Signal, oldStart, oldEnd);
+	else
+	{
+		ReleaseStreamRange(Signal, oldStart, start);
+		ReleaseStreamRange(Signal, end, oldEnd);
+	}
+	stream->residentStart = stream->residentEnd = 0;
+
+	if(disjoint)
+	{
+		if(!LoadStreamRange(Signal, start, end))
+			return 0;
+	}
+	else
+	{
+		if(!LoadStreamRange(Signal, start, oldStart) || !LoadStreamRange(Signal, oldEnd, end))
+		{
+			ReleaseStreamRange(Signal, start, end);
+			return 0;
+		}
+	}
+
+	stream->residentStart = start;
+	stream->residentEnd = end;
+	if(end - start > stream->peakResident)
+		stream->peakResident = end - start;
+	return 1;
+#else
+	(void)Signal;
+	(void)start;
+	(void)end;
+	return 1;
+#endif
+}
+
+// Applied as samples are loaded, the ones already in memory are dropped and read again
+void SetStreamChannelGain(AudioSignal *Signal, int channel, double ratio)
+{
+	PCMStream	*stream = &Signal->stream;
+
+	StreamSamples(Signal, 0, 0);
+	stream->gain[channel == CHANNEL_LEFT ? 0 : 1] *= ratio;
+	stream->gainStart = Signal->startOffset;
+	stream->gainEnd = Signal->endOffset;
+}
+
+// The longest block plus the look ahead, at least two blocks per batch
+long int GetStreamWindowSamples(AudioSignal *Signal, long int longestBlock)
+{
+	long int	lookAhead = STREAM_LOOKAHEAD;
+
+	if(lookAhead < longestBlock)
+		lookAhead = longestBlock;
+	lookAhead -= lookAhead % Signal->AudioChannels;
+	return longestBlock + lookAhead;
+}
+
+void PrintStreamStats(AudioSignal *Signal)
+{
+	if(!Signal->stream.active)
+		return;
+
+	logmsg(" - %s stream: %0.2f MB converted, peak %0.2f MB resident of %0.2f MB\n",
+		Signal->role == ROLE_REF ? "Reference" : "Comparison",
+		(double)Signal->stream.loaded*sizeof(SampleValue)/(1024.0*1024.0),
+		(double)Signal->stream.peakResident*sizeof(SampleValue)/(1024.0*1024.0),
+		(double)Signal->stream.reserved/(1024.0*1024.0));
+}
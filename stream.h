@@ -0,0 +1,51 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library:
+ *	  http://www.fftw.org/
+ *
+ */
+
+#ifndef MDFOURIER_STREAM_H
+#define MDFOURIER_STREAM_H
+
+#include "mdfourier.h"
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__)
+	#define PCM_STREAM
+#endif
+
+// Samples kept ahead of the block being processed, so blocks can be transformed in parallel
+#define STREAM_LOOKAHEAD	(8*1024*1024)
+// Samples of the start pulse search kept in memory at a time
+#define STREAM_SYNC_WINDOW	(4*1024*1024)
+
+int CanStreamPCM(AudioSignal *Signal, parameters *config);
+int OpenPCMStream(AudioSignal *Signal, char *fileName);
+void ClosePCMStream(AudioSignal *Signal);
+int StreamSamples(AudioSignal *Signal, long int start, long int end);
+void SetStreamChannelGain(AudioSignal *Signal, int channel, double ratio);
+long int GetStreamWindowSamples(AudioSignal *Signal, long int longestBlock);
+void PrintStreamStats(AudioSignal *Signal);
+
+#endif
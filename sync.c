@@ -30,6 +30,7 @@
 #include "sync.h"
 #include "log.h"
 #include "freq.h"
+#include "fftplan.h"
 
 /*
 	There are the number of subdivisions to use. 
@@ -44,41 +45,211 @@
 // Cut off for harmonic search
 #define HARMONIC_TSHLD 6000
 
-long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *config)
+// Largest chunk correlated directly, and rounding margin for the energy test
+#define SYNC_DFT_MAX_SIZE	64
+#define SYNC_DOMINANCE_EPS	1e-9
+
+// Coarse sync search: sync bin share of the energy and level relative to the loudest cell
+#define SYNC_PYRAMID_RATIO		0.5
+#define SYNC_PYRAMID_FLOOR		0.001
+#define SYNC_PYRAMID_CANDIDATES	8
+
+// Correlation sync: positions scored per segment, resync period for the phasors,
+// share of the best score for the first peak and share of the train energy in the pulses
+#define SYNC_CORR_SEGMENT	262144
+#define SYNC_CORR_RESYNC	1024
+#define SYNC_CORR_PEAK		0.5
+#define SYNC_CORR_RATIO		0.75
+
+// Audio before the signal that can hold the start pulse, same criteria as DetectPulseInternal
+double GetStartPulseSearchSeconds(wav_hdr header, int role, parameters *config)
 {
-	int			maxdetected = 0, AudioChannels = 0;
-	long int	sampleOffset = 0, searchOffset = 0;
+	double	fileSeconds = 0, expected = 0, syncLen = 0, silenceLen = 0;
+
+	fileSeconds = (double)(header.data.DataSize/(header.fmt.bitsPerSample/8))/((double)header.fmt.SamplesPerSec*header.fmt.NumOfChan);
+	expected = GetSignalTotalDuration(GetMSPerFrameRole(role, config), config);
+	syncLen = GetFirstSyncDuration(GetMSPerFrameRole(role, config), config);
+	silenceLen = GetFirstSilenceDuration(GetMSPerFrameRole(role, config), config);
+
+	if(expected + syncLen + silenceLen/2 < fileSeconds)
+		fileSeconds = fileSeconds - expected + syncLen + silenceLen/2;
+	return fileSeconds;
+}
+
+// Leading or trailing audio much longer than the signal
+int IsLongCapture(wav_hdr header, int role, parameters *config)
+{
+	return(GetSignalTotalDuration(GetMSPerFrameRole(role, config), config)*1.5 < GetStartPulseSearchSeconds(header, role, config));
+}
+
+// Audio the start pulse detection reads, with one more train for the length checks
+long int GetStartPulseSearchEnd(wav_hdr header, int role, parameters *config)
+{
+	double		syncLen = 0;
+	long int	endSearch = 0, totalSamples = 0;
+
+	totalSamples = header.data.DataSize/(header.fmt.bitsPerSample/8);
+	syncLen = GetFirstSyncDuration(GetMSPerFrameRole(role, config), config);
+	endSearch = SecondsToSamples(header.fmt.SamplesPerSec, GetStartPulseSearchSeconds(header, role, config) + 2*syncLen, header.fmt.NumOfChan, NULL, NULL);
+	if(endSearch > totalSamples)
+		endSearch = totalSamples;
+	return endSearch;
+}
+
+// Window around the expected closing silence, every retry offset starts within it
+void GetEndPulseSearchRange(long int startpulse, wav_hdr header, int role, long int *startSearch, long int *endSearch, parameters *config)
+{
+	long int	totalSamples = 0;
+
+	totalSamples = header.data.DataSize/(header.fmt.bitsPerSample/8);
+	*startSearch = GetSecondSyncSilenceSampleOffset(GetMSPerFrameRole(role, config), header, 0, -4.0, config) + startpulse;
+	*endSearch = GetSecondSyncSilenceSampleOffset(GetMSPerFrameRole(role, config), header, 0, 4.0, config) + startpulse;
+	*endSearch += 2*SecondsToSamples(header.fmt.SamplesPerSec, GetLastSyncDuration(GetMSPerFrameRole(role, config), config), header.fmt.NumOfChan, NULL, NULL);
+	if(*startSearch < startpulse)
+		*startSearch = startpulse;
+	if(*endSearch > totalSamples)
+		*endSearch = totalSamples;
+}
+
+static long int AdjustStartPulse(SampleValue *AllSamples, wav_hdr header, long int sampleOffset, int role, int AudioChannels, parameters *config);
+
+long int DetectPulse(SampleValue *AllSamples, wav_hdr header, int role, parameters *config)
+{
+	int			maxdetected = 0, AudioChannels = 0, coarseDone = 0, longCapture = 0;
+	long int	sampleOffset = -1, totalSamples = 0;
 
 	if(config->debugSync)
 		logmsgFileOnly("\nStarting Detect start pulse\n");
 
 	AudioChannels = header.fmt.NumOfChan;
+	totalSamples = header.data.DataSize/(header.fmt.bitsPerSample/8);
 
-	sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, 0, &maxdetected, role, AudioChannels, config);
-	if(sampleOffset == -1)
+	longCapture = IsLongCapture(header, role, config);
+	if(longCapture)
+#ifdef OPENMP_ENABLE
+		#pragma omp atomic write
+#endif
+		config->trimmingNeeded = 1;
+
+	if(config->syncCorrelation)
 	{
-		if(config->debugSync)
-			logmsgFileOnly("WARNING SYNC: First round start pulse failed\n");
+		double		syncLen = 0;
+		long int	endSearch = 0;
+
+		// The whole train has to fit, so one more sync length is scanned
+		syncLen = GetFirstSyncDuration(GetMSPerFrameRole(role, config), config);
+		endSearch = SecondsToSamples(header.fmt.SamplesPerSec, GetStartPulseSearchSeconds(header, role, config) + syncLen, AudioChannels, NULL, NULL);
+		if(endSearch > totalSamples)
+			endSearch = totalSamples;
+		sampleOffset = DetectPulseCorrelation(AllSamples, header, 0, endSearch, syncLen, role, AudioChannels, config);
+		if(sampleOffset == -1 && config->debugSync)
+			logmsgFileOnly("WARNING SYNC: Start pulse correlation failed, scanning pulses\n");
+	}
 
-		// Find out a new starting point where some soudn starts
-		searchOffset = DetectSignalStart(AllSamples, header, 0, 0, 0, NULL, NULL, config);
-		if (searchOffset > 0)
-		{
-			long int MS_Samples = 0;
+	// Long silences before or after, scanning all of it at full resolution is slow
+	if(sampleOffset == -1 && longCapture)
+	{
+		sampleOffset = DetectPulseCoarse(AllSamples, header, FACTOR_EXPLORE, 0, totalSamples, &maxdetected, role, AudioChannels, config);
+		coarseDone = 1;
+	}
 
-			MS_Samples = SecondsToSamples(header.fmt.SamplesPerSec, 0.015, AudioChannels, NULL, NULL);
-			if (searchOffset >= MS_Samples)
-				searchOffset -= MS_Samples;
-		}
-		else
-			return -1;
+	if(sampleOffset == -1)
+		sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, 0, &maxdetected, role, AudioChannels, config);
+	if(sampleOffset == -1 && !coarseDone)
+		sampleOffset = DetectPulseCoarse(AllSamples, header, FACTOR_EXPLORE, 0, totalSamples, &maxdetected, role, AudioChannels, config);
+	if(sampleOffset == -1)
+		return(DetectPulseAfterSignalStart(AllSamples, header, role, config));
 
-		sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, searchOffset, &maxdetected, role, AudioChannels, config);
-		if(sampleOffset == -1)
-			return -1;
+	return(AdjustStartPulse(AllSamples, header, sampleOffset, role, AudioChannels, config));
+}
+
+/*
+	DetectPulse for streamed signals, which only hold part of the file. The
+	pulse train is located within [startSample, endSample), GetPulseReadMargins
+	has the audio read around it. DetectPulseAfterSignalStart is the last resort.
+*/
+long int DetectPulseInRange(SampleValue *AllSamples, wav_hdr header, long int startSample, long int endSample, int role, parameters *config)
+{
+	int			maxdetected = 0, AudioChannels = 0;
+	long int	sampleOffset = -1;
+
+	AudioChannels = header.fmt.NumOfChan;
+	if(config->debugSync)
+		logmsgFileOnly("\nStarting Detect start pulse in %ld-%ld\n", SamplesForDisplay(startSample, AudioChannels),
+			SamplesForDisplay(endSample, AudioChannels));
+
+	if(config->syncCorrelation)
+		sampleOffset = DetectPulseCorrelation(AllSamples, header, startSample, endSample,
+							GetFirstSyncDuration(GetMSPerFrameRole(role, config), config), role, AudioChannels, config);
+	// The full resolution scan covers the whole lead, only short captures are read at once
+	if(sampleOffset == -1 && !startSample && !IsLongCapture(header, role, config))
+		sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, 0, &maxdetected, role, AudioChannels, config);
+	if(sampleOffset == -1)
+		sampleOffset = DetectPulseCoarse(AllSamples, header, FACTOR_EXPLORE, startSample, endSample, &maxdetected, role, AudioChannels, config);
+	if(sampleOffset == -1)
+		return -1;
+
+	return(AdjustStartPulse(AllSamples, header, sampleOffset, role, AudioChannels, config));
+}
+
+// Last resort, the pulse train right after the first sound
+long int DetectPulseAfterSignalStart(SampleValue *AllSamples, wav_hdr header, int role, parameters *config)
+{
+	int			maxdetected = 0, AudioChannels = 0;
+	long int	sampleOffset = -1, searchOffset = 0;
+
+	if(config->debugSync)
+		logmsgFileOnly("WARNING SYNC: First round start pulse failed\n");
+
+	AudioChannels = header.fmt.NumOfChan;
+	// Find out a new starting point where some sound starts
+	searchOffset = DetectSignalStart(AllSamples, header, 0, 0, 0, NULL, NULL, config);
+	if(searchOffset > 0)
+	{
+		long int MS_Samples = 0;
+
+		MS_Samples = SecondsToSamples(header.fmt.SamplesPerSec, 0.015, AudioChannels, NULL, NULL);
+		if (searchOffset >= MS_Samples)
+			searchOffset -= MS_Samples;
 	}
+	else
+		return -1;
+
+	sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, searchOffset, &maxdetected, role, AudioChannels, config);
+	if(sampleOffset == -1)
+		return -1;
+	return(AdjustStartPulse(AllSamples, header, sampleOffset, role, AudioChannels, config));
+}
+
+// DetectSignalStart only looks at the first sixth of the file when started at zero
+long int GetSignalStartSearchEnd(wav_hdr header, int role, parameters *config)
+{
+	long int	before = 0, after = 0, totalSamples = 0;
+
+	totalSamples = header.data.DataSize/(header.fmt.bitsPerSample/8);
+	GetPulseReadMargins(header, role, &before, &after, config);
+	return(totalSamples/6 + after);
+}
+
+// Before the range: the coarse search lead and one pulse for the length adjustment. After it: a whole scan
+void GetPulseReadMargins(wav_hdr header, int role, long int *before, long int *after, parameters *config)
+{
+	double	syncLen = 0, pulseLen = 0;
+
+	syncLen = GetFirstSyncDuration(GetMSPerFrameRole(role, config), config);
+	if(GetLastSyncDuration(GetMSPerFrameRole(role, config), config) > syncLen)
+		syncLen = GetLastSyncDuration(GetMSPerFrameRole(role, config), config);
+	pulseLen = FramesToSeconds(1, GetMSPerFrameRole(role, config));
 
-	searchOffset = AdjustPulseSampleStartByLength(AllSamples, header, sampleOffset, role, AudioChannels, config);
+	*before = SecondsToSamples(header.fmt.SamplesPerSec, pulseLen + 0.030, header.fmt.NumOfChan, NULL, NULL);
+	*after = SecondsToSamples(header.fmt.SamplesPerSec, 2*syncLen, header.fmt.NumOfChan, NULL, NULL);
+}
+
+static long int AdjustStartPulse(SampleValue *AllSamples, wav_hdr header, long int sampleOffset, int role, int AudioChannels, parameters *config)
+{
+	long int searchOffset = 0;
+
+	searchOffset = AdjustPulseSampleStartByLength(AllSamples, header, sampleOffset, role, SYNC_ALIGN_SLOT(role, 0), AudioChannels, config);
 	if (searchOffset != -1 && searchOffset != sampleOffset)
 	{
 		if (config->debugSync)
@@ -112,11 +283,38 @@ long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *c
 								-0.9, -0.8, -0.7, -0.6, -1.6, -1.7, -1.8, -1.9,\
 								-0.4, -0.3, -0.2, -0.1, -1.1, -1.2, -1.3, -1.4 }
 
-long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header, int role, parameters *config)
+long int AdjustEndPulse(SampleValue *AllSamples, wav_hdr header, long int sampleOffset, int role, int AudioChannels, parameters *config)
+{
+	long int searchOffset = 0;
+
+	searchOffset = AdjustPulseSampleStartByLength(AllSamples, header, sampleOffset, role, SYNC_ALIGN_SLOT(role, 1), AudioChannels, config);
+	if (searchOffset != -1 && searchOffset != sampleOffset)
+	{
+		if (config->debugSync)
+			logmsg("    SYNC: Adjusted pulse sample start from %ld to %ld",
+				SamplesForDisplay(sampleOffset, AudioChannels), SamplesForDisplay(searchOffset, AudioChannels));
+		sampleOffset = searchOffset;
+	}
+	return sampleOffset;
+}
+
+static inline int IsEndPulseCandidate(long int sampleOffset, int pastSilence, long int secondSilenceStart, long int totalSamples)
+{
+	if(sampleOffset >= totalSamples)
+		return 0;
+	if(pastSilence)
+		return sampleOffset >= secondSilenceStart;
+	return sampleOffset < secondSilenceStart;
+}
+
+long int DetectEndPulse(SampleValue *AllSamples, long int startpulse, wav_hdr header, int role, parameters *config)
 {
 	int			maxdetected = 0, frameAdjust = 0, tries = 0, maxtries = END_SYNC_MAX_TRIES;
-	int			factor = 0, AudioChannels = 0, bytesPerSample = 0;
+	int			factor = 0, AudioChannels = 0, bytesPerSample = 0, candidates = 0, found = 0, i = 0;
+	int			*detected = NULL;
 	long int 	sampleOffset = 0, searchOffset = -1, totalSamples = 0, secondSilenceStart = 0;
+	long int	startSearch = 0, endSearch = 0, *offsets = NULL, *results = NULL;
+	LogBuffer	*logs = NULL;
 	double		silenceOffset[END_SYNC_MAX_TRIES] = END_SYNC_VALUES;
 
 	bytesPerSample = header.fmt.bitsPerSample / 8;
@@ -127,6 +325,19 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 		factor = FACTOR_LFEXPL;
 	else
 		factor = FACTOR_EXPLORE;
+
+	/* Window around the expected closing silence */
+	GetEndPulseSearchRange(startpulse, header, role, &startSearch, &endSearch, config);
+
+	if(config->syncCorrelation && startSearch < endSearch)
+	{
+		searchOffset = DetectPulseCorrelation(AllSamples, header, startSearch, endSearch, GetLastSyncDuration(GetMSPerFrameRole(role, config), config), role, AudioChannels, config);
+		if(searchOffset != -1)
+			return(AdjustEndPulse(AllSamples, header, searchOffset, role, AudioChannels, config));
+		if(config->debugSync)
+			logmsgFileOnly("WARNING SYNC: End pulse correlation failed, scanning pulses\n");
+	}
+
 	/* Try a clean detection */
 	sampleOffset = GetSecondSyncSilenceSampleOffset(GetMSPerFrameRole(role, config), header, 0, 1, config);
 	if(!sampleOffset)
@@ -142,18 +353,7 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 			logmsgFileOnly("\nStarting CLEAN Detect end pulse with sample offset %ld\n", SamplesForDisplay(sampleOffset, AudioChannels));
 		searchOffset = DetectPulseInternal(AllSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
 		if(searchOffset != -1)
-		{
-			sampleOffset = searchOffset;
-			searchOffset = AdjustPulseSampleStartByLength(AllSamples, header, searchOffset, role, AudioChannels, config);
-			if (searchOffset != -1 && searchOffset != sampleOffset)
-			{
-				if (config->debugSync)
-					logmsg("    SYNC: Adjusted pulse sample start from %ld to %ld",
-						SamplesForDisplay(sampleOffset, AudioChannels), SamplesForDisplay(searchOffset, AudioChannels));
-				sampleOffset = searchOffset;
-			}
-			return sampleOffset;
-		}
+			return(AdjustEndPulse(AllSamples, header, searchOffset, role, AudioChannels, config));
 
 	
 		/* We try to figure out position of the pulses, things are not fine with this recording, profile selected, framerate, etc */
@@ -166,82 +366,126 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 			logmsgFileOnly("End pulse CLEAN detection out of bounds at %ld samples\n", SamplesForDisplay(sampleOffset, AudioChannels));
 	}
 
-	do
+	/* Locate the closing pulse train around the expected silence before trying offsets one by one */
+	if(startSearch < endSearch)
+	{
+		searchOffset = DetectPulseCoarse(AllSamples, header, factor, startSearch, endSearch, &maxdetected, role, AudioChannels, config);
+		if(searchOffset != -1)
+			return(AdjustEndPulse(AllSamples, header, searchOffset, role, AudioChannels, config));
+	}
+
+	/*
+		Each entry in the table is an independent scan, first the ones before
+		the expected silence and then the ones at or after it. They are run in
+		parallel and the earliest success in that order wins, later entries are
+		skipped once it is known. Logs are replayed in table order.
+	*/
+	candidates = 2*maxtries;
+	offsets = (long int*)malloc(sizeof(long int)*candidates);
+	results = (long int*)malloc(sizeof(long int)*candidates);
+	detected = (int*)calloc(candidates, sizeof(int));
+	logs = (LogBuffer*)calloc(candidates, sizeof(LogBuffer));
+	if(!offsets || !results || !detected || !logs)
+	{
+		logmsg("\tEnd pulse malloc failed!\n");
+		free(offsets);
+		free(results);
+		free(detected);
+		free(logs);
+		return -1;
+	}
+
+	for(i = 0; i < candidates; i++)
 	{
-		/* Use defaults to calculate real frame rate but don't go further than silence*/
-		sampleOffset = GetSecondSyncSilenceSampleOffset(GetMSPerFrameRole(role, config), header, frameAdjust, silenceOffset[tries], config) + startpulse;
-		if(sampleOffset < secondSilenceStart && sampleOffset < totalSamples)
+		/* Use defaults to calculate real frame rate */
+		offsets[i] = GetSecondSyncSilenceSampleOffset(GetMSPerFrameRole(role, config), header, frameAdjust, silenceOffset[i % maxtries], config) + startpulse;
+		results[i] = -1;
+	}
+
+	found = candidates;
+#ifdef OPENMP_ENABLE
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for(i = 0; i < candidates; i++)
+	{
+		int			earliest = 0;
+		LogBuffer	*previousLog = NULL;
+
+		// Same section as the update, a critical section does not order atomic accesses
+#ifdef OPENMP_ENABLE
+		#pragma omp critical (end_pulse_found)
+#endif
+		earliest = found;
+		if(i > earliest || !IsEndPulseCandidate(offsets[i], i >= maxtries, secondSilenceStart, totalSamples))
+			continue;
+
+		previousLog = GetLogBuffer();
+		SetLogBuffer(&logs[i]);
+		results[i] = DetectPulseInternal(AllSamples, header, factor, offsets[i], &detected[i], role, AudioChannels, config);
+		if(results[i] == -1 && !detected[i])
 		{
 			if(config->debugSync)
-				logmsgFileOnly("\nFile %s\nStarting Detect end pulse #%d with sample offset %ld [%g silence]\n\tMaxDetected %d frameAdjust: %d\n",
-					GetFileName(role, config), tries + 1, SamplesForDisplay(sampleOffset, AudioChannels), silenceOffset[tries], maxdetected, frameAdjust);
-	
-			frameAdjust = 0;
-			maxdetected = 0;
-
-			searchOffset = DetectPulseInternal(AllSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
-			if(searchOffset == -1 && !maxdetected)
-			{
-				if(config->debugSync)
-					logmsgFileOnly("End pulse failed try #%d, started search at %ld samples [%g silence]\n",
-						tries+1, SamplesForDisplay(sampleOffset, AudioChannels), silenceOffset[tries]);
-			}
+				logmsgFileOnly("End pulse failed try #%d, started search at %ld samples [%g silence]\n",
+					i % maxtries + 1, SamplesForDisplay(offsets[i], AudioChannels), silenceOffset[i % maxtries]);
 		}
-		else
+		SetLogBuffer(previousLog);
+
+		if(results[i] != -1)
 		{
-			if(sampleOffset > totalSamples && config->debugSync)
-				logmsgFileOnly("End pulse try #%d detection out of bounds at %ld samples\n", tries+1, SamplesForDisplay(sampleOffset, AudioChannels));
+#ifdef OPENMP_ENABLE
+			#pragma omp critical (end_pulse_found)
+#endif
+			if(i < found)
+				found = i;
 		}
+	}
 
-		tries ++;
-	}while(searchOffset == -1 && tries < maxtries);
-
-	if(searchOffset == -1)
+	for(i = 0; i < candidates; i++)
 	{
-		tries = 0;
-		do
+		if(i > found)
 		{
-			/* Use defaults to calculate real frame rate further back than silence... */
-			sampleOffset = GetSecondSyncSilenceSampleOffset(GetMSPerFrameRole(role, config), header, frameAdjust, silenceOffset[tries], config) + startpulse;
-			if(sampleOffset >= secondSilenceStart && sampleOffset < totalSamples)
-			{
-				if(config->debugSync)
-					logmsgFileOnly("\nFile %s\nStarting Detect end pulse #%d with sample offset %ld [%g silence]\n\tMaxDetected %d frameAdjust: %d\n",
-						GetFileName(role, config), tries + 1, SamplesForDisplay(sampleOffset, AudioChannels), silenceOffset[tries], maxdetected, frameAdjust);
-	
-				frameAdjust = 0;
-				maxdetected = 0;
+			ReleaseLogBuffer(&logs[i]);
+			continue;
+		}
 
-				searchOffset = DetectPulseInternal(AllSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
-				if(searchOffset == -1 && !maxdetected)
-				{
-					if(config->debugSync)
-						logmsgFileOnly("End pulse failed try #%d, started search at %ld samples [%g silence]\n",
-						tries+1, SamplesForDisplay(sampleOffset, AudioChannels), silenceOffset[tries]);
-				}
-			}
-			else
+		tries = i % maxtries;
+		if(IsEndPulseCandidate(offsets[i], i >= maxtries, secondSilenceStart, totalSamples))
+		{
+			if(config->debugSync)
+				logmsgFileOnly("\nFile %s\nStarting Detect end pulse #%d with sample offset %ld [%g silence]\n\tMaxDetected %d frameAdjust: %d\n",
+					GetFileName(role, config), tries + 1, SamplesForDisplay(offsets[i], AudioChannels), silenceOffset[tries], maxdetected, frameAdjust);
+			FlushLogBuffer(&logs[i]);
+			maxdetected = detected[i];
+		}
+		else
+		{
+			if(offsets[i] > totalSamples && config->debugSync)
 			{
-				if(sampleOffset > totalSamples && config->debugSync)
-					logmsgFileOnly("End pulse #%d detection out of bounds at %ld samples\n", tries+1, SamplesForDisplay(sampleOffset, AudioChannels));
+				if(i < maxtries)
+					logmsgFileOnly("End pulse try #%d detection out of bounds at %ld samples\n", tries+1, SamplesForDisplay(offsets[i], AudioChannels));
+				else
+					logmsgFileOnly("End pulse #%d detection out of bounds at %ld samples\n", tries+1, SamplesForDisplay(offsets[i], AudioChannels));
 			}
+		}
+	}
 
-			tries ++;
-		}while(searchOffset == -1 && tries < maxtries);
+	if(found < candidates)
+	{
+		searchOffset = results[found];
+		tries = found % maxtries + 1;
 	}
+	else
+		tries = maxtries;
+
+	free(offsets);
+	free(results);
+	free(detected);
+	free(logs);
 
 	if(tries >= maxtries)
 		return -1;
 
-	sampleOffset = searchOffset;
-	searchOffset = AdjustPulseSampleStartByLength(AllSamples, header, sampleOffset, role, AudioChannels, config);
-	if (searchOffset != -1 && searchOffset != sampleOffset)
-	{
-		if (config->debugSync)
-			logmsg("    SYNC: Adjusted pulse sample start from %ld to %ld",
-				SamplesForDisplay(sampleOffset, AudioChannels), SamplesForDisplay(searchOffset, AudioChannels));
-		sampleOffset = searchOffset;
-	}
+	sampleOffset = AdjustEndPulse(AllSamples, header, searchOffset, role, AudioChannels, config);
 	if(config->debugSync)
 		logmsgFileOnly("End pulse return value %ld\n", SamplesForDisplay(sampleOffset, AudioChannels));
 
@@ -623,13 +867,14 @@ long int DetectPulseTrainSequence(Pulses *pulseArray, double targetFrequency, do
 	return -1;
 }
 
-long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters* config)
+long int AdjustPulseSampleStartByLength(SampleValue *Samples, wav_hdr header, long int offset, int role, int alignSlot, int AudioChannels, parameters* config)
 {
 	int			samplesNeeded = 0, frequency = 0, startDetectPos = -1, endDetectPos = -1, bytesPerSample = 0;
 	long int	startSearch = 0, endSearch = 0, pos = 0, count = 0, foundPos = -1, totalSamples = 0;
 	long int	synLenInSamples = 0, matchCount = 0, tolerance = 0;
-	double*		buffer = NULL, percentSTD = 0;
+	double		percentSTD = 0;
 	Pulses*		pulseArray = NULL;
+	SyncDetector detector;
 	double		targetFrequency = 0;
 	double		syncLen = 0, averageMag = 0, standardDeviation = 0, compareMag = 0;
 
@@ -651,13 +896,6 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 
 	synLenInSamples = RoundToNsamples(((double)header.fmt.SamplesPerSec*syncLen*AudioChannels) / 1000.0, AudioChannels, NULL, NULL);
 
-	buffer = (double*)malloc(samplesNeeded * sizeof(double));
-	if (!buffer)
-	{
-		logmsgFileOnly("\tERROR: Sync Adjust malloc failed\n");
-		return(foundPos);
-	}
-
 	if (offset >= synLenInSamples)
 	{
 		startSearch = offset - synLenInSamples;
@@ -679,16 +917,20 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 	pulseArray = (Pulses*)malloc(sizeof(Pulses) * (endSearch - startSearch));
 	if (!pulseArray)
 	{
-		free(buffer);
 		logmsgFileOnly("\tPulse malloc failed!\n");
 		return(foundPos);
 	}
 	memset(pulseArray, 0, sizeof(Pulses) * (endSearch - startSearch));
 
+	if (!InitSyncDetector(&detector, samplesNeeded, header.fmt.SamplesPerSec, AudioChannels, targetFrequency, NULL, config))
+	{
+		free(pulseArray);
+		return(foundPos);
+	}
+
 	// we are counting inn samples, not bytes
 	for (pos = startSearch; pos < endSearch; pos += AudioChannels)
 	{
-		memset(buffer, 0, samplesNeeded * sizeof(double));
 		if (pos + samplesNeeded > totalSamples)
 		{
 			//logmsg("\tUnexpected end of File, please record the full Audio Test from the 240p Test Suite\n");
@@ -696,12 +938,11 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 		}
 
 		pulseArray[count].samples = pos;
-		memcpy(buffer, Samples + pos, samplesNeeded * sizeof(double));
-		ProcessChunkForSyncPulse(buffer, samplesNeeded,
-			header.fmt.SamplesPerSec, &pulseArray[count],
+		ProcessChunkForSyncPulse(&detector, Samples + pos, &pulseArray[count],
 			CHANNEL_LEFT, AudioChannels, config);
 		count++;
 	}
+	ReleaseSyncDetector(&detector);
 
 	// Calculate Average
 	for (pos = 0; pos < count; pos++)
@@ -716,7 +957,6 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 	if (!matchCount)
 	{
 		logmsgFileOnly("\tERROR: Sync Adjustment, no matches at %g\n", targetFrequency);
-		free(buffer);
 		free(pulseArray);
 		return(foundPos);
 	}
@@ -736,7 +976,6 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 	if (!matchCount)
 	{
 		logmsgFileOnly("\tERROR: Sync Adjustment, no matches at for std dev %g\n", targetFrequency);
-		free(buffer);
 		free(pulseArray);
 		return(foundPos);
 	}
@@ -756,7 +995,7 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 		compareMag = averageMag - standardDeviation/4;
 	if(percentSTD >= 100)						// least common
 		compareMag = averageMag - standardDeviation/5;
-	config->syncAlignPct[config->syncAlignIterator] = percentSTD;
+	config->syncAlignPct[alignSlot] = percentSTD;
 
 	if (config->debugSync)
 		logmsgFileOnly("Adjust Sync %g%% AVG: %g STD: %g Used: %g\n", percentSTD, averageMag, standardDeviation, compareMag);
@@ -879,8 +1118,8 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 				if (newFoundPos != foundPos)
 				{
 					foundPos = newFoundPos;
-					config->syncAlignTolerance[config->syncAlignIterator] = 1;
-					config->syncAlignPct[config->syncAlignIterator] = percent;
+					config->syncAlignTolerance[alignSlot] = 1;
+					config->syncAlignPct[alignSlot] = percent;
 					if (config->debugSync)
 						logmsg("WARNING: Had to adjust sync pulse start due to %g%% pulse length difference from %ld samples to %ld samples\n", percent,
 							SamplesForDisplay(pulseArray[startDetectPos].samples, AudioChannels), SamplesForDisplay(foundPos, AudioChannels));
@@ -913,20 +1152,19 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 		}
 	}
 
-	free(buffer);
 	free(pulseArray);
 
 	return foundPos;
 }
 
 // Searches using 1ms/factor blocks
-long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long int offset, int *maxdetected, int role, int AudioChannels, parameters *config)
+long int DetectPulseInternal(SampleValue *Samples, wav_hdr header, int factor, long int offset, int *maxdetected, int role, int AudioChannels, parameters *config)
 {
 	int					bytesPerSample = 0, executeCleanSilence = 0;
 	long int			i = 0, TotalMS = 0, totalSamples = 0;
-	double				*sampleBuffer = NULL;
 	long int		 	sampleBufferSize = 0, pos = 0, startPos = 0;
 	Pulses				*pulseArray = NULL;
+	SyncDetector		detector;
 	double				targetFrequency = 0, targetFrequencyHarmonic[2] = { NO_FREQ, NO_FREQ }, origFrequency = 0, MaxMagnitude = 0;
 
 	bytesPerSample = header.fmt.bitsPerSample/8;
@@ -939,13 +1177,6 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 			logmsg("ERROR: Invalid parameters for sync detection\n");
 		return -1;
 	}
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
-	{
-		logmsgFileOnly("\tERROR: malloc failed for sample buffer during DetectPulseInternal\n");
-		return -1;
-	}
-
 	totalSamples = header.data.DataSize/bytesPerSample;
 	// calculate how many sampleBufferSize units fit in the available samples from the file
 	TotalMS = totalSamples/sampleBufferSize-1;
@@ -954,8 +1185,9 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 	{
 		double syncLen = 0;
 
-		i = offset;
-		startPos = i;
+		// Only the window after the offset is scanned, no need to index from the start of the file
+		i = 0;
+		startPos = 0;
 
 		/* check for the time duration in ms*factor of the sync pulses */
 		syncLen = GetLastSyncDuration(GetMSPerFrameRole(role, config), config)*1000*factor;
@@ -997,6 +1229,9 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 			TotalMS = TotalMS - expectedlen + syncLen + silenceLen/2;
 
 		if(expectedlen*1.5 < TotalMS)  // long file
+#ifdef OPENMP_ENABLE
+			#pragma omp atomic write
+#endif
 			config->trimmingNeeded = 1;
 	}
 
@@ -1033,6 +1268,12 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 			 i, TotalMS-1, totalSamples/sampleBufferSize - 1);
 	}
 
+	if(!InitSyncDetector(&detector, sampleBufferSize, header.fmt.SamplesPerSec, AudioChannels, targetFrequency, targetFrequencyHarmonic, config))
+	{
+		free(pulseArray);
+		return -1;
+	}
+
 	while(i < TotalMS)
 	{
 		if(pos + sampleBufferSize > totalSamples)
@@ -1041,21 +1282,18 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 			break;
 		}
 
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Samples + pos, sampleBufferSize*sizeof(double));
 		pulseArray[i].samples = pos;
 
-		pos += sampleBufferSize;
-
 		/* We use left channel by default, we don't know about channel imbalances yet */
-		ProcessChunkForSyncPulse(sampleBuffer, sampleBufferSize, 
-			header.fmt.SamplesPerSec, &pulseArray[i], 
-			CHANNEL_LEFT, AudioChannels, config);
+		ProcessChunkForSyncPulse(&detector, Samples + pos, &pulseArray[i], CHANNEL_LEFT, AudioChannels, config);
+
+		pos += sampleBufferSize;
 
 		if(pulseArray[i].magnitude > MaxMagnitude)
 			MaxMagnitude = pulseArray[i].magnitude;
 		i++;
 	}
+	ReleaseSyncDetector(&detector);
 
 
 	for(i = startPos; i < TotalMS; i++)
@@ -1086,72 +1324,132 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 	offset = DetectPulseTrainSequence(pulseArray, targetFrequency, targetFrequencyHarmonic, TotalMS, factor, maxdetected, startPos, role, AudioChannels, config);
 
 	free(pulseArray);
-	free(sampleBuffer);
 
 	return offset;
 }
 
-double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, Pulses *pulse, char channel, int AudioChannels, parameters *config)
+/*
+	Sync chunks are a few samples long, so each bin is correlated against
+	precomputed twiddles instead of planning and running an FFT per chunk.
+	When one of the sync bins holds more than half of the chunk energy
+	(Parseval) it is the maximum, and the rest of the bins are skipped.
+	Larger chunks, from very high sample rates, use the FFT.
+*/
+int InitSyncDetector(SyncDetector *detector, size_t size, long samplerate, int AudioChannels, double targetFrequency, double *targetFrequencyHarmonic, parameters *config)
 {
-	fftw_plan		p = NULL;
-	long		  	stereoSignalSize = 0;	
-	long		  	i = 0, monoSignalSize = 0; 
-	double		  	*signal = NULL;
-	fftw_complex  	*spectrum = NULL;
-	double		 	seconds = 0, boxsize = 0;
-	double			maxHertz = 0, maxMag = 0, maxPhase = 0;
-
-	stereoSignalSize = (long)size;
-	monoSignalSize = stereoSignalSize/AudioChannels;	 /* is 1/2 n bit values */
-	seconds = (double)size/((double)samplerate*AudioChannels);
-	boxsize = seconds;
-
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
-	if(!signal)
+	long int	i = 0, n = 0, monoSignalSize = 0;
+	double		boxsize = 0;
+
+	if(!detector)
+		return 0;
+
+	memset(detector, 0, sizeof(SyncDetector));
+	monoSignalSize = (long)size/AudioChannels;
+	boxsize = (double)size/((double)samplerate*AudioChannels);
+
+	detector->size = monoSignalSize;
+	detector->bins = monoSignalSize/2;
+	detector->factor = (double)size;
+	detector->hertz = (double*)malloc(sizeof(double)*(detector->bins+1));
+	detector->pass = (char*)malloc(sizeof(char)*(detector->bins+1));
+	detector->signal = (double*)fftw_malloc(sizeof(double)*(monoSignalSize+1));
+	if(!detector->hertz || !detector->pass || !detector->signal)
 	{
+		ReleaseSyncDetector(detector);
 		logmsgFileOnly("Not enough memory\n");
-		return(0);
+		return 0;
 	}
-	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
-	if(!spectrum)
+	memset(detector->signal, 0, sizeof(double)*(monoSignalSize+1));
+
+	for(i = 1; i <= detector->bins; i++)
 	{
-		logmsgFileOnly("Not enough memory\n");
-		return(0);
+		detector->hertz[i] = CalculateFrequency(i, boxsize);
+		detector->pass[i] = detector->hertz[i] < SYNC_LPF || (config->syncTolerance && detector->hertz[i] < SYNC_LPF/2);
+		if(detector->pass[i] && detector->targetCount < 3 && targetFrequency != NO_FREQ &&
+			(detector->hertz[i] == targetFrequency ||
+			(targetFrequencyHarmonic && targetFrequencyHarmonic[0] != NO_FREQ && detector->hertz[i] == targetFrequencyHarmonic[0]) ||
+			(targetFrequencyHarmonic && targetFrequencyHarmonic[1] != NO_FREQ && detector->hertz[i] == targetFrequencyHarmonic[1])))
+			detector->target[detector->targetCount++] = i;
 	}
 
-	if(!config->sync_plan)
+	if(monoSignalSize > SYNC_DFT_MAX_SIZE)
 	{
- 		fftw_import_wisdom_from_filename("wisdom.fftw");
-
-		config->sync_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->sync_plan)
+		detector->spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
+		if(!detector->spectrum)
 		{
-			logmsgFileOnly("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			fftw_free(spectrum);
-			spectrum = NULL;
+			ReleaseSyncDetector(detector);
+			logmsgFileOnly("Not enough memory\n");
 			return 0;
 		}
+		return 1;
+	}
+
+	detector->cosTable = (double*)malloc(sizeof(double)*(detector->bins+1)*monoSignalSize);
+	detector->sinTable = (double*)malloc(sizeof(double)*(detector->bins+1)*monoSignalSize);
+	if(!detector->cosTable || !detector->sinTable)
+	{
+		ReleaseSyncDetector(detector);
+		logmsgFileOnly("Not enough memory\n");
+		return 0;
 	}
 
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-	if(!p)
+	// FFTW sign convention, X[k] = sum x[n]*e^(-2*pi*i*k*n/N)
+	for(i = 0; i <= detector->bins; i++)
 	{
-		logmsgFileOnly("FFTW failed to create FFTW_MEASURE plan\n");
+		for(n = 0; n < monoSignalSize; n++)
+		{
+			double angle = 2.0*M_PI*(double)((i*n) % monoSignalSize)/(double)monoSignalSize;
 
-		free(signal);
-		signal = NULL;
+			detector->cosTable[i*monoSignalSize+n] = cos(angle);
+			detector->sinTable[i*monoSignalSize+n] = -sin(angle);
+		}
+	}
+	return 1;
+}
 
-		fftw_free(spectrum);
-		spectrum = NULL;
-		return 0;
+void ReleaseSyncDetector(SyncDetector *detector)
+{
+	if(!detector)
+		return;
+
+	if(detector->signal)
+		fftw_free(detector->signal);
+	if(detector->spectrum)
+		fftw_free(detector->spectrum);
+	free(detector->cosTable);
+	free(detector->sinTable);
+	free(detector->hertz);
+	free(detector->pass);
+	memset(detector, 0, sizeof(SyncDetector));
+}
+
+static inline fftw_complex CorrelateSyncBin(SyncDetector *detector, long int bin)
+{
+	double	real = 0, imag = 0;
+	double	*cosRow = NULL, *sinRow = NULL;
+
+	cosRow = detector->cosTable + bin*detector->size;
+	sinRow = detector->sinTable + bin*detector->size;
+	for(long int n = 0; n < detector->size; n++)
+	{
+		real += detector->signal[n]*cosRow[n];
+		imag += detector->signal[n]*sinRow[n];
 	}
+	return(real + I*imag);
+}
 
-	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
-	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
+static inline void SetSyncPulse(Pulses *pulse, double hertz, fftw_complex *value, double factor)
+{
+	pulse->hertz = hertz;
+	pulse->magnitude = CalculateMagnitude(value, factor);
+	pulse->phase = CalculatePhase(value);
+}
+
+static inline void LoadSyncChunk(SyncDetector *detector, SampleValue *samples, char channel, int AudioChannels)
+{
+	double	*signal = detector->signal;
 
-	for(i = 0; i < monoSignalSize; i++)
+	for(long int i = 0; i < detector->size; i++)
 	{
 		if(channel == CHANNEL_LEFT)
 			signal[i] = (double)samples[i*AudioChannels];
@@ -1160,48 +1458,517 @@ double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, P
 		if(channel == CHANNEL_STEREO)
 			signal[i] = ((double)samples[i*AudioChannels]+(double)samples[i*AudioChannels+1])/2.0;
 	}
+}
 
-	fftw_execute(p); 
-	fftw_destroy_plan(p);
-	p = NULL;
+// Energy in bins 1 to N/2 via Parseval, the Nyquist bin has no mirror
+static inline double SyncChunkEnergy(SyncDetector *detector, double *energy)
+{
+	double	dc = 0, nyquist = 0, *signal = detector->signal;
+	long int monoSignalSize = detector->size;
 
-	for(i = 1; i < monoSignalSize/2+1; i++)
+	*energy = 0;
+	for(long int i = 0; i < monoSignalSize; i++)
 	{
-		double magnitude;
+		*energy += signal[i]*signal[i];
+		dc += signal[i];
+		nyquist += i & 1 ? -signal[i] : signal[i];
+	}
 
-		magnitude = CalculateMagnitude(&spectrum[i], size);
-		if(magnitude > maxMag)
+	if(monoSignalSize & 1)
+		return((monoSignalSize*(*energy) - dc*dc)/2.0);
+	return((monoSignalSize*(*energy) - dc*dc + nyquist*nyquist)/2.0);
+}
+
+double ProcessChunkForSyncPulse(SyncDetector *detector, SampleValue *samples, Pulses *pulse, char channel, int AudioChannels, parameters *config)
+{
+	long int		i = 0, monoSignalSize = 0;
+	double			*signal = NULL, energy = 0, halfEnergy = 0, maxPower = 0;
+
+	monoSignalSize = detector->size;
+	signal = detector->signal;
+	LoadSyncChunk(detector, samples, channel, AudioChannels);
+
+	pulse->hertz = 0;
+	pulse->magnitude = 0;
+	pulse->phase = 0;
+
+	if(detector->spectrum)
+	{
+		if(!ExecuteRealToComplex(monoSignalSize, signal, detector->spectrum, config))
+			return 0;
+
+		for(i = 1; i <= detector->bins; i++)
+		{
+			double magnitude;
+
+			magnitude = CalculateMagnitude(&detector->spectrum[i], detector->factor);
+			if(magnitude > pulse->magnitude && detector->pass[i])
+				SetSyncPulse(pulse, detector->hertz[i], &detector->spectrum[i], detector->factor);
+		}
+		return(pulse->hertz);
+	}
+
+	halfEnergy = SyncChunkEnergy(detector, &energy);
+	for(int t = 0; t < detector->targetCount; t++)
+	{
+		fftw_complex	value;
+		double			power = 0;
+
+		value = CorrelateSyncBin(detector, detector->target[t]);
+		power = creal(value)*creal(value) + cimag(value)*cimag(value);
+		if(2.0*power > halfEnergy + SYNC_DOMINANCE_EPS*monoSignalSize*energy)
+		{
+			SetSyncPulse(pulse, detector->hertz[detector->target[t]], &value, detector->factor);
+			return(pulse->hertz);
+		}
+	}
+
+	for(i = 1; i <= detector->bins; i++)
+	{
+		fftw_complex	value;
+		double			power = 0;
+
+		if(!detector->pass[i])
+			continue;
+
+		value = CorrelateSyncBin(detector, i);
+		power = creal(value)*creal(value) + cimag(value)*cimag(value);
+		if(power > maxPower)
+		{
+			maxPower = power;
+			SetSyncPulse(pulse, detector->hertz[i], &value, detector->factor);
+		}
+	}
+	return(pulse->hertz);
+}
+
+/*
+	Coarse to fine search: the sync bin and broadband energies of every
+	FACTOR_EXPLORE chunk are added into cells of 8, 64 and 512 chunks.
+	Pulse trains are located on the coarsest level, narrowed down on the
+	finer ones and only then scanned at full resolution by
+	DetectPulseInternal in a small window.
+*/
+void ReleaseSyncPyramid(SyncPyramid *pyramid)
+{
+	if(!pyramid)
+		return;
+
+	for(int l = 0; l < SYNC_PYRAMID_LEVELS; l++)
+	{
+		free(pyramid->tone[l]);
+		free(pyramid->energy[l]);
+	}
+	memset(pyramid, 0, sizeof(SyncPyramid));
+}
+
+int BuildSyncPyramid(SyncPyramid *pyramid, SampleValue *Samples, long int startSample, long int endSample, wav_hdr header, int role, int AudioChannels, parameters *config)
+{
+	long int		chunks = 0, decimation = 1;
+	double			origFrequency = 0, targetFrequency = 0, targetFrequencyHarmonic[2] = { NO_FREQ, NO_FREQ };
+	SyncDetector	detector;
+
+	memset(pyramid, 0, sizeof(SyncPyramid));
+	pyramid->start = startSample;
+	pyramid->chunkSize = SecondsToSamples(header.fmt.SamplesPerSec, 1.0/((double)FACTOR_EXPLORE*1000.0), AudioChannels, NULL, NULL);
+	if(pyramid->chunkSize < 2*AudioChannels)
+		return 0;
+
+	chunks = (endSample - startSample)/pyramid->chunkSize;
+	for(int l = 0; l < SYNC_PYRAMID_LEVELS; l++)
+	{
+		decimation *= SYNC_PYRAMID_STEP;
+		pyramid->cells[l] = chunks/decimation;
+		if(!pyramid->cells[l])
+		{
+			ReleaseSyncPyramid(pyramid);
+			return 0;
+		}
+		pyramid->tone[l] = (double*)calloc(pyramid->cells[l], sizeof(double));
+		pyramid->energy[l] = (double*)calloc(pyramid->cells[l], sizeof(double));
+		if(!pyramid->tone[l] || !pyramid->energy[l])
+		{
+			logmsgFileOnly("\tERROR: malloc failed for sync pyramid\n");
+			ReleaseSyncPyramid(pyramid);
+			return 0;
+		}
+	}
+
+	origFrequency = GetPulseSyncFreq(role, config);
+	targetFrequency = FindFrequencyBracketForSync(origFrequency,
+						pyramid->chunkSize, AudioChannels, header.fmt.SamplesPerSec, config);
+	if(origFrequency < HARMONIC_TSHLD)
+	{
+		targetFrequencyHarmonic[0] = FindFrequencyBracketForSync(targetFrequency*2,
+						pyramid->chunkSize, AudioChannels, header.fmt.SamplesPerSec, config);
+		targetFrequencyHarmonic[1] = FindFrequencyBracketForSync(targetFrequency*3,
+						pyramid->chunkSize, AudioChannels, header.fmt.SamplesPerSec, config);
+	}
+	if(!InitSyncDetector(&detector, pyramid->chunkSize, header.fmt.SamplesPerSec, AudioChannels, targetFrequency, targetFrequencyHarmonic, config))
+	{
+		ReleaseSyncPyramid(pyramid);
+		return 0;
+	}
+	// Only short chunks have correlators, this is not worth it otherwise
+	if(detector.spectrum || !detector.targetCount)
+	{
+		ReleaseSyncDetector(&detector);
+		ReleaseSyncPyramid(pyramid);
+		return 0;
+	}
+
+	chunks = pyramid->cells[0]*SYNC_PYRAMID_STEP;
+	for(long int c = 0; c < chunks; c++)
+	{
+		double	energy = 0, halfEnergy = 0, tone = 0;
+		long int cell = c/SYNC_PYRAMID_STEP;
+
+		LoadSyncChunk(&detector, Samples + startSample + c*pyramid->chunkSize, CHANNEL_LEFT, AudioChannels);
+		halfEnergy = SyncChunkEnergy(&detector, &energy);
+		for(int t = 0; t < detector.targetCount; t++)
+		{
+			fftw_complex value;
+
+			value = CorrelateSyncBin(&detector, detector.target[t]);
+			tone += creal(value)*creal(value) + cimag(value)*cimag(value);
+		}
+		pyramid->tone[0][cell] += tone;
+		pyramid->energy[0][cell] += halfEnergy;
+	}
+	ReleaseSyncDetector(&detector);
+
+	for(int l = 1; l < SYNC_PYRAMID_LEVELS; l++)
+	{
+		for(long int c = 0; c < pyramid->cells[l]*SYNC_PYRAMID_STEP; c++)
+		{
+			pyramid->tone[l][c/SYNC_PYRAMID_STEP] += pyramid->tone[l-1][c];
+			pyramid->energy[l][c/SYNC_PYRAMID_STEP] += pyramid->energy[l-1][c];
+		}
+	}
+
+	for(int l = 0; l < SYNC_PYRAMID_LEVELS; l++)
+	{
+		for(long int c = 0; c < pyramid->cells[l]; c++)
+		{
+			if(pyramid->tone[l][c] > pyramid->maxTone[l])
+				pyramid->maxTone[l] = pyramid->tone[l][c];
+		}
+	}
+	return 1;
+}
+
+static inline int IsSyncCell(SyncPyramid *pyramid, int level, long int cell)
+{
+	return(pyramid->tone[level][cell] >= SYNC_PYRAMID_RATIO*pyramid->energy[level][cell] &&
+		pyramid->tone[level][cell] >= SYNC_PYRAMID_FLOOR*pyramid->maxTone[level]);
+}
+
+/*
+	Returns the sample offset of the next run of sync cells on the coarse
+	level, starting at cell *next, narrowed down through the finer levels
+*/
+long int FindSyncCandidate(SyncPyramid *pyramid, long int *next)
+{
+	int			level = SYNC_PYRAMID_LEVELS - 1;
+	long int	cell = *next;
+
+	while(cell < pyramid->cells[level] && !IsSyncCell(pyramid, level, cell))
+		cell++;
+	if(cell >= pyramid->cells[level])
+		return -1;
+
+	*next = cell;
+	while(*next < pyramid->cells[level] && IsSyncCell(pyramid, level, *next))
+		(*next)++;
+
+	for(level = level - 1; level >= 0; level--)
+	{
+		long int first = 0, last = 0;
+
+		// The coarse cell could have started late, look one cell back
+		first = cell*SYNC_PYRAMID_STEP - SYNC_PYRAMID_STEP;
+		last = cell*SYNC_PYRAMID_STEP + SYNC_PYRAMID_STEP;
+		if(first < 0)
+			first = 0;
+		if(last > pyramid->cells[level])
+			last = pyramid->cells[level];
+
+		cell = cell*SYNC_PYRAMID_STEP;
+		for(long int c = first; c < last; c++)
 		{
-			int		pass = 0;
-			double	hertz = 0;
-
-			hertz = CalculateFrequency(i, boxsize);
-			if (hertz < SYNC_LPF || (config->syncTolerance && hertz < SYNC_LPF/2))	// LPF
-				pass = 1;
-			
-			if(pass)
+			if(IsSyncCell(pyramid, level, c))
 			{
-				maxHertz = hertz;
-				maxMag = magnitude;
-				maxPhase = CalculatePhase(&spectrum[i]);
+				cell = c;
+				break;
 			}
 		}
 	}
 
-	fftw_free(spectrum);
-	spectrum = NULL;
+	return(pyramid->start + cell*SYNC_PYRAMID_STEP*pyramid->chunkSize);
+}
+
+long int DetectPulseCoarse(SampleValue *Samples, wav_hdr header, int factor, long int startSample, long int endSample, int *maxdetected, int role, int AudioChannels, parameters *config)
+{
+	long int	next = 0, candidate = 0, offset = -1, leadSamples = 0;
+	SyncPyramid	pyramid;
 
-	free(signal);
-	signal = NULL;
+	if(!BuildSyncPyramid(&pyramid, Samples, startSample, endSample, header, role, AudioChannels, config))
+		return -1;
+
+	// Start one 1ms cell early, plus the 15ms DetectPulse leaves after DetectSignalStart
+	leadSamples = SecondsToSamples(header.fmt.SamplesPerSec, 0.015, AudioChannels, NULL, NULL);
+	leadSamples += SYNC_PYRAMID_STEP*pyramid.chunkSize;
+	for(int tries = 0; tries < SYNC_PYRAMID_CANDIDATES && offset == -1; tries++)
+	{
+		candidate = FindSyncCandidate(&pyramid, &next);
+		if(candidate == -1)
+			break;
 
-	pulse->hertz = maxHertz;
-	pulse->magnitude = maxMag;
-	pulse->phase = maxPhase;
+		if(candidate >= leadSamples)
+			candidate -= leadSamples;
+		if(config->debugSync)
+			logmsgFileOnly("\nCoarse sync candidate #%d at %ld samples\n", tries+1, SamplesForDisplay(candidate, AudioChannels));
+		offset = DetectPulseInternal(Samples, header, factor, candidate, maxdetected, role, AudioChannels, config);
+	}
 
-	return(maxHertz);
+	ReleaseSyncPyramid(&pyramid);
+	return offset;
 }
 
-long int DetectSignalStart(double *AllSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config)
+/*
+	Matched filter for the whole pulse train, built from the profile: pulseCount
+	pulses of the sync tone, each one half of its period. The left channel is
+	mixed down to the sync frequency and its energy is measured in 1ms windows,
+	which tolerates the same frequency drift as the pulse scan. Those are added
+	over each pulse length and correlated against the train, the pulses add and
+	the gaps between them subtract.
+*/
+int InitSyncCorrelator(SyncCorrelator *correlator, double syncSeconds, double samplerate, int role, parameters *config)
+{
+	double	period = 0;
+
+	if(!correlator)
+		return 0;
+
+	memset(correlator, 0, sizeof(SyncCorrelator));
+	correlator->pulseCount = getPulseCount(role, config);
+	if(correlator->pulseCount <= 0 || syncSeconds <= 0)
+		return 0;
+
+	period = syncSeconds*samplerate/correlator->pulseCount;
+	correlator->window = (long int)(samplerate/1000.0);
+	correlator->pulseLen = (long int)floor(period/2.0);
+	if(correlator->window < 1 || correlator->pulseLen < correlator->window)
+		return 0;
+
+	correlator->omega = 2.0*M_PI*GetPulseSyncFreq(role, config)/samplerate;
+	correlator->pulseStart = (long int*)malloc(sizeof(long int)*correlator->pulseCount);
+	if(!correlator->pulseStart)
+		return 0;
+	for(int i = 0; i < correlator->pulseCount; i++)
+		correlator->pulseStart[i] = (long int)round(i*period);
+	correlator->trainLen = correlator->pulseStart[correlator->pulseCount-1] + 2*correlator->pulseLen;
+
+	correlator->energy = (double*)malloc(sizeof(double)*(SYNC_CORR_SEGMENT+2*correlator->trainLen));
+	correlator->score = (double*)malloc(sizeof(double)*(SYNC_CORR_SEGMENT+correlator->trainLen));
+	if(!correlator->energy || !correlator->score)
+	{
+		ReleaseSyncCorrelator(correlator);
+		logmsgFileOnly("Not enough memory\n");
+		return 0;
+	}
+	return 1;
+}
+
+void ReleaseSyncCorrelator(SyncCorrelator *correlator)
+{
+	if(!correlator)
+		return;
+
+	free(correlator->pulseStart);
+	free(correlator->energy);
+	free(correlator->score);
+	memset(correlator, 0, sizeof(SyncCorrelator));
+}
+
+// Scores count train positions from the mono sample first, energy keeps the pulse length sums
+void CorrelateSyncSegment(SyncCorrelator *correlator, SampleValue *Samples, long int first, long int count, int AudioChannels)
+{
+	long int	window = correlator->window, box = 0, energyCount = 0, windowCount = 0;
+	double		re = 0, im = 0, sum = 0, rotRe = 0, rotIm = 0;
+	double		lagRe = 0, lagIm = 0, leadRe = 0, leadIm = 0, *energy = correlator->energy;
+
+	box = correlator->pulseLen - window + 1;
+	energyCount = count + correlator->trainLen - correlator->pulseLen;
+	windowCount = energyCount + box - 1;
+
+	/* Energy of the sync tone in each 1ms window, the phasors are rotated and resynced periodically */
+	rotRe = cos(correlator->omega);
+	rotIm = -sin(correlator->omega);
+	for(long int k = 0; k < window; k++)
+	{
+		double phase = correlator->omega*(double)(first+k);
+
+		re += Samples[(first+k)*AudioChannels]*cos(phase);
+		im -= Samples[(first+k)*AudioChannels]*sin(phase);
+	}
+	for(long int i = 0; i < windowCount; i++)
+	{
+		double	in = 0, out = 0, tmp = 0;
+
+		energy[i] = re*re + im*im;
+		if(i + 1 == windowCount)
+			break;
+
+		if(i % SYNC_CORR_RESYNC == 0)
+		{
+			lagRe = cos(correlator->omega*(double)(first+i));
+			lagIm = -sin(correlator->omega*(double)(first+i));
+			leadRe = cos(correlator->omega*(double)(first+i+window));
+			leadIm = -sin(correlator->omega*(double)(first+i+window));
+		}
+		out = Samples[(first+i)*AudioChannels];
+		in = Samples[(first+i+window)*AudioChannels];
+		re += in*leadRe - out*lagRe;
+		im += in*leadIm - out*lagIm;
+
+		tmp = lagRe*rotRe - lagIm*rotIm;
+		lagIm = lagRe*rotIm + lagIm*rotRe;
+		lagRe = tmp;
+		tmp = leadRe*rotRe - leadIm*rotIm;
+		leadIm = leadRe*rotIm + leadIm*rotRe;
+		leadRe = tmp;
+	}
+
+	/* Add them over each pulse length, in place */
+	for(long int k = 0; k < box; k++)
+		sum += energy[k];
+	for(long int i = 0; i < energyCount; i++)
+	{
+		double	tmp = energy[i];
+
+		energy[i] = sum;
+		if(i + box < windowCount)
+			sum += energy[i+box] - tmp;
+	}
+
+	for(long int i = 0; i < count; i++)
+	{
+		double	score = 0;
+
+		for(int p = 0; p < correlator->pulseCount; p++)
+			score += energy[i+correlator->pulseStart[p]] - energy[i+correlator->pulseStart[p]+correlator->pulseLen];
+		correlator->score[i] = score;
+	}
+}
+
+/*
+	Returns the first sample of the pulse train between startSample and endSample.
+	Trains shifted by a few pulses also score high, so the first position close
+	to the best score is located and the peak is taken from the train length after it.
+*/
+long int DetectPulseCorrelation(SampleValue *Samples, wav_hdr header, long int startSample, long int endSample, double syncSeconds, int role, int AudioChannels, parameters *config)
+{
+	long int		first = 0, positions = 0, segments = 0, segment = 0, from = 0, count = 0, peak = -1;
+	double			*segmentMax = NULL, best = 0, threshold = 0, on = 0, off = 0, ratio = 0;
+	int				pulses = 0;
+	SyncCorrelator	correlator;
+
+	if(!InitSyncCorrelator(&correlator, syncSeconds, header.fmt.SamplesPerSec, role, config))
+		return -1;
+
+	first = startSample/AudioChannels;
+	positions = endSample/AudioChannels - first - correlator.trainLen + 1;
+	if(positions <= 0)
+	{
+		ReleaseSyncCorrelator(&correlator);
+		return -1;
+	}
+
+	segments = (positions + SYNC_CORR_SEGMENT - 1)/SYNC_CORR_SEGMENT;
+	segmentMax = (double*)malloc(sizeof(double)*segments);
+	if(!segmentMax)
+	{
+		ReleaseSyncCorrelator(&correlator);
+		logmsgFileOnly("Not enough memory\n");
+		return -1;
+	}
+
+	for(segment = 0; segment < segments; segment++)
+	{
+		from = segment*SYNC_CORR_SEGMENT;
+		count = positions - from < SYNC_CORR_SEGMENT ? positions - from : SYNC_CORR_SEGMENT;
+		CorrelateSyncSegment(&correlator, Samples, first+from, count, AudioChannels);
+		segmentMax[segment] = correlator.score[0];
+		for(long int i = 1; i < count; i++)
+		{
+			if(correlator.score[i] > segmentMax[segment])
+				segmentMax[segment] = correlator.score[i];
+		}
+		if(segmentMax[segment] > best)
+			best = segmentMax[segment];
+	}
+
+	if(best <= 0)
+	{
+		free(segmentMax);
+		ReleaseSyncCorrelator(&correlator);
+		return -1;
+	}
+
+	threshold = best*SYNC_CORR_PEAK;
+	for(segment = 0; segment < segments && segmentMax[segment] < threshold; segment++);
+	free(segmentMax);
+
+	/* The segment with the first peak is scored again, including the train length after it */
+	from = segment*SYNC_CORR_SEGMENT;
+	count = positions - from < SYNC_CORR_SEGMENT + correlator.trainLen ? positions - from : SYNC_CORR_SEGMENT + correlator.trainLen;
+	CorrelateSyncSegment(&correlator, Samples, first+from, count, AudioChannels);
+	for(long int i = 0; i < count; i++)
+	{
+		if(correlator.score[i] >= threshold)
+		{
+			peak = i;
+			for(long int j = i + 1; j < count && j < i + correlator.trainLen; j++)
+			{
+				if(correlator.score[j] > correlator.score[peak])
+					peak = j;
+			}
+			break;
+		}
+	}
+	if(peak == -1)
+	{
+		ReleaseSyncCorrelator(&correlator);
+		return -1;
+	}
+
+	for(int p = 0; p < correlator.pulseCount; p++)
+	{
+		double	pulse = 0, gap = 0;
+
+		pulse = correlator.energy[peak+correlator.pulseStart[p]];
+		gap = correlator.energy[peak+correlator.pulseStart[p]+correlator.pulseLen];
+		if(pulse > gap)
+			pulses++;
+		on += pulse;
+		off += gap;
+	}
+	ratio = on/(on+off);
+
+	if(config->debugSync)
+		logmsgFileOnly("Correlation sync peak at %ld samples, score %g, pulse energy ratio %g, pulses %d/%d\n",
+			first+from+peak, correlator.score[peak], ratio, pulses, correlator.pulseCount);
+
+	if(ratio < SYNC_CORR_RATIO || pulses < correlator.pulseCount - 1)
+		peak = -1;
+	ReleaseSyncCorrelator(&correlator);
+	if(peak == -1)
+		return -1;
+	return((first+from+peak)*AudioChannels);
+}
+
+long int DetectSignalStart(SampleValue *AllSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config)
 {
 	int			AudioChannels = 0;
 	long int	position = 0;
@@ -1226,15 +1993,15 @@ long int DetectSignalStart(double *AllSamples, wav_hdr header, long int offset,
 
 // amount of full length pulses to use
 #define MIN_LEN 4
-long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config)
+long int DetectSignalStartInternal(SampleValue *Samples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config)
 {
 	int					bytesPerSample;
 	long int			i = 0, TotalMS = 0, start = 0, totalSamples = 0;
-	double				*sampleBuffer = NULL;
 	long int		 	sampleBufferSize = 0;
 	long int			pos = 0;
 	double				MaxMagnitude = 0;
 	Pulses				*pulseArray;
+	SyncDetector		detector;
 	double 				total = 0;
 	long int 			count = 0, length = 0, tolerance = 0, toleranceIssueOffset = -1, MaxTolerance = 4;
 	double 				targetFrequency = 0, targetFrequencyHarmonic[2] = { NO_FREQ, NO_FREQ }, averageAmplitude = 0;
@@ -1249,13 +2016,6 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 			logmsg("ERROR: Invalid parameters for sync detection\n");
 		return -1;
 	}
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
-	{
-		logmsgFileOnly("\tERROR: malloc failed for sample buffer during DetectPulseInternal\n");
-		return -1;
-	}
-
 	totalSamples = header.data.DataSize/bytesPerSample;
 	// calculate how many sampleBufferSize units fit in the available samples from the file
 	TotalMS = totalSamples/sampleBufferSize-1;
@@ -1279,6 +2039,24 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 	else
 		TotalMS /= 6;
 
+	if(syncKnown)
+	{
+		targetFrequency = FindFrequencyBracketForSync(syncKnown, 
+					sampleBufferSize, AudioChannels, header.fmt.SamplesPerSec, config);
+		/*
+		targetFrequencyHarmonic[0] = FindFrequencyBracketForSync(syncKnown*2, 
+					millisecondSize/2, AudioChannels, header.fmt.SamplesPerSec, config);
+		targetFrequencyHarmonic[1] = FindFrequencyBracketForSync(syncKnown*3, 
+					millisecondSize/2, AudioChannels, header.fmt.SamplesPerSec, config);
+		*/
+	}
+
+	if(!InitSyncDetector(&detector, sampleBufferSize, header.fmt.SamplesPerSec, AudioChannels, targetFrequency, targetFrequencyHarmonic, config))
+	{
+		free(pulseArray);
+		return -1;
+	}
+
 	while(i < TotalMS)
 	{
 		if(pos + sampleBufferSize > totalSamples)
@@ -1287,21 +2065,18 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 			break;
 		}
 
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Samples + pos, sampleBufferSize*sizeof(double));
 		pulseArray[i].samples = pos;
 
-		pos += sampleBufferSize;
-
 		/* We use left channel by default, we don't know about channel imbalances yet */
-		ProcessChunkForSyncPulse(sampleBuffer, sampleBufferSize, 
-			header.fmt.SamplesPerSec, &pulseArray[i], 
-			CHANNEL_LEFT, AudioChannels, config);
+		ProcessChunkForSyncPulse(&detector, Samples + pos, &pulseArray[i], CHANNEL_LEFT, AudioChannels, config);
+
+		pos += sampleBufferSize;
 
 		if(pulseArray[i].magnitude > MaxMagnitude)
 			MaxMagnitude = pulseArray[i].magnitude;
 		i++;
 	}
+	ReleaseSyncDetector(&detector);
 
 	for(i = start; i < TotalMS; i++)
 	{
@@ -1332,17 +2107,7 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 		*endPulse = -1;
 
 	if(syncKnown)
-	{
-		targetFrequency = FindFrequencyBracketForSync(syncKnown, 
-					sampleBufferSize, AudioChannels, header.fmt.SamplesPerSec, config);
-		/*
-		targetFrequencyHarmonic[0] = FindFrequencyBracketForSync(syncKnown*2, 
-					millisecondSize/2, AudioChannels, header.fmt.SamplesPerSec, config);
-		targetFrequencyHarmonic[1] = FindFrequencyBracketForSync(syncKnown*3, 
-					millisecondSize/2, AudioChannels, header.fmt.SamplesPerSec, config);
-		*/
 		averageAmplitude = findAverageAmplitudeForTarget(pulseArray, targetFrequency, targetFrequencyHarmonic, TotalMS, start, factor, AudioChannels, config);
-	}
 
 	for(i = start; i < TotalMS; i++)
 	{
@@ -1443,7 +2208,6 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 	}
 
 	free(pulseArray);
-	free(sampleBuffer);
 
 	return offset;
 }
@@ -37,15 +37,77 @@ typedef struct pulses_st {
 	long int samples;
 } Pulses;
 
-long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *config);
-long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header, int role, parameters *config);
-long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long int offset, int *maxDetected, int role, int AudioChannels, parameters *config);
-double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, Pulses *pulse, char channel, int AudioChannels, parameters *config);
+// Correlators for the sync tone, built once per detection pass
+typedef struct sync_detector_st {
+	long int		size;
+	long int		bins;
+	double			factor;
+	double			*signal;
+	double			*hertz;
+	char			*pass;
+	double			*cosTable;
+	double			*sinTable;
+	fftw_complex	*spectrum;
+	long int		target[3];
+	int				targetCount;
+} SyncDetector;
+
+// Sync bin and broadband energy of the file, added in cells of 8, 64 and 512 chunks
+#define SYNC_PYRAMID_LEVELS	3
+#define SYNC_PYRAMID_STEP	8
+
+typedef struct sync_pyramid_st {
+	long int	start;
+	long int	chunkSize;
+	long int	cells[SYNC_PYRAMID_LEVELS];
+	double		*tone[SYNC_PYRAMID_LEVELS];
+	double		*energy[SYNC_PYRAMID_LEVELS];
+	double		maxTone[SYNC_PYRAMID_LEVELS];
+} SyncPyramid;
+
+// Pulse train matched filter, see DetectPulseCorrelation
+typedef struct sync_correlator_st {
+	int			pulseCount;
+	long int	*pulseStart;
+	long int	pulseLen;
+	long int	trainLen;
+	long int	window;
+	double		omega;
+	double		*energy;
+	double		*score;
+} SyncCorrelator;
+
+// Slot in syncAlignPct/syncAlignTolerance: Ref Start, Ref End, Com Start, Com End
+#define SYNC_ALIGN_SLOT(role, isEnd)	(((role) == ROLE_REF ? 0 : 2) + ((isEnd) ? 1 : 0))
+
+long int DetectPulse(SampleValue *AllSamples, wav_hdr header, int role, parameters *config);
+long int DetectPulseInRange(SampleValue *AllSamples, wav_hdr header, long int startSample, long int endSample, int role, parameters *config);
+long int DetectPulseAfterSignalStart(SampleValue *AllSamples, wav_hdr header, int role, parameters *config);
+long int GetSignalStartSearchEnd(wav_hdr header, int role, parameters *config);
+void GetPulseReadMargins(wav_hdr header, int role, long int *before, long int *after, parameters *config);
+long int DetectEndPulse(SampleValue *AllSamples, long int startpulse, wav_hdr header, int role, parameters *config);
+long int AdjustEndPulse(SampleValue *AllSamples, wav_hdr header, long int sampleOffset, int role, int AudioChannels, parameters *config);
+double GetStartPulseSearchSeconds(wav_hdr header, int role, parameters *config);
+int IsLongCapture(wav_hdr header, int role, parameters *config);
+long int GetStartPulseSearchEnd(wav_hdr header, int role, parameters *config);
+void GetEndPulseSearchRange(long int startpulse, wav_hdr header, int role, long int *startSearch, long int *endSearch, parameters *config);
+long int DetectPulseInternal(SampleValue *Samples, wav_hdr header, int factor, long int offset, int *maxDetected, int role, int AudioChannels, parameters *config);
+int InitSyncDetector(SyncDetector *detector, size_t size, long samplerate, int AudioChannels, double targetFrequency, double *targetFrequencyHarmonic, parameters *config);
+void ReleaseSyncDetector(SyncDetector *detector);
+int BuildSyncPyramid(SyncPyramid *pyramid, SampleValue *Samples, long int startSample, long int endSample, wav_hdr header, int role, int AudioChannels, parameters *config);
+void ReleaseSyncPyramid(SyncPyramid *pyramid);
+long int FindSyncCandidate(SyncPyramid *pyramid, long int *next);
+long int DetectPulseCoarse(SampleValue *Samples, wav_hdr header, int factor, long int startSample, long int endSample, int *maxdetected, int role, int AudioChannels, parameters *config);
+int InitSyncCorrelator(SyncCorrelator *correlator, double syncSeconds, double samplerate, int role, parameters *config);
+void ReleaseSyncCorrelator(SyncCorrelator *correlator);
+void CorrelateSyncSegment(SyncCorrelator *correlator, SampleValue *Samples, long int first, long int count, int AudioChannels);
+long int DetectPulseCorrelation(SampleValue *Samples, wav_hdr header, long int startSample, long int endSample, double syncSeconds, int role, int AudioChannels, parameters *config);
+double ProcessChunkForSyncPulse(SyncDetector *detector, SampleValue *samples, Pulses *pulse, char channel, int AudioChannels, parameters *config);
 long int DetectPulseTrainSequence(Pulses *pulseArray, double targetFrequency, double *targetFrequencyHarmonic, long int TotalMS, int factor, int *maxdetected, long int start, int role, int AudioChannels, parameters *config);
-long int AdjustPulseSampleStartByPhase(double *Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters *config);
-long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters* config);
+long int AdjustPulseSampleStartByPhase(SampleValue *Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters *config);
+long int AdjustPulseSampleStartByLength(SampleValue *Samples, wav_hdr header, long int offset, int role, int alignSlot, int AudioChannels, parameters* config);
 
 double findAverageAmplitudeForTarget(Pulses *pulseArray, double targetFrequency, double *targetFrequencyHarmonic, long int TotalMS, long int start, int factor, int AudioChannels, parameters *config);
-long int DetectSignalStart(double *AllSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config);
-long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config);
+long int DetectSignalStart(SampleValue *AllSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config);
+long int DetectSignalStartInternal(SampleValue *Samples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config);
 #endif
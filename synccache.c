@@ -0,0 +1,387 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library:
+ *	  http://www.fftw.org/
+ *
+ */
+
+/*
+ * Sync results are kept in a text file next to each audio file. The first
+ * lines are the key: a hash of the loaded samples, the profile and the
+ * options that change detection. The file is only used when the key
+ * matches, otherwise it is detected again and rewritten. Internal sync
+ * results are added as they are found, keyed by their search position,
+ * and written once the signal has been processed.
+ */
+
+#include "synccache.h"
+#include "log.h"
+#include "freq.h"
+#include "sync.h"
+
+#define SYNC_CACHE_LINE		512
+#define SYNC_CACHE_KEYS		4
+
+#define HASH_PRIME_1	0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2	0xC2B2AE3D27D4EB4FULL
+
+static inline uint64_t HashRound(uint64_t lane, uint64_t value)
+{
+	lane ^= value*HASH_PRIME_2;
+	lane = (lane << 31) | (lane >> 33);
+	return lane*HASH_PRIME_1;
+}
+
+/*
+	Four independent lanes so the multiplies overlap, one pass over the samples.
+	Values are hashed as doubles, so float and double builds match for PCM
+*/
+uint64_t HashSamples(SampleValue *samples, long int count)
+{
+	uint64_t	lane[4] = { HASH_PRIME_1, HASH_PRIME_2, ~HASH_PRIME_1, ~HASH_PRIME_2 };
+	uint64_t	value = 0, hash = 0;
+	double		sample = 0;
+	long int	i = 0;
+
+	if(!samples)
+		return 0;
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		for(int l = 0; l < 4; l++)
+		{
+			sample = samples[i+l];
+			memcpy(&value, &sample, sizeof(uint64_t));
+			lane[l] = HashRound(lane[l], value);
+		}
+	}
+	for(; i < count; i++)
+	{
+		sample = samples[i];
+		memcpy(&value, &sample, sizeof(uint64_t));
+		lane[0] = HashRound(lane[0], value);
+	}
+
+	hash = (uint64_t)count;
+	for(int l = 0; l < 4; l++)
+		hash = HashRound(hash, lane[l]);
+	hash ^= hash >> 29;
+	return hash;
+}
+
+static inline uint64_t HashDouble(uint64_t hash, double value)
+{
+	uint64_t	bits = 0;
+
+	memcpy(&bits, &value, sizeof(uint64_t));
+	return HashRound(hash, bits);
+}
+
+// Everything in the profile that moves the sync search: pulse formats, blocks and frame lengths
+static uint64_t HashSyncProfile(parameters *config)
+{
+	uint64_t	hash = HASH_PRIME_1;
+
+	hash = HashRound(hash, (uint64_t)config->types.syncCount);
+	for(int i = 0; i < config->types.syncCount; i++)
+	{
+		VideoBlockDef	*format = &config->types.SyncFormat[i];
+
+		hash = HashDouble(hash, format->MSPerFrame);
+		hash = HashDouble(hash, format->LineCount);
+		hash = HashRound(hash, (uint64_t)format->pulseSyncFreq);
+		hash = HashRound(hash, (uint64_t)format->pulseFrameLen);
+		hash = HashRound(hash, (uint64_t)format->pulseCount);
+	}
+
+	hash = HashRound(hash, (uint64_t)config->types.totalBlocks);
+	hash = HashRound(hash, (uint64_t)config->types.typeCount);
+	for(int i = 0; i < config->types.typeCount; i++)
+	{
+		AudioBlockType	*type = &config->types.typeArray[i];
+
+		hash = HashRound(hash, (uint64_t)type->type);
+		hash = HashRound(hash, (uint64_t)type->elementCount);
+		hash = HashRound(hash, (uint64_t)type->frames);
+		hash = HashRound(hash, (uint64_t)type->cutFrames);
+		hash = HashRound(hash, (uint64_t)type->syncTone);
+		hash = HashDouble(hash, type->syncLen);
+	}
+	hash ^= hash >> 29;
+	return hash;
+}
+
+static void GetSyncCacheName(AudioSignal *Signal, char *name)
+{
+	sprintf(name, "%s%s", Signal->SourceFile, SYNC_CACHE_EXT);
+}
+
+// The lines that must match for the file to be used
+static void GetSyncCacheKeys(AudioSignal *Signal, parameters *config, char keys[SYNC_CACHE_KEYS][SYNC_CACHE_LINE])
+{
+	snprintf(keys[0], SYNC_CACHE_LINE, "MDFourierSyncCache %d", SYNC_CACHE_VERSION);
+	snprintf(keys[1], SYNC_CACHE_LINE, "pcm %016llx %ld %d %d",
+		(unsigned long long)Signal->syncCache.hash, Signal->numSamples,
+		Signal->header.fmt.SamplesPerSec, Signal->AudioChannels);
+	snprintf(keys[2], SYNC_CACHE_LINE, "profile %016llx %s",
+		(unsigned long long)HashSyncProfile(config), config->types.Name);
+	snprintf(keys[3], SYNC_CACHE_LINE, "options %d %.17g %d %d",
+		Signal->role == ROLE_REF ? config->videoFormatRef : config->videoFormatCom,
+		GetMSPerFrame(Signal, config), config->syncTolerance, config->syncCorrelation);
+}
+
+static int ReadSyncCacheLine(char *line, FILE *file)
+{
+	if(fgets(line, SYNC_CACHE_LINE, file) == NULL)
+		return 0;
+	line[strcspn(line, "\r\n")] = '\0';
+	return 1;
+}
+
+/*
+	Hashes the samples and reads the sidecar file. On a match the offsets
+	are set in the signal, with the values detection would have left behind.
+*/
+int LoadSyncCache(AudioSignal *Signal, parameters *config)
+{
+	char		name[BUFFER_SIZE+16], line[SYNC_CACHE_LINE];
+	char		keys[SYNC_CACHE_KEYS][SYNC_CACHE_LINE];
+	FILE		*file = NULL;
+	SyncCache	cache;
+
+	if(Signal->syncCache.rejected)
+		return 0;
+
+	Signal->syncCache.hash = HashSamples(Signal->Samples, Signal->numSamples);
+	Signal->syncCache.valid = 0;
+
+	GetSyncCacheName(Signal, name);
+	file = fopen(name, "r");
+	if(!file)
+		return 0;
+
+	memset(&cache, 0, sizeof(SyncCache));
+	cache.hash = Signal->syncCache.hash;
+	GetSyncCacheKeys(Signal, config, keys);
+	for(int k = 0; k < SYNC_CACHE_KEYS; k++)
+	{
+		if(!ReadSyncCacheLine(line, file) || strcmp(line, keys[k]) != 0)
+		{
+			if(config->debugSync)
+				logmsgFileOnly("Sync cache %s does not match, detecting again\n", name);
+			fclose(file);
+			return 0;
+		}
+	}
+
+	if(!ReadSyncCacheLine(line, file) ||
+		sscanf(line, "sync %ld %ld %lf %lf", &cache.startOffset, &cache.endOffset, &cache.framerate, &cache.EstimatedSR) != 4 ||
+		!ReadSyncCacheLine(line, file) ||
+		sscanf(line, "align %lf %d %lf %d", &cache.alignPct[0], &cache.alignTolerance[0], &cache.alignPct[1], &cache.alignTolerance[1]) != 4 ||
+		!ReadSyncCacheLine(line, file) ||
+		sscanf(line, "internal %d", &cache.internalCount) != 1 ||
+		cache.internalCount < 0 || cache.internalCount > DELAYCOUNT)
+	{
+		logmsg(" - WARNING: Sync cache %s is corrupt, detecting again\n", name);
+		fclose(file);
+		return 0;
+	}
+
+	for(int i = 0; i < cache.internalCount; i++)
+	{
+		InternalSyncCache *entry = &cache.internal[i];
+
+		if(!ReadSyncCacheLine(line, file) ||
+			sscanf(line, "%ld %ld %ld %d", &entry->pos, &entry->offset, &entry->endPulse, &entry->toleranceIssue) != 4)
+		{
+			logmsg(" - WARNING: Sync cache %s is corrupt, detecting again\n", name);
+			fclose(file);
+			return 0;
+		}
+	}
+	fclose(file);
+
+	if(cache.startOffset < 0 || cache.endOffset <= cache.startOffset || cache.endOffset > Signal->numSamples)
+	{
+		logmsg(" - WARNING: Sync cache %s has invalid offsets, detecting again\n", name);
+		return 0;
+	}
+
+	cache.valid = 1;
+	Signal->syncCache = cache;
+	Signal->startOffset = cache.startOffset;
+	Signal->endOffset = cache.endOffset;
+
+	if(IsLongCapture(Signal->header, Signal->role, config))
+#ifdef OPENMP_ENABLE
+		#pragma omp atomic write
+#endif
+		config->trimmingNeeded = 1;
+	for(int i = 0; i < 2; i++)
+	{
+		config->syncAlignPct[SYNC_ALIGN_SLOT(Signal->role, i)] = cache.alignPct[i];
+		config->syncAlignTolerance[SYNC_ALIGN_SLOT(Signal->role, i)] = cache.alignTolerance[i];
+	}
+
+	logmsg(" - Using cached sync offsets from %s\n", name);
+	return 1;
+}
+
+// Written to a temporary file first, the same file can be both Reference and Comparison
+int SaveSyncCache(AudioSignal *Signal, parameters *config)
+{
+	char		name[BUFFER_SIZE+16], tmpName[BUFFER_SIZE+32];
+	char		keys[SYNC_CACHE_KEYS][SYNC_CACHE_LINE];
+	FILE		*file = NULL;
+	SyncCache	*cache = &Signal->syncCache;
+
+	if(!cache->valid)
+		return 0;
+
+	GetSyncCacheName(Signal, name);
+	sprintf(tmpName, "%s.%s", name, Signal->role == ROLE_REF ? "ref" : "com");
+	file = fopen(tmpName, "w");
+	if(!file)
+	{
+		if(config->debugSync)
+			logmsgFileOnly("Could not create sync cache %s\n", tmpName);
+		return 0;
+	}
+
+	GetSyncCacheKeys(Signal, config, keys);
+	for(int k = 0; k < SYNC_CACHE_KEYS; k++)
+		fprintf(file, "%s\n", keys[k]);
+	fprintf(file, "sync %ld %ld %.17g %.17g\n", cache->startOffset, cache->endOffset, cache->framerate, cache->EstimatedSR);
+	fprintf(file, "align %.17g %d %.17g %d\n", cache->alignPct[0], cache->alignTolerance[0], cache->alignPct[1], cache->alignTolerance[1]);
+	fprintf(file, "internal %d\n", cache->internalCount);
+	for(int i = 0; i < cache->internalCount; i++)
+		fprintf(file, "%ld %ld %ld %d\n", cache->internal[i].pos, cache->internal[i].offset,
+			cache->internal[i].endPulse, cache->internal[i].toleranceIssue);
+
+	if(fclose(file) != 0)
+	{
+		remove(tmpName);
+		return 0;
+	}
+
+	// rename does not replace existing files in Windows
+	remove(name);
+	if(rename(tmpName, name) != 0)
+	{
+		remove(tmpName);
+		if(config->debugSync)
+			logmsgFileOnly("Could not create sync cache %s\n", name);
+		return 0;
+	}
+	return 1;
+}
+
+// Takes the detected values from the signal, previous internal sync results are dropped
+void StoreSyncCache(AudioSignal *Signal, parameters *config)
+{
+	SyncCache	*cache = &Signal->syncCache;
+
+	cache->startOffset = Signal->startOffset;
+	cache->endOffset = Signal->endOffset;
+	cache->framerate = Signal->framerate;
+	cache->EstimatedSR = Signal->EstimatedSR;
+	for(int i = 0; i < 2; i++)
+	{
+		cache->alignPct[i] = config->syncAlignPct[SYNC_ALIGN_SLOT(Signal->role, i)];
+		cache->alignTolerance[i] = config->syncAlignTolerance[SYNC_ALIGN_SLOT(Signal->role, i)];
+	}
+	cache->internalCount = 0;
+	cache->internalPending = 0;
+	cache->valid = 1;
+
+	SaveSyncCache(Signal, config);
+}
+
+// Results are derived from the offsets, if they differ the code changed since it was saved and the offsets are dropped
+int CheckSyncCache(AudioSignal *Signal, parameters *config)
+{
+	SyncCache	*cache = &Signal->syncCache;
+
+	if(cache->framerate == Signal->framerate && cache->EstimatedSR == Signal->EstimatedSR)
+		return 1;
+
+	logmsg(" - WARNING: Cached sync does not match the current detection, detecting again\n");
+	if(config->debugSync)
+		logmsgFileOnly("Sync cache framerate %.17g and sample rate %.17g differ from %.17g and %.17g\n",
+			cache->framerate, cache->EstimatedSR, Signal->framerate, Signal->EstimatedSR);
+
+	// The sample hash is kept for the new results, the file is not read again
+	cache->valid = 0;
+	cache->internalCount = 0;
+	cache->rejected = 1;
+	return 0;
+}
+
+int GetCachedInternalSync(AudioSignal *Signal, long int pos, long int *offset, long int *endPulse, int *toleranceIssue)
+{
+	SyncCache	*cache = &Signal->syncCache;
+
+	if(!cache->valid)
+		return 0;
+
+	for(int i = 0; i < cache->internalCount; i++)
+	{
+		if(cache->internal[i].pos == pos)
+		{
+			*offset = cache->internal[i].offset;
+			*endPulse = cache->internal[i].endPulse;
+			*toleranceIssue = cache->internal[i].toleranceIssue;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void StoreInternalSync(AudioSignal *Signal, long int pos, long int offset, long int endPulse, int toleranceIssue)
+{
+	SyncCache			*cache = &Signal->syncCache;
+	InternalSyncCache	*entry = NULL;
+
+	if(!cache->valid || cache->internalCount >= DELAYCOUNT)
+		return;
+
+	entry = &cache->internal[cache->internalCount++];
+	entry->pos = pos;
+	entry->offset = offset;
+	entry->endPulse = endPulse;
+	entry->toleranceIssue = toleranceIssue;
+	cache->internalPending = 1;
+}
+
+// Internal sync results are only kept in memory as they are found, saved once all blocks went through
+void FlushInternalSync(AudioSignal *Signal, parameters *config)
+{
+	SyncCache	*cache = &Signal->syncCache;
+
+	if(!cache->valid || !cache->internalPending)
+		return;
+
+	cache->internalPending = 0;
+	SaveSyncCache(Signal, config);
+}
@@ -0,0 +1,46 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library:
+ *	  http://www.fftw.org/
+ *
+ */
+
+#ifndef MDFOURIER_SYNCCACHE_H
+#define MDFOURIER_SYNCCACHE_H
+
+#include "mdfourier.h"
+
+#define SYNC_CACHE_EXT		".mdfsync"
+#define SYNC_CACHE_VERSION	2
+
+uint64_t HashSamples(SampleValue *samples, long int count);
+int LoadSyncCache(AudioSignal *Signal, parameters *config);
+int SaveSyncCache(AudioSignal *Signal, parameters *config);
+void StoreSyncCache(AudioSignal *Signal, parameters *config);
+int CheckSyncCache(AudioSignal *Signal, parameters *config);
+int GetCachedInternalSync(AudioSignal *Signal, long int pos, long int *offset, long int *endPulse, int *toleranceIssue);
+void StoreInternalSync(AudioSignal *Signal, long int pos, long int offset, long int endPulse, int toleranceIssue);
+void FlushInternalSync(AudioSignal *Signal, parameters *config);
+
+#endif
@@ -0,0 +1,307 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ */
+
+/*
+ * Checks each sample decode kernel ConvertWAVBlock uses against its scalar
+ * loop, bit for bit. Inputs are random bytes plus the extremes of each
+ * format, every count up to a few vector widths is run so each tail length
+ * is hit, from every start alignment and ending right before an unreadable
+ * page so a kernel reading past its last sample faults. Guard values after
+ * the output catch writes past it. Then both paths are timed per format,
+ * taking turns, and the fastest call of each is shown.
+ *
+ * The SIMD path is picked at build time, make decodetest builds this once
+ * for SSE2 and once for SSSE3, with double and with float samples.
+ *
+ * usage: decodebench [runs [samples]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "../mdfourier.h"
+#include "../decode.h"
+
+#define BENCH_RUNS		50
+#define BENCH_SAMPLES	(4*1024*1024)
+#define CHECK_COUNTS	72		// every count up to here, a few times the widest step
+#define CHECK_LONG		100003	// odd so the long run ends in a tail too
+#define CHECK_ALIGN		16
+#define GUARD_SAMPLES	8
+#define GUARD_BYTE		0xA5
+
+typedef void (*DecodeKernel)(const uint8_t *bytes, SampleValue *samples, long int count);
+
+typedef struct decode_format_st {
+	char			*name;
+	int				bytes;
+	DecodeKernel	kernel;
+	DecodeKernel	scalar;
+} DecodeFormat;
+
+static DecodeFormat formats[] = {
+	{ "PCM 8",    1, DecodePCM8,    DecodePCM8Scalar },
+	{ "PCM 16",   2, DecodePCM16,   DecodePCM16Scalar },
+	{ "PCM 24",   3, DecodePCM24,   DecodePCM24Scalar },
+	{ "PCM 32",   4, DecodePCM32,   DecodePCM32Scalar },
+	{ "Float 32", 4, DecodeFloat32, DecodeFloat32Scalar },
+};
+
+static unsigned long int seed = 1;
+
+static uint8_t NextByte(void)
+{
+	seed = seed*6364136223846793005UL + 1442695040888963407UL;
+	return (uint8_t)(seed >> 56);
+}
+
+// Little endian values that sit on the edges of each format
+static void WriteEdgeValues(DecodeFormat *format, uint8_t *bytes, long int count)
+{
+	uint32_t	pcm[] = { 0x00000000, 0xFFFFFFFF, 0x80000000, 0x7FFFFFFF, 0x00800000, 0x007FFFFF,
+						  0xFF800000, 0x00008000, 0x00007FFF, 0x00000080, 0x0000007F,
+						  0x01000001, 0x01000003, 0x7FFFFFC0, 0x7FFFFF80, 0x80000001 };
+	float		ieee[] = { 0.0f, -0.0f, 1.0f, -1.0f, 1e-45f, -1e-45f, 1.17549421e-38f, 3.40282347e+38f,
+						   INFINITY, -INFINITY, NAN, 16777217.0f, 0.1f, -32768.0f, 8388607.0f, 2147483648.0f };
+	long int	edges = 0;
+
+	edges = sizeof(pcm)/sizeof(pcm[0]);
+	if(edges > count)
+		edges = count;
+	for(long int i = 0; i < edges; i++)
+	{
+		if(format->kernel == DecodeFloat32)
+			memcpy(bytes+i*format->bytes, &ieee[i], sizeof(float));
+		else
+			memcpy(bytes+i*format->bytes, &pcm[i], format->bytes);
+	}
+}
+
+static void FillInput(DecodeFormat *format, uint8_t *bytes, long int count)
+{
+	for(long int i = 0; i < count*format->bytes; i++)
+		bytes[i] = NextByte();
+	WriteEdgeValues(format, bytes, count);
+}
+
+static int CheckGuard(SampleValue *samples, long int count)
+{
+	uint8_t	*guard = (uint8_t*)(samples+count);
+
+	for(size_t i = 0; i < sizeof(SampleValue)*GUARD_SAMPLES; i++)
+	{
+		if(guard[i] != GUARD_BYTE)
+			return 0;
+	}
+	return 1;
+}
+
+// One call of each path on the same bytes, 0 on any difference
+static int CheckRun(DecodeFormat *format, const uint8_t *bytes, long int count, SampleValue *kernelOut, SampleValue *scalarOut, char *where)
+{
+	memset(kernelOut, GUARD_BYTE, sizeof(SampleValue)*(count+GUARD_SAMPLES));
+	memset(scalarOut, GUARD_BYTE, sizeof(SampleValue)*(count+GUARD_SAMPLES));
+
+	format->kernel(bytes, kernelOut, count);
+	format->scalar(bytes, scalarOut, count);
+
+	for(long int i = 0; i < count; i++)
+	{
+		if(memcmp(&kernelOut[i], &scalarOut[i], sizeof(SampleValue)) != 0)
+		{
+			printf("FAIL %s %s, %ld samples: sample %ld is %.17g, scalar gives %.17g\n",
+				format->name, where, count, i, (double)kernelOut[i], (double)scalarOut[i]);
+			return 0;
+		}
+	}
+	if(!CheckGuard(kernelOut, count) || !CheckGuard(scalarOut, count))
+	{
+		printf("FAIL %s %s, %ld samples: wrote past the last sample\n", format->name, where, count);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+	guarded is the start of the page that can't be read, inputs are placed
+	to end there. base is CHECK_ALIGN bytes before a page boundary.
+*/
+static int CheckFormat(DecodeFormat *format, uint8_t *base, uint8_t *guarded, SampleValue *kernelOut, SampleValue *scalarOut)
+{
+	int		failed = 0;
+
+	for(long int count = 0; count <= CHECK_COUNTS; count++)
+	{
+		uint8_t	*end = guarded - count*format->bytes;
+
+		FillInput(format, end, count);
+		if(!CheckRun(format, end, count, kernelOut, scalarOut, "at a page end"))
+			failed++;
+
+		for(int align = 0; align < CHECK_ALIGN; align++)
+		{
+			FillInput(format, base+align, count);
+			if(!CheckRun(format, base+align, count, kernelOut, scalarOut, "unaligned"))
+				failed++;
+		}
+	}
+
+	FillInput(format, guarded - CHECK_LONG*format->bytes, CHECK_LONG);
+	if(!CheckRun(format, guarded - CHECK_LONG*format->bytes, CHECK_LONG, kernelOut, scalarOut, "long run"))
+		failed++;
+
+	return failed;
+}
+
+static double ElapsedMS(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec)*1000.0 + (end->tv_nsec - start->tv_nsec)/1000000.0;
+}
+
+static double TimeCall(DecodeKernel kernel, const uint8_t *bytes, SampleValue *samples, long int count)
+{
+	struct timespec	start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	kernel(bytes, samples, count);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return ElapsedMS(&start, &end);
+}
+
+/*
+	Both paths take turns and the fastest call of each is kept, timing one
+	after the other favoured whichever ran second
+*/
+static void TimeFormat(DecodeFormat *format, uint8_t *bytes, SampleValue *samples, long int count, long int runs)
+{
+	double	kernelMS = 0, scalarMS = 0;
+
+	FillInput(format, bytes, count);
+
+	// First touch outside the timing
+	format->kernel(bytes, samples, count);
+	format->scalar(bytes, samples, count);
+	for(long int run = 0; run < runs; run++)
+	{
+		double	elapsed = 0;
+
+		elapsed = TimeCall(format->kernel, bytes, samples, count);
+		if(!run || elapsed < kernelMS)
+			kernelMS = elapsed;
+		elapsed = TimeCall(format->scalar, bytes, samples, count);
+		if(!run || elapsed < scalarMS)
+			scalarMS = elapsed;
+	}
+
+	printf(" - %-8s kernel %7.3f ms  scalar %7.3f ms  (%0.2fx)\n", format->name,
+		kernelMS, scalarMS, kernelMS > 0 ? scalarMS/kernelMS : 0);
+}
+
+static char *GetBuildName(void)
+{
+#if defined(__SSSE3__)
+	return "SSSE3";
+#elif defined(__SSE2__)
+	return "SSE2";
+#else
+	return "scalar only";
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+	long int	runs = BENCH_RUNS, count = BENCH_SAMPLES, page = 0;
+	size_t		checkBytes = 0, mapSize = 0;
+	uint8_t		*map = NULL, *guarded = NULL, *bytes = NULL;
+	SampleValue	*kernelOut = NULL, *scalarOut = NULL;
+	int			failed = 0, formatCount = sizeof(formats)/sizeof(formats[0]);
+
+	if(argc > 1)
+		runs = atol(argv[1]);
+	if(argc > 2)
+		count = atol(argv[2]);
+	if(runs <= 0 || count <= 0)
+	{
+		printf("usage: decodebench [runs [samples]]\n");
+		return 1;
+	}
+
+	// Room for the long run ahead of an unreadable page
+	page = sysconf(_SC_PAGESIZE);
+	checkBytes = ((CHECK_LONG*4 + CHECK_ALIGN + CHECK_COUNTS*4)/page + 1)*page;
+	mapSize = checkBytes + page;
+	map = (uint8_t*)mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(map == MAP_FAILED || mprotect(map + checkBytes, page, PROT_NONE) != 0)
+	{
+		printf("FAIL could not map the check buffer\n");
+		return 1;
+	}
+	guarded = map + checkBytes;
+
+	kernelOut = (SampleValue*)malloc(sizeof(SampleValue)*(CHECK_LONG+GUARD_SAMPLES));
+	scalarOut = (SampleValue*)malloc(sizeof(SampleValue)*(CHECK_LONG+GUARD_SAMPLES));
+	bytes = (uint8_t*)malloc(sizeof(uint8_t)*count*4);
+	if(!kernelOut || !scalarOut || !bytes)
+	{
+		printf("FAIL malloc\n");
+		free(kernelOut);
+		free(scalarOut);
+		free(bytes);
+		munmap(map, mapSize);
+		return 1;
+	}
+
+	printf("%s build, %s samples\n", GetBuildName(), sizeof(SampleValue) == sizeof(float) ? "float" : "double");
+	for(int f = 0; f < formatCount; f++)
+	{
+		int	formatFailed = 0;
+
+		formatFailed = CheckFormat(&formats[f], map + page - CHECK_ALIGN, guarded, kernelOut, scalarOut);
+		if(!formatFailed)
+			printf("OK   %s matches the scalar loop, 0-%d samples from %d alignments and %d\n",
+				formats[f].name, CHECK_COUNTS, CHECK_ALIGN, CHECK_LONG);
+		failed += formatFailed;
+	}
+
+	free(kernelOut);
+	kernelOut = (SampleValue*)malloc(sizeof(SampleValue)*count);
+	if(kernelOut)
+	{
+		printf("%ld samples, fastest call of %ld:\n", count, runs);
+		for(int f = 0; f < formatCount; f++)
+			TimeFormat(&formats[f], bytes, kernelOut, count, runs);
+	}
+	else
+		printf("Not enough memory for the timing\n");
+
+	printf("%s: %d mismatches\n", failed ? "FAIL" : "OK", failed);
+
+	free(kernelOut);
+	free(scalarOut);
+	free(bytes);
+	munmap(map, mapSize);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,298 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ */
+
+/*
+ * Writes a set of known differences with SaveBinaryDifferences (-b), maps
+ * the .mdfd file and checks the header, the column alignment and every
+ * value against what was written. Also checks that a file that can't be
+ * created is reported and nothing is left behind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../mdfourier.h"
+#include "../diff.h"
+
+#define TEST_NAME		"tests/diffexport_out"
+#define TEST_BADNAME	"tests/diffexport_missing/out"
+#define TEST_BLOCKS		7
+
+// diff.c only needs these from the rest of MDFourier
+void logmsg(char *fmt, ... )
+{
+	va_list arguments;
+
+	va_start(arguments, fmt);
+	vprintf(fmt, arguments);
+	va_end(arguments);
+}
+
+void logmsgFileOnly(char *fmt, ... )
+{
+	(void)fmt;
+}
+
+int GetBlockType(parameters *config, int pos)
+{
+	(void)config;
+	return pos % 3 + 1;
+}
+
+char GetBlockChannel(parameters *config, int pos)
+{
+	(void)config;
+	return pos % 2 ? CHANNEL_STEREO : CHANNEL_MONO;
+}
+
+char *GetBlockName(parameters *config, int pos)
+{
+	(void)config;
+	(void)pos;
+	return "Test";
+}
+
+int GetBlockSubIndex(parameters *config, int pos)
+{
+	(void)config;
+	return pos;
+}
+
+int CalculateMaxCompare(int block, AudioSignal *Signal, double significant, char channel, parameters *config)
+{
+	(void)block;
+	(void)Signal;
+	(void)significant;
+	(void)channel;
+	(void)config;
+	return 0;
+}
+
+// Block 0 and every third one are left empty, the rest have a few rows
+static long int GetTestRows(int block)
+{
+	if(block % 3 == 0)
+		return 0;
+	return block*113 + 5;
+}
+
+static double GetTestValue(int block, long int row, int column)
+{
+	return block*1000.0 + row + column/8.0;
+}
+
+static int FillTestDifferences(parameters *config)
+{
+	config->types.totalBlocks = TEST_BLOCKS;
+	config->significantAmplitude = -60.5;
+	config->averageDifference = 1.25;
+	config->Differences.BlockDiffArray = (BlockDifference*)calloc(TEST_BLOCKS, sizeof(BlockDifference));
+	if(!config->Differences.BlockDiffArray)
+		return 0;
+
+	for(int b = 0; b < TEST_BLOCKS; b++)
+	{
+		BlockDifference	*blk = &config->Differences.BlockDiffArray[b];
+
+		if(!GetTestRows(b))
+			continue;
+
+		blk->amplDiffArray = (AmplDifference*)calloc(GetTestRows(b), sizeof(AmplDifference));
+		if(!blk->amplDiffArray)
+			return 0;
+		blk->cntAmplBlkDiff = GetTestRows(b);
+		for(long int a = 0; a < blk->cntAmplBlkDiff; a++)
+		{
+			blk->amplDiffArray[a].hertz = GetTestValue(b, a, DIFF_COL_HERTZ);
+			blk->amplDiffArray[a].refAmplitude = GetTestValue(b, a, DIFF_COL_REFAMPLITUDE);
+			blk->amplDiffArray[a].diffAmplitude = GetTestValue(b, a, DIFF_COL_DIFFAMPLITUDE);
+			blk->amplDiffArray[a].channel = a % 2 ? CHANNEL_RIGHT : CHANNEL_LEFT;
+		}
+	}
+	return 1;
+}
+
+static void ReleaseTestDifferences(parameters *config)
+{
+	if(!config->Differences.BlockDiffArray)
+		return;
+	for(int b = 0; b < TEST_BLOCKS; b++)
+		free(config->Differences.BlockDiffArray[b].amplDiffArray);
+	free(config->Differences.BlockDiffArray);
+	config->Differences.BlockDiffArray = NULL;
+}
+
+static int CheckColumns(DiffExportHeader *header, char *data, size_t size)
+{
+	uint64_t	row = 0;
+
+	for(int c = 0; c < DIFF_COL_COUNT; c++)
+	{
+		if(header->offset[c] % DIFF_EXPORT_ALIGN || header->offset[c] < sizeof(DiffExportHeader) || header->offset[c] > size)
+		{
+			printf("FAIL column %d: offset %llu is not aligned or out of the file\n", c, (unsigned long long)header->offset[c]);
+			return 0;
+		}
+	}
+
+	for(int b = 0; b < TEST_BLOCKS; b++)
+	{
+		for(long int a = 0; a < GetTestRows(b); a++, row++)
+		{
+			double	*hertz = (double*)(data + header->offset[DIFF_COL_HERTZ]);
+			double	*ref = (double*)(data + header->offset[DIFF_COL_REFAMPLITUDE]);
+			double	*diff = (double*)(data + header->offset[DIFF_COL_DIFFAMPLITUDE]);
+			int32_t	*block = (int32_t*)(data + header->offset[DIFF_COL_BLOCK]);
+			int32_t	*type = (int32_t*)(data + header->offset[DIFF_COL_TYPE]);
+			int8_t	*channel = (int8_t*)(data + header->offset[DIFF_COL_CHANNEL]);
+
+			if(hertz[row] != GetTestValue(b, a, DIFF_COL_HERTZ) ||
+				ref[row] != GetTestValue(b, a, DIFF_COL_REFAMPLITUDE) ||
+				diff[row] != GetTestValue(b, a, DIFF_COL_DIFFAMPLITUDE) ||
+				block[row] != b || type[row] != GetBlockType(NULL, b) ||
+				channel[row] != (a % 2 ? CHANNEL_RIGHT : CHANNEL_LEFT))
+			{
+				printf("FAIL row %llu (block %d entry %ld) does not match\n", (unsigned long long)row, b, a);
+				return 0;
+			}
+		}
+	}
+
+	if(header->offset[DIFF_COL_CHANNEL] + row*sizeof(int8_t) != size)
+	{
+		printf("FAIL file is %llu bytes, expected %llu\n", (unsigned long long)size,
+			(unsigned long long)(header->offset[DIFF_COL_CHANNEL] + row*sizeof(int8_t)));
+		return 0;
+	}
+	return 1;
+}
+
+static int CheckRoundTrip(parameters *config)
+{
+	char				name[BUFFER_SIZE];
+	DiffExportHeader	*header = NULL;
+	struct stat			st;
+	uint64_t			count = 0;
+	char				*data = NULL;
+	int					fd = -1, ok = 0;
+
+	if(!SaveBinaryDifferences(TEST_NAME, config))
+	{
+		printf("FAIL could not export the differences\n");
+		return 0;
+	}
+
+	sprintf(name, "%s%s", TEST_NAME, DIFF_EXPORT_EXT);
+	fd = open(name, O_RDONLY);
+	if(fd == -1 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(DiffExportHeader))
+	{
+		printf("FAIL could not open %s\n", name);
+		if(fd != -1)
+			close(fd);
+		return 0;
+	}
+
+	data = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED)
+	{
+		printf("FAIL could not map %s\n", name);
+		return 0;
+	}
+
+	for(int b = 0; b < TEST_BLOCKS; b++)
+		count += GetTestRows(b);
+
+	header = (DiffExportHeader*)data;
+	if(memcmp(header->magic, DIFF_EXPORT_MAGIC, sizeof(DIFF_EXPORT_MAGIC)) != 0 ||
+		header->version != DIFF_EXPORT_VERSION || header->byteOrder != DIFF_EXPORT_BYTE_ORDER ||
+		header->headerSize != sizeof(DiffExportHeader) || header->columns != DIFF_COL_COUNT ||
+		header->count != count || header->totalBlocks != TEST_BLOCKS ||
+		header->significantAmplitude != config->significantAmplitude ||
+		header->averageDifference != config->averageDifference)
+		printf("FAIL header does not match\n");
+	else
+		ok = CheckColumns(header, data, st.st_size);
+
+	munmap(data, st.st_size);
+	remove(name);
+	if(ok)
+		printf("OK   %llu rows in %d blocks read back from a mapped file\n", (unsigned long long)count, TEST_BLOCKS);
+	return ok;
+}
+
+static int CheckFailure(parameters *config)
+{
+	char	name[BUFFER_SIZE];
+	FILE	*file = NULL;
+
+	if(SaveBinaryDifferences(TEST_BADNAME, config))
+	{
+		printf("FAIL export to a missing folder succeeded\n");
+		return 0;
+	}
+
+	sprintf(name, "%s%s", TEST_BADNAME, DIFF_EXPORT_EXT);
+	file = fopen(name, "rb");
+	if(file)
+	{
+		fclose(file);
+		printf("FAIL failed export left %s behind\n", name);
+		return 0;
+	}
+	printf("OK   failed export reported and nothing left behind\n");
+	return 1;
+}
+
+int main(void)
+{
+	parameters	*config = NULL;
+	int			failed = 0;
+
+	config = (parameters*)calloc(1, sizeof(parameters));
+	if(!config)
+		return 1;
+
+	if(!FillTestDifferences(config))
+	{
+		printf("FAIL malloc\n");
+		ReleaseTestDifferences(config);
+		free(config);
+		return 1;
+	}
+
+	if(!CheckRoundTrip(config))
+		failed++;
+	if(!CheckFailure(config))
+		failed++;
+
+	ReleaseTestDifferences(config);
+	free(config);
+	return failed ? 1 : 0;
+}
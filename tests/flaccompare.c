@@ -0,0 +1,196 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ */
+
+/*
+ * Decodes each FLAC file given with the sequential decoder and with the
+ * segmented one used by -6, and checks that both produce the same samples.
+ * flaccompare.sh builds the set of files it is meant to run on.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "../mdfourier.h"
+#include "../flac.h"
+
+#ifdef OPENMP_ENABLE
+	#include <omp.h>
+#endif
+
+#define MIN_THREADS	4
+
+// flac.c only needs these from the rest of MDFourier
+char *getFilenameExtension(char *filename)
+{
+	char *dot = NULL;
+
+	dot = strrchr(filename, '.');
+	if(!dot || dot == filename) 
+		return "";
+	return dot + 1;
+}
+
+void logmsg(char *fmt, ... )
+{
+	va_list arguments;
+
+	va_start(arguments, fmt);
+	vprintf(fmt, arguments);
+	va_end(arguments);
+}
+
+void logmsgFileOnly(char *fmt, ... )
+{
+	va_list arguments;
+
+	va_start(arguments, fmt);
+	vprintf(fmt, arguments);
+	va_end(arguments);
+}
+
+static AudioSignal *DecodeFile(char *name, int segmented)
+{
+	AudioSignal	*Signal = NULL;
+	int			ok = 0;
+
+	Signal = (AudioSignal*)calloc(1, sizeof(AudioSignal));
+	if(!Signal)
+		return NULL;
+
+	if(segmented)
+		ok = FLACtoSignalSegmented(name, Signal);
+	else
+		ok = FLACtoSignal(name, Signal);
+	if(!ok)
+	{
+		if(Signal->Samples)
+			free(Signal->Samples);
+		free(Signal);
+		return NULL;
+	}
+	return Signal;
+}
+
+static void ReleaseSignal(AudioSignal *Signal)
+{
+	if(!Signal)
+		return;
+	if(Signal->Samples)
+		free(Signal->Samples);
+	free(Signal);
+}
+
+static int CompareFile(char *name)
+{
+	AudioSignal	*sequential = NULL, *segmented = NULL;
+	long int	mismatch = -1;
+	int			ok = 0;
+
+	sequential = DecodeFile(name, 0);
+	if(!sequential)
+	{
+		printf("FAIL %s: sequential decoder could not decode the file\n", name);
+		return 0;
+	}
+
+	// The file must be long enough to be split, otherwise nothing is being tested
+	segmented = DecodeFile(name, 1);
+	if(!segmented)
+	{
+		printf("FAIL %s: segmented decoder did not split or decode the file\n", name);
+		ReleaseSignal(sequential);
+		return 0;
+	}
+
+	if(sequential->numSamples != segmented->numSamples ||
+		sequential->header.fmt.NumOfChan != segmented->header.fmt.NumOfChan ||
+		sequential->header.fmt.bitsPerSample != segmented->header.fmt.bitsPerSample ||
+		sequential->header.fmt.SamplesPerSec != segmented->header.fmt.SamplesPerSec)
+	{
+		printf("FAIL %s: stream info differs (%ld vs %ld samples)\n", name,
+			sequential->numSamples, segmented->numSamples);
+		ReleaseSignal(sequential);
+		ReleaseSignal(segmented);
+		return 0;
+	}
+
+	// Bit exact, the samples are integers stored as SampleValue
+	for(long int i = 0; i < sequential->numSamples; i++)
+	{
+		if(memcmp(&sequential->Samples[i], &segmented->Samples[i], sizeof(SampleValue)) != 0)
+		{
+			mismatch = i;
+			break;
+		}
+	}
+
+	if(mismatch >= 0)
+		printf("FAIL %s: sample %ld (channel %ld) is %g sequential and %g segmented\n", name,
+			mismatch/sequential->header.fmt.NumOfChan, mismatch%sequential->header.fmt.NumOfChan,
+			sequential->Samples[mismatch], segmented->Samples[mismatch]);
+	else
+	{
+		if(sequential->blocksizeFLAC)
+			printf("OK   %s: %ld samples %dch %d-bit, fixed blocksize %lu\n", name,
+				sequential->numSamples, sequential->header.fmt.NumOfChan, sequential->header.fmt.bitsPerSample,
+				(unsigned long)sequential->blocksizeFLAC);
+		else
+			printf("OK   %s: %ld samples %dch %d-bit, variable blocksize\n", name,
+				sequential->numSamples, sequential->header.fmt.NumOfChan, sequential->header.fmt.bitsPerSample);
+		ok = 1;
+	}
+
+	ReleaseSignal(sequential);
+	ReleaseSignal(segmented);
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	int		failed = 0;
+
+	if(argc < 2)
+	{
+		printf("usage: flaccompare file.flac [file.flac ...]\n");
+		return 1;
+	}
+
+#ifdef OPENMP_ENABLE
+	if(omp_get_max_threads() < MIN_THREADS)
+		omp_set_num_threads(MIN_THREADS);
+#else
+	printf("FAIL: built without OpenMP, the segmented decoder never splits the stream\n");
+	return 1;
+#endif
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(!CompareFile(argv[i]))
+			failed++;
+	}
+
+	printf("%d of %d files decoded identically\n", argc - 1 - failed, argc - 1);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Builds the FLAC files the segmented decoder (-6) is checked with and runs
+# flaccompare on them: mono and stereo, 16 and 24 bit, fixed blocksize with
+# and without a seektable, and variable blocksize.
+# Needs sox and flac, the reference encoder only writes fixed blocksize
+# streams so the variable blocksize ones are made with flake when present.
+
+DIR=${1:-tests/flacdata}
+COMPARE=${COMPARE:-tests/flaccompare}
+SECONDS_LONG=75
+
+mkdir -p "$DIR" || exit 1
+FILES=""
+MISSING=0
+
+for bits in 16 24; do
+	for channels in 1 2; do
+		name="$DIR/${bits}bit_${channels}ch"
+
+		# Long enough to be split in several segments
+		sox -n -r 48000 -b $bits -c $channels "$name.wav" synth $SECONDS_LONG pinknoise vol 0.5 || exit 1
+
+		flac -s -f --blocksize=4096 -o "$name.seek.flac" "$name.wav" || exit 1
+		flac -s -f --blocksize=4096 --no-seektable -o "$name.noseek.flac" "$name.wav" || exit 1
+		FILES="$FILES $name.seek.flac $name.noseek.flac"
+
+		if command -v flake >/dev/null 2>&1; then
+			flake -v 1 "$name.wav" -o "$name.variable.flac" || exit 1
+			FILES="$FILES $name.variable.flac"
+		else
+			echo "flake not found, variable blocksize $bits bit ${channels}ch can't be tested"
+			MISSING=1
+		fi
+	done
+done
+
+$COMPARE $FILES || exit 1
+exit $MISSING
@@ -0,0 +1,200 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2021 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ */
+
+/*
+ * Compares the two ways FillFrequencyStructuresInternal can keep the top
+ * MaxFreq bins of a block: sorting the whole spectrum and keeping the
+ * first ones, and selecting them first and sorting only those. Both have
+ * to give the same bins in the same order, ties included, and both are
+ * timed.
+ *
+ * usage: rankbench [runs [bins [amount]]], defaults are one 20 kHz block
+ * at 1 Hz resolution and the default MaxFreq.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../mdfourier.h"
+#include "../spectrum.h"
+
+#define BENCH_RUNS		2000
+#define BENCH_BINS		19980
+
+static unsigned long int seed = 1;
+
+static double NextRandom(void)
+{
+	seed = seed*6364136223846793005UL + 1442695040888963407UL;
+	return (double)(seed >> 11)/(double)(1UL << 53);
+}
+
+/*
+	Every third run is quantized so many magnitudes tie, ties have to
+	come out by ascending bin like the stable sort leaves them
+*/
+static void FillBins(BinRank *bins, long int count, int run)
+{
+	for(long int i = 0; i < count; i++)
+	{
+		double	magnitude = 0;
+
+		magnitude = NextRandom()*NextRandom()*1000.0;
+		if(run % 3 == 2)
+			magnitude = floor(magnitude/25.0);
+		bins[i].magnitude = magnitude;
+		bins[i].bin = i + 20;
+	}
+}
+
+static double ElapsedMS(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec)*1000.0 + (end->tv_nsec - start->tv_nsec)/1000000.0;
+}
+
+static long int CompareRanks(BinRank *sorted, BinRank *selected, long int amount)
+{
+	for(long int i = 0; i < amount; i++)
+	{
+		if(sorted[i].bin != selected[i].bin || sorted[i].magnitude != selected[i].magnitude)
+			return i;
+	}
+	return -1;
+}
+
+static int RunCase(BinRank *input, BinRank *sorted, BinRank *selected, long int count, long int amount, int run, double *sortMS, double *selectMS)
+{
+	struct timespec	start, end;
+	long int		mismatch = 0;
+
+	FillBins(input, count, run);
+	memcpy(sorted, input, sizeof(BinRank)*count);
+	memcpy(selected, input, sizeof(BinRank)*count);
+
+	// What FillFrequencyStructuresInternal did before
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	SortBins(sorted, count);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*sortMS += ElapsedMS(&start, &end);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	SelectTopBins(selected, count, amount);
+	SortBins(selected, amount < count ? amount : count);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*selectMS += ElapsedMS(&start, &end);
+
+	mismatch = CompareRanks(sorted, selected, amount < count ? amount : count);
+	if(mismatch != -1)
+	{
+		printf("FAIL %ld bins, top %ld, run %d: rank %ld is bin %ld sorted and bin %ld selected\n",
+			count, amount, run, mismatch, sorted[mismatch].bin, selected[mismatch].bin);
+		return 0;
+	}
+	return 1;
+}
+
+// Sizes that hit the early returns and the smallest partitions
+static int RunEdgeCases(BinRank *input, BinRank *sorted, BinRank *selected)
+{
+	long int	cases[][2] = { { 1, 1 }, { 2, 1 }, { 3, 2 }, { 10, 0 }, { 10, 10 }, { 10, 20 }, { 100, 1 }, { 100, 99 } };
+	double		ignored = 0;
+	int			failed = 0;
+
+	for(unsigned int c = 0; c < sizeof(cases)/sizeof(cases[0]); c++)
+	{
+		for(int run = 0; run < 3; run++)
+		{
+			if(!RunCase(input, sorted, selected, cases[c][0], cases[c][1], run, &ignored, &ignored))
+				failed++;
+		}
+	}
+
+	// Every magnitude equal, the whole order comes from the tie break
+	for(long int i = 0; i < 1000; i++)
+	{
+		input[i].magnitude = 1.0;
+		input[i].bin = 999 - i;
+	}
+	memcpy(sorted, input, sizeof(BinRank)*1000);
+	memcpy(selected, input, sizeof(BinRank)*1000);
+	SortBins(sorted, 1000);
+	SelectTopBins(selected, 1000, 100);
+	SortBins(selected, 100);
+	if(CompareRanks(sorted, selected, 100) != -1)
+	{
+		printf("FAIL equal magnitudes do not keep the bin order\n");
+		failed++;
+	}
+	return failed;
+}
+
+int main(int argc, char *argv[])
+{
+	BinRank		*input = NULL, *sorted = NULL, *selected = NULL;
+	long int	runs = BENCH_RUNS, count = BENCH_BINS, amount = FREQ_COUNT;
+	double		sortMS = 0, selectMS = 0;
+	int			failed = 0;
+
+	if(argc > 1)
+		runs = atol(argv[1]);
+	if(argc > 2)
+		count = atol(argv[2]);
+	if(argc > 3)
+		amount = atol(argv[3]);
+	if(runs <= 0 || count < 1000 || amount < 0)
+	{
+		printf("usage: rankbench [runs [bins >= 1000 [amount]]]\n");
+		return 1;
+	}
+
+	input = (BinRank*)malloc(sizeof(BinRank)*count);
+	sorted = (BinRank*)malloc(sizeof(BinRank)*count);
+	selected = (BinRank*)malloc(sizeof(BinRank)*count);
+	if(!input || !sorted || !selected)
+	{
+		printf("FAIL malloc\n");
+		free(input);
+		free(sorted);
+		free(selected);
+		return 1;
+	}
+
+	failed = RunEdgeCases(input, sorted, selected);
+	for(long int run = 0; run < runs; run++)
+	{
+		if(!RunCase(input, sorted, selected, count, amount, run, &sortMS, &selectMS))
+			failed++;
+	}
+
+	printf("%ld bins, top %ld, %ld runs, a third of them with tied magnitudes\n", count, amount, runs);
+	printf(" - Full sort:       %0.3f ms per block\n", sortMS/runs);
+	printf(" - Select and sort: %0.3f ms per block (%0.2fx)\n", selectMS/runs, selectMS > 0 ? sortMS/selectMS : 0);
+	printf("%s: %d ordering mismatches\n", failed ? "FAIL" : "OK", failed);
+
+	free(input);
+	free(sorted);
+	free(selected);
+	return failed ? 1 : 0;
+}
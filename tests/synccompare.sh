@@ -0,0 +1,40 @@
+#!/bin/sh
+# Runs the sync detection on each capture with the pulse scanner and with
+# the correlator (-2), and prints the start and end offsets both report.
+# usage: synccompare.sh profile.mfn capture.wav [capture.wav ...]
+# MDFOURIER can point to the binary, extra options can go in OPTIONS.
+
+MDFOURIER=${MDFOURIER:-./mdfourier}
+PROFILE=$1
+FAILED=0
+
+if [ -z "$PROFILE" ] || [ $# -lt 2 ]; then
+	echo "usage: synccompare.sh profile.mfn capture.wav [capture.wav ...]"
+	exit 1
+fi
+shift
+
+# Same file as comparison, under another name so it is not skipped
+COPY=$(mktemp -d) || exit 1
+trap 'rm -rf "$COPY"' EXIT
+
+# Start and end offsets in samples from the verbose sync report of the reference
+offsets() {
+	ln -sf "$(cd "$(dirname "$1")" && pwd)/$(basename "$1")" "$COPY/$(basename "$1")"
+	$MDFOURIER -P "$PROFILE" -r "$1" -c "$COPY/$(basename "$1")" -v -l -D -M -S -F -g $OPTIONS $2 2>&1 |
+		grep -A2 "Sync pulse train" | grep -o "\[[0-9]* samples" | head -2 | tr -d '[a-z ' | tr '\n' ' '
+}
+
+printf "%-40s %-24s %-24s %s\n" "capture" "scan start/end" "-2 start/end" "difference"
+for capture in "$@"; do
+	scan=$(offsets "$capture" "")
+	corr=$(offsets "$capture" "-2")
+	set -- $scan $corr
+	if [ $# -ne 4 ]; then
+		printf "%-40s %-24s %-24s %s\n" "$capture" "$scan" "$corr" "not detected"
+		FAILED=1
+		continue
+	fi
+	printf "%-40s %-24s %-24s %d/%d\n" "$capture" "$1/$2" "$3/$4" $(($3 - $1)) $(($4 - $2))
+done
+exit $FAILED
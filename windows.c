@@ -31,38 +31,109 @@
 #include "log.h"
 #include "freq.h"
 
-#define MAX_WINDOWS	100
+#define MAX_WINDOWS		100
+#define WINDOW_BUCKETS	64
+
+/*
+	Windows are shared by every manager in the process, keyed by type,
+	sample rate and sizes. Entries are only released at exit, so the
+	units handed out stay valid while other threads add new ones.
+*/
+windowUnit	*windowCache[WINDOW_BUCKETS];
+int			windowCacheCount = 0;
+
+unsigned int HashWindow(char winType, double SampleRate, long int size, long int sizePadding, long int clkAdjust)
+{
+	unsigned long int hash = 0;
+
+	hash = (unsigned long int)size;
+	hash = hash*31 + (unsigned long int)sizePadding;
+	hash = hash*31 + (unsigned long int)clkAdjust;
+	hash = hash*31 + (unsigned long int)SampleRate;
+	hash = hash*31 + (unsigned long int)winType;
+	return(hash % WINDOW_BUCKETS);
+}
+
+windowUnit *FindCachedWindow(char winType, double SampleRate, long int size, long int sizePadding, long int clkAdjust, int ZeroPad)
+{
+	windowUnit *unit = NULL;
+
+	unit = windowCache[HashWindow(winType, SampleRate, size, sizePadding, clkAdjust)];
+	while(unit)
+	{
+		if(unit->size == size && unit->sizePadding == sizePadding &&
+			unit->clkAdjust == clkAdjust && unit->winType == winType &&
+			unit->SampleRate == SampleRate && unit->ZeroPad == ZeroPad)
+			return unit;
+		unit = unit->next;
+	}
+	return NULL;
+}
 
 int initWindows(windowManager *wm, double SampleRate, char winType, parameters *config)
 {
 	if(!wm || !config)
 		return 0;
 
+	// Only the list of windows used is kept here, for drawing them
+	wm->windowArray = NULL;
+	wm->windowCount = 0;
 	wm->MaxWindow = 0;
-	wm->SampleRate = 0;
-	wm->winType = 'n';
-	
-	// Create the wm
-	wm->windowArray = (windowUnit*)malloc(sizeof(windowUnit)*MAX_WINDOWS);
-	if(!wm->windowArray)
+	wm->SampleRate = SampleRate;
+	wm->winType = winType;
+
+	return 1;
+}
+
+/*
+	Cached units keep the frames and seconds of whoever created them, the
+	list gets its own copy labelled for this caller. The window is shared.
+*/
+int AddWindowToManager(windowManager *wm, windowUnit *unit, long int frames, double seconds)
+{
+	windowUnit	*entry = NULL;
+
+	for(int i = 0; i < wm->windowCount; i++)
+	{
+		if(wm->windowArray[i]->window == unit->window && wm->windowArray[i]->frames == frames)
+			return 1;
+	}
+
+	if(wm->windowCount == wm->MaxWindow)
+	{
+		windowUnit **tmp = NULL;
+
+		tmp = (windowUnit**)realloc(wm->windowArray, sizeof(windowUnit*)*(wm->MaxWindow+MAX_WINDOWS));
+		if(!tmp)
+		{
+			logmsg("Not enough memory for expanded window manager\n");
+			return 0;
+		}
+		wm->windowArray = tmp;
+		wm->MaxWindow += MAX_WINDOWS;
+	}
+
+	entry = (windowUnit*)malloc(sizeof(windowUnit));
+	if(!entry)
 	{
 		logmsg("Not enough memory for window manager\n");
 		return 0;
 	}
-	wm->windowCount = 0;
-	wm->MaxWindow = MAX_WINDOWS-1;
-	wm->SampleRate = SampleRate;
-	wm->winType = winType;
-
-	memset(wm->windowArray, 0, sizeof(windowUnit)*MAX_WINDOWS);
+	*entry = *unit;
+	entry->frames = frames;
+	entry->seconds = seconds;
+	entry->next = NULL;
 
+	wm->windowArray[wm->windowCount++] = entry;
 	return 1;
 }
 
-double *CreateWindowInternal(windowManager *wm, double *(*createWindow)(long), char *name, double seconds, long windowSize, long sizePadding, long clkAdjustBufferSize, double frames, parameters *config)
+windowUnit *CreateWindowInternal(windowManager *wm, double *(*createWindow)(long), char *name, double seconds, long windowSize, long sizePadding, long clkAdjustBufferSize, double frames, parameters *config)
 {
-	long int realMemSize = 0;
-	double *window = NULL;
+	long int	realMemSize = 0;
+	double		*window = NULL, S2 = 0, sum = 0;
+	windowUnit	*unit = NULL;
+	unsigned int hash = 0;
 
 	realMemSize = windowSize;
 
@@ -105,19 +176,49 @@ double *CreateWindowInternal(windowManager *wm, double *(*createWindow)(long), c
 		memset(window+windowSize, 0, sizeof(double)*(realMemSize-windowSize));
 	}
 
-	wm->windowArray[wm->windowCount].window = window;
-	wm->windowArray[wm->windowCount].frames = frames;
-	wm->windowArray[wm->windowCount].seconds = seconds;
-	wm->windowArray[wm->windowCount].size = windowSize;
-	wm->windowArray[wm->windowCount].clkAdjust = clkAdjustBufferSize;
-	wm->windowArray[wm->windowCount].sizePadding = sizePadding;
-	wm->windowArray[wm->windowCount].realMemSize = realMemSize;
-	
-	wm->windowCount++;
-	return window;
+	// Same order as the per block sum, so the result is identical
+	for(long int i = 0; i < windowSize; i++)
+	{
+		S2 += window[i]*window[i];
+		sum += window[i];
+	}
+	if(isinf(S2) || !sum)
+	{
+		logmsg("ERROR: Window error in code detected, %s size %ld S2: %g\n", name, windowSize, S2);
+		free(window);
+		return NULL;
+	}
+
+	unit = (windowUnit*)malloc(sizeof(windowUnit));
+	if(!unit)
+	{
+		free(window);
+		logmsg("Not enough memory for window manager\n");
+		return NULL;
+	}
+
+	unit->window = window;
+	unit->frames = frames;
+	unit->seconds = seconds;
+	unit->size = windowSize;
+	unit->clkAdjust = clkAdjustBufferSize;
+	unit->sizePadding = sizePadding;
+	unit->realMemSize = realMemSize;
+	unit->S2 = S2;
+	unit->coherentGain = sum/(double)windowSize;
+	unit->winType = wm->winType;
+	unit->SampleRate = wm->SampleRate;
+	unit->ZeroPad = config->ZeroPad;
+
+	hash = HashWindow(unit->winType, unit->SampleRate, windowSize, sizePadding, clkAdjustBufferSize);
+	unit->next = windowCache[hash];
+	windowCache[hash] = unit;
+	windowCacheCount++;
+
+	return unit;
 }
 
-double *CreateWindow(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config)
+windowUnit *CreateWindow(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config)
 {
 	double		seconds = 0;
 	long int	size = 0;
@@ -133,21 +234,6 @@ double *CreateWindow(windowManager *wm, long int frames, long int cutFrames, dou
 		return NULL;
 	}
 
-	if(wm->windowCount == wm->MaxWindow)
-	{
-		windowUnit *tmp = NULL;
-
-		tmp = (windowUnit*)realloc(wm->windowArray, sizeof(windowUnit)*(wm->MaxWindow+MAX_WINDOWS));
-		if(!tmp)
-		{
-			logmsg("Not enough memory for expanded window manager\n");
-			return NULL;
-		}
-		wm->windowArray = tmp;
-		memset(wm->windowArray+wm->MaxWindow, 0, sizeof(windowUnit)*MAX_WINDOWS);
-		wm->MaxWindow += MAX_WINDOWS;
-	}
-
 	seconds = FramesToSeconds(frames-cutFrames, framerate);
 	size = ceil(wm->SampleRate*seconds);
 
@@ -197,15 +283,16 @@ double *CreateWindow(windowManager *wm, long int frames, long int cutFrames, dou
 	return NULL;
 }
 
-double *getWindowByLength(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config)
+windowUnit *getWindowUnitByLength(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config)
 {
 	double		seconds = 0;
 	long int	size = 0;
 	double		secondsPadding = 0;
-	long int	sizePadding = 0;
+	long int	sizePadding = 0, clkAdjustBufferSize = 0;
+	windowUnit	*unit = NULL;
 
 	if(!wm)
-		return 0;
+		return NULL;
 
 	seconds = FramesToSeconds(frames-cutFrames, framerate);
 	size = ceil(wm->SampleRate*seconds);
@@ -213,31 +300,56 @@ double *getWindowByLength(windowManager *wm, long int frames, long int cutFrames
 	secondsPadding = FramesToSeconds(cutFrames, framerate);
 	sizePadding = ceil(wm->SampleRate*secondsPadding);
 
+	if(config->doClkAdjust)
+		clkAdjustBufferSize = ceil(wm->SampleRate*FramesToSeconds(1, framerate));
+
 #ifdef DEBUG
 	if(config->verbose >= 3)
 		logmsg("Asked for window: %ld pad:%ld (%ld frames %ld cut frames %g fr)\n",
 			size, sizePadding, frames, cutFrames, framerate);
 #endif
 
-	for(int i = 0; i < wm->windowCount; i++)
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (window_cache)
+#endif
 	{
-		if(size == wm->windowArray[i].size && sizePadding == wm->windowArray[i].sizePadding)
+		unit = FindCachedWindow(wm->winType, wm->SampleRate, size, sizePadding, clkAdjustBufferSize, config->ZeroPad);
+		if(!unit)
 		{
 #ifdef DEBUG
 			if(config->verbose >= 2)
-				logmsg("Served window size %ld zero:%ld (%ld frames %ld cut frames %g fr)\n",
-					size, sizePadding, frames, cutFrames, framerate);
+				logmsg("Creating window %ld zero:%ld (%ld frames %ld cut frames %g fr)\n", size, sizePadding, frames, cutFrames, framerate);
 #endif
-			
-			return wm->windowArray[i].window;
+			unit = CreateWindow(wm, frames, cutFrames, framerate, config);
 		}
+		if(unit && config->drawWindows && !AddWindowToManager(wm, unit, frames, seconds))
+			unit = NULL;
 	}
 
-#ifdef DEBUG
-	if(config->verbose >= 2)
-		logmsg("Creating window %ld zero:%ld (%ld frames %ld cut frames %g fr)\n", size, sizePadding, frames, cutFrames, framerate);
-#endif
-	return CreateWindow(wm, frames, cutFrames, framerate, config);
+	return unit;
+}
+
+double *getWindowByLength(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config)
+{
+	windowUnit	*unit = NULL;
+
+	unit = getWindowUnitByLength(wm, frames, cutFrames, framerate, config);
+	if(!unit)
+		return NULL;
+	return unit->window;
+}
+
+// Energy of the first length samples, the padding after size is all zeroes
+double GetWindowEnergy(windowUnit *unit, long int length)
+{
+	double S2 = 0;
+
+	if(length >= unit->size)
+		return unit->S2;
+
+	for(long int i = 0; i < length; i++)
+		S2 += unit->window[i]*unit->window[i];
+	return S2;
 }
 
 void freeWindows(windowManager *wm)
@@ -245,34 +357,46 @@ void freeWindows(windowManager *wm)
 	if(!wm)
 		return;
 
-	for(int i = 0; i < wm->windowCount; i++)
-	{
-		if(wm->windowArray[i].window)
-		{
-			free(wm->windowArray[i].window);
-			wm->windowArray[i].window = NULL;
-		}
-	}
-	if(wm->windowCount)
+	if(wm->windowArray)
 	{
+		for(int i = 0; i < wm->windowCount; i++)
+			free(wm->windowArray[i]);
 		free(wm->windowArray);
 		wm->windowArray = NULL;
-		wm->windowCount = 0;
 	}
 
+	wm->windowCount = 0;
 	wm->MaxWindow = 0;
 	wm->SampleRate = 0;
 	wm->winType = 'n';
 }
 
+void ReleaseWindowCache(void)
+{
+	for(int i = 0; i < WINDOW_BUCKETS; i++)
+	{
+		while(windowCache[i])
+		{
+			windowUnit *next = NULL;
+
+			next = windowCache[i]->next;
+			free(windowCache[i]->window);
+			free(windowCache[i]);
+			windowCache[i] = next;
+		}
+	}
+	windowCacheCount = 0;
+}
+
 void printWindows(windowManager *wm)
 {
 	for(int i = 0; i < wm->windowCount; i++)
 	{
-		printf("WINDOW: %d frames %ld seconds %g size %ld pad: %ld real: %ld\n", i,
-			wm->windowArray[i].frames, wm->windowArray[i].seconds,
-			wm->windowArray[i].size, wm->windowArray[i].sizePadding,
-			wm->windowArray[i].realMemSize);
+		printf("WINDOW: %d frames %ld seconds %g size %ld pad: %ld real: %ld S2: %g gain: %g\n", i,
+			wm->windowArray[i]->frames, wm->windowArray[i]->seconds,
+			wm->windowArray[i]->size, wm->windowArray[i]->sizePadding,
+			wm->windowArray[i]->realMemSize, wm->windowArray[i]->S2,
+			wm->windowArray[i]->coherentGain);
 	}
 }
 
@@ -456,36 +580,6 @@ double *hammingWindow(long int n)
 	return(w);
 }
 
-double CalculateCorrectionFactor(windowManager *wm, long int frames)
-{
-	double		*window = NULL;
-	double		factor = 0, sum = 0;
-	long int	size = 0;
-
-	if(!wm)
-		return 1;
-
-	for(int i = 0; i < wm->windowCount; i++)
-	{
-		if(frames == wm->windowArray[i].frames)
-		{
-			window = wm->windowArray[i].window;
-			size = wm->windowArray[i].size;
-			break;
-		}
-	}
-
-	if(!window)
-		return 1;
-
-	for(long int i = 0; i < size; i++)
-		sum += window[i];
-	
-	factor = (double)size/sum;
-
-	return factor;
-}
-
 double CompensateValueForWindow(double value, char winType)
 {
 	switch(winType)
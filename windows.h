@@ -38,11 +38,13 @@ double *hammingWindow(long int n);
 double *rectWindow(long int n);
 
 int initWindows(windowManager *wm, double SampleRate, char winType, parameters *config);
+windowUnit *getWindowUnitByLength(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config);
 double *getWindowByLength(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config);
-double *CreateWindow(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config);
+windowUnit *CreateWindow(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config);
+double GetWindowEnergy(windowUnit *unit, long int length);
 void freeWindows(windowManager *windows);
+void ReleaseWindowCache(void);
 double CompensateValueForWindow(double value, char winType);
-double CalculateCorrectionFactor(windowManager *wm, long int frames);
 void printWindows(windowManager *wm);
 
 #endif